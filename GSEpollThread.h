@@ -0,0 +1,111 @@
+#if	!defined(INCLUDED_GSEPOLLTHREAD)
+#define	INCLUDED_GSEPOLLTHREAD	1
+/**
+   Copyright (C) 2026 Free Software Foundation, Inc.
+
+   Written by:  Richard Frith-Macdonald <rfm@gnu.org>
+   Date:        October 2026
+
+   This file is part of the Performance Library.
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 3 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; if not, write to the Free
+   Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111 USA.
+   */
+#import "GSIOThreadPool.h"
+
+/** GSEpollThread is a GSIOThread which, instead of running a standard
+ * run loop, runs a lean event loop built on the Linux epoll API, for
+ * threads handling very large numbers of file descriptors.<br />
+ * Descriptors are watched in edge-triggered mode, with a callback method
+ * being called for each batch of events, and timers are held in a
+ * binary heap, so neither involves creating objects per event.  The loop
+ * sleeps in epoll_wait() and is woken from other threads using an eventfd.
+ * <br />
+ * To use the class, call [GSIOThreadPool-setThreadClass:] with it as the
+ * argument, then acquire and release threads from the pool as usual.
+ * The -watchDescriptor:events:target:selector:, -unwatchDescriptor:,
+ * -scheduleTimer:target:selector:object: and -cancelTimer: methods must
+ * only be called in the thread itself, so work should be handed to the
+ * thread using [GSIOThread-postSelector:target:object:], which wakes the
+ * epoll loop using the eventfd rather than the run loop.<br />
+ * The standard run loop of the thread is still run (without blocking)
+ * from time to time (see -setRunLoopInterval:), so other code which
+ * performs selectors in the thread or schedules NSTimer instances in it
+ * continues to work, though with greater latency.<br />
+ * On systems without epoll, the watch and timer methods raise an
+ * NSInternalInconsistencyException.
+ */
+@interface	GSEpollThread : GSIOThread
+{
+@private
+  int			_epoll;		/** The epoll descriptor */
+  int			_wake;		/** The eventfd for wakeups */
+  void			*_watchers;	/** Watchers indexed by descriptor */
+  int			_watchLimit;	/** Size of watchers table */
+  void			*_heap;		/** Timer heap */
+  NSUInteger		_heapCount;
+  NSUInteger		_heapSize;
+  NSTimeInterval	_runLoopInterval;
+}
+
+/** Cancels a timer returned by -scheduleTimer:target:selector:object:
+ * so that it will not fire.  Does nothing if the timer has already fired
+ * (as long as the handle has been kept retained).
+ */
+- (void) cancelTimer: (id)timer;
+
+/** Returns the interval at which the standard run loop of the thread is
+ * run to handle performers and timers not managed by the epoll loop.
+ */
+- (NSTimeInterval) runLoopInterval;
+
+/** Schedules a timer to perform aSelector on aTarget with anObject as
+ * its argument, after the delay (in seconds).  The target and object are
+ * retained until the timer fires or is cancelled.<br />
+ * Returns an autoreleased opaque handle which may be passed to
+ * -cancelTimer: ... the caller must retain the handle if it may cancel
+ * the timer after the current autorelease pool is emptied.
+ */
+- (id) scheduleTimer: (NSTimeInterval)delay
+	      target: (id)aTarget
+	    selector: (SEL)aSelector
+	      object: (id)anObject;
+
+/** Sets the interval (in seconds) at which the standard run loop is
+ * checked for work (default 0.1).
+ */
+- (void) setRunLoopInterval: (NSTimeInterval)interval;
+
+/** Stops watching the file descriptor.  This must be called before the
+ * descriptor is closed.
+ */
+- (void) unwatchDescriptor: (int)fd;
+
+/** Watches the file descriptor for the specified epoll events (EPOLLIN,
+ * EPOLLOUT etc), in edge-triggered mode, so the handler must read or
+ * write until the operation would block before it can be called again.
+ * <br />
+ * When events occur, aSelector is performed on aTarget (which is
+ * retained until the descriptor is unwatched).  The method must have the
+ * signature -(void)descriptor:(int)fd events:(uint32_t)events<br />
+ * Watching a descriptor which is already watched replaces the previous
+ * events and handler.
+ */
+- (void) watchDescriptor: (int)fd
+		  events: (uint32_t)events
+		  target: (id)aTarget
+		selector: (SEL)aSelector;
+@end
+
+#endif
@@ -0,0 +1,621 @@
+/**
+   Copyright (C) 2026 Free Software Foundation, Inc.
+
+   Written by:  Richard Frith-Macdonald <rfm@gnu.org>
+   Date:        October 2026
+
+   This file is part of the Performance Library.
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 3 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; if not, write to the Free
+   Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111 USA.
+   */
+#include <inttypes.h>
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#if	defined(__linux__)
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#endif
+
+#import <Foundation/NSAutoreleasePool.h>
+#import <Foundation/NSDate.h>
+#import <Foundation/NSException.h>
+#import <Foundation/NSRunLoop.h>
+#import <Foundation/NSString.h>
+#import <Foundation/NSZone.h>
+#import "GSEpollThread.h"
+
+#if !defined (GNUSTEP)
+#import  "GNUstep.h"
+#endif
+
+/* Methods implemented in GSIOThreadPool.m
+ */
+@interface	GSIOThread (EpollPrivate)
+- (void) _drainMailbox;
+- (void) _probe: (NSTimer*)t;
+- (void) _setup;
+- (void) _signalMailbox;
+- (void) _slow: (id)target selector: (SEL)sel duration: (NSTimeInterval)d;
+- (NSTimeInterval) _slowThreshold;
+@end
+
+/* A timer in the heap.
+ */
+@interface	GSEpollTimer : NSObject
+{
+  @public
+  uint64_t	when;		// Nanoseconds
+  uint64_t	seq;		// Order of creation, for equal times
+  NSUInteger	index;		// Position in heap (NSNotFound if not there)
+  id		target;
+  SEL		sel;
+  id		object;
+}
+@end
+
+@implementation	GSEpollTimer
+- (void) dealloc
+{
+  [target release];
+  [object release];
+  [super dealloc];
+}
+@end
+
+/* A watched descriptor.  The generation is incremented each time the
+ * entry is changed, and is stored in the epoll event data with the
+ * descriptor, so that events already fetched for a descriptor which has
+ * since been unwatched (and perhaps reused) can be recognised and ignored.
+ */
+typedef struct {
+  id		target;
+  SEL		sel;
+  IMP		imp;
+  uint32_t	generation;
+} GSEpollWatcher;
+
+typedef void (*GSEpollHandler)(id, SEL, int, uint32_t);
+
+#define	EPOLL_BATCH	256
+
+static inline uint64_t
+now()
+{
+  struct timespec	ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static inline BOOL
+earlier(GSEpollTimer *a, GSEpollTimer *b)
+{
+  if (a->when == b->when)
+    {
+      return (a->seq < b->seq) ? YES : NO;
+    }
+  return (a->when < b->when) ? YES : NO;
+}
+
+/* Moves the timer at index i up or down the heap to its proper place.
+ */
+static void
+heapFix(GSEpollTimer **heap, NSUInteger count, NSUInteger i)
+{
+  GSEpollTimer	*t = heap[i];
+
+  while (i > 0)
+    {
+      NSUInteger	parent = (i - 1) / 2;
+
+      if (NO == earlier(t, heap[parent]))
+	{
+	  break;
+	}
+      heap[i] = heap[parent];
+      heap[i]->index = i;
+      i = parent;
+    }
+  for (;;)
+    {
+      NSUInteger	child = 2 * i + 1;
+
+      if (child >= count)
+	{
+	  break;
+	}
+      if (child + 1 < count && earlier(heap[child + 1], heap[child]))
+	{
+	  child++;
+	}
+      if (NO == earlier(heap[child], t))
+	{
+	  break;
+	}
+      heap[i] = heap[child];
+      heap[i]->index = i;
+      i = child;
+    }
+  heap[i] = t;
+  t->index = i;
+}
+
+@interface	GSEpollThread (Private)
+- (void) _remove: (GSEpollTimer*)t;
+- (void) _timers: (NSTimeInterval)threshold;
+@end
+
+@implementation	GSEpollThread
+
+#if	defined(__linux__)
+
+- (void) cancelTimer: (id)timer
+{
+  GSEpollTimer	*t = (GSEpollTimer*)timer;
+
+  if (nil != t && t->index < _heapCount
+    && ((GSEpollTimer**)_heap)[t->index] == t)
+    {
+      DESTROY(t->target);
+      DESTROY(t->object);
+      [self _remove: t];
+    }
+}
+
+- (void) dealloc
+{
+  GSEpollWatcher	*w = (GSEpollWatcher*)_watchers;
+  GSEpollTimer		**heap = (GSEpollTimer**)_heap;
+  int			fd;
+
+  for (fd = 0; fd < _watchLimit; fd++)
+    {
+      [w[fd].target release];
+    }
+  if (0 != w)
+    {
+      NSZoneFree(NSDefaultMallocZone(), w);
+    }
+  while (_heapCount > 0)
+    {
+      [heap[--_heapCount] release];
+    }
+  if (0 != heap)
+    {
+      NSZoneFree(NSDefaultMallocZone(), heap);
+    }
+  if (_epoll >= 0)
+    {
+      close(_epoll);
+    }
+  if (_wake >= 0)
+    {
+      close(_wake);
+    }
+  [super dealloc];
+}
+
+- (id) init
+{
+  if ((self = [super init]) != nil)
+    {
+      struct epoll_event	ev;
+
+      _runLoopInterval = 0.1;
+      _epoll = epoll_create1(EPOLL_CLOEXEC);
+      _wake = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+      if (_epoll < 0 || _wake < 0)
+	{
+	  NSLog(@"%@ unable to create epoll/eventfd descriptors: %d",
+	    self, errno);
+	  [self release];
+	  return nil;
+	}
+      ev.events = EPOLLIN | EPOLLET;
+      ev.data.u64 = (uint64_t)(uint32_t)_wake;
+      epoll_ctl(_epoll, EPOLL_CTL_ADD, _wake, &ev);
+    }
+  return self;
+}
+
+/* Run the epoll loop until terminated (-terminate: ends the thread
+ * using +[NSThread exit]).
+ */
+- (void) main
+{
+  NSAutoreleasePool	*arp = [NSAutoreleasePool new];
+  NSRunLoop		*loop = [NSRunLoop currentRunLoop];
+  struct epoll_event	events[EPOLL_BATCH];
+  uint64_t		nextRunLoop;
+
+  [self _setup];
+  nextRunLoop = now() + (uint64_t)(_runLoopInterval * 1000000000.0);
+  for (;;)
+    {
+      uint64_t	t = now();
+      uint64_t	limit = nextRunLoop;
+      NSTimeInterval	threshold = [self _slowThreshold];
+      int	timeout;
+      int	count;
+      int	i;
+
+      if (_heapCount > 0 && ((GSEpollTimer**)_heap)[0]->when < limit)
+	{
+	  limit = ((GSEpollTimer**)_heap)[0]->when;
+	}
+      timeout = (limit <= t) ? 0 : (int)((limit - t + 999999) / 1000000);
+      count = epoll_wait(_epoll, events, EPOLL_BATCH, timeout);
+      if (count < 0 && errno != EINTR)
+	{
+	  NSLog(@"%@ epoll_wait failed: %d", self, errno);
+	  break;
+	}
+      for (i = 0; i < count; i++)
+	{
+	  int		fd = (int)(events[i].data.u64 & 0xffffffff);
+	  uint32_t	gen = (uint32_t)(events[i].data.u64 >> 32);
+	  GSEpollWatcher	*w;
+	  id		target = nil;
+	  SEL		sel = 0;
+	  uint64_t	start = 0;
+
+	  if (fd == _wake)
+	    {
+	      uint64_t	v;
+
+	      while (read(_wake, &v, sizeof(v)) > 0)
+		;
+	      [self _drainMailbox];
+	      continue;
+	    }
+	  if (fd >= _watchLimit)
+	    {
+	      continue;
+	    }
+	  w = ((GSEpollWatcher*)_watchers) + fd;
+	  if (nil == w->target || w->generation != gen)
+	    {
+	      continue;		// Unwatched since the event was fetched
+	    }
+	  /* Keep the target in case the handler unwatches it (which would
+	   * release it while its method is still running).
+	   */
+	  target = [w->target retain];
+	  sel = w->sel;
+	  if (threshold > 0.0)
+	    {
+	      start = now();
+	    }
+	  NS_DURING
+	    {
+	      (*(GSEpollHandler)w->imp)(target, sel, fd, events[i].events);
+	    }
+	  NS_HANDLER
+	    {
+	      NSLog(@"%@ problem handling events for descriptor %d: %@",
+		self, fd, localException);
+	    }
+	  NS_ENDHANDLER
+	  if (threshold > 0.0)
+	    {
+	      NSTimeInterval	d = (now() - start) / 1000000000.0;
+
+	      if (d > threshold)
+		{
+		  [self _slow: target selector: sel duration: d];
+		}
+	    }
+	  [target release];
+	}
+      if (_heapCount > 0)
+	{
+	  [self _timers: threshold];
+	}
+      if ((t = now()) >= nextRunLoop)
+	{
+	  /* Let the standard run loop handle anything it has (without
+	   * waiting), including any termination timer.
+	   */
+	  [loop runMode: NSDefaultRunLoopMode
+	     beforeDate: [NSDate distantPast]];
+	  nextRunLoop = t + (uint64_t)(_runLoopInterval * 1000000000.0);
+	}
+      [arp release];
+      arp = [NSAutoreleasePool new];
+    }
+  [arp release];
+}
+
+/* Calls which target this thread object itself (as GSIOThreadPool does
+ * to terminate threads) are posted to the mailbox, so they do not depend
+ * upon the standard run loop.
+ */
+- (void) performSelector: (SEL)aSelector
+		onThread: (NSThread*)thr
+	      withObject: (id)arg
+	   waitUntilDone: (BOOL)wait
+{
+  if (thr != self || YES == wait || YES == [self isFinished])
+    {
+      if (thr == self && YES == wait && [NSThread currentThread] == self)
+	{
+	  [self performSelector: aSelector withObject: arg];
+	}
+      else
+	{
+	  [super performSelector: aSelector
+			onThread: thr
+		      withObject: arg
+		   waitUntilDone: wait];
+	}
+    }
+  else
+    {
+      [self postSelector: aSelector target: self object: arg];
+    }
+}
+
+- (id) scheduleTimer: (NSTimeInterval)delay
+	      target: (id)aTarget
+	    selector: (SEL)aSelector
+	      object: (id)anObject
+{
+  static uint64_t	sequence = 0;
+  GSEpollTimer		*t;
+
+  if (nil == aTarget || 0 == aSelector)
+    {
+      [NSException raise: NSInvalidArgumentException
+		  format: @"Nil target or null selector"];
+    }
+  if (_heapCount == _heapSize)
+    {
+      _heapSize = (0 == _heapSize) ? 64 : _heapSize * 2;
+      _heap = NSZoneRealloc(NSDefaultMallocZone(), _heap,
+	_heapSize * sizeof(GSEpollTimer*));
+    }
+  t = [GSEpollTimer new];
+  t->when = now();
+  if (delay > 0.0)
+    {
+      t->when += (uint64_t)(delay * 1000000000.0);
+    }
+  t->seq = __sync_add_and_fetch(&sequence, 1);
+  t->target = [aTarget retain];
+  t->sel = aSelector;
+  t->object = [anObject retain];
+  ((GSEpollTimer**)_heap)[_heapCount++] = t;	// Heap owns reference
+  heapFix((GSEpollTimer**)_heap, _heapCount, _heapCount - 1);
+
+  /* The heap releases the timer when it fires, so the caller needs its
+   * own reference in order to cancel it safely.
+   */
+  return [[t retain] autorelease];
+}
+
+/* The load probe uses a timer in our heap rather than an NSTimer, so that
+ * it measures the epoll loop rather than the periodic polling of the
+ * standard run loop.
+ */
+- (id) _scheduleProbe: (NSTimeInterval)interval
+{
+  return [[self scheduleTimer: interval
+		       target: self
+		     selector: @selector(_probe:)
+		       object: nil] retain];
+}
+
+- (void) _cancelProbe: (id)handle
+{
+  [self cancelTimer: handle];
+}
+
+/* Wakes the epoll loop to drain the mailbox.
+ */
+- (void) _signalMailbox
+{
+  uint64_t	v = 1;
+
+  if (write(_wake, &v, sizeof(v)) < 0 && EAGAIN != errno)
+    {
+      NSLog(@"%@ unable to wake thread: %d", self, errno);
+    }
+}
+
+- (void) unwatchDescriptor: (int)fd
+{
+  GSEpollWatcher	*w;
+
+  if (fd < 0 || fd >= _watchLimit)
+    {
+      return;
+    }
+  w = ((GSEpollWatcher*)_watchers) + fd;
+  if (nil != w->target)
+    {
+      epoll_ctl(_epoll, EPOLL_CTL_DEL, fd, 0);
+      DESTROY(w->target);
+      w->sel = 0;
+      w->imp = 0;
+      w->generation++;
+    }
+}
+
+- (void) watchDescriptor: (int)fd
+		  events: (uint32_t)events
+		  target: (id)aTarget
+		selector: (SEL)aSelector
+{
+  struct epoll_event	ev;
+  GSEpollWatcher	*w;
+  IMP			imp;
+  int			op;
+
+  if (fd < 0 || nil == aTarget || 0 == aSelector)
+    {
+      [NSException raise: NSInvalidArgumentException
+		  format: @"Bad descriptor, target or selector"];
+    }
+  if (0 == (imp = [aTarget methodForSelector: aSelector]))
+    {
+      [NSException raise: NSInvalidArgumentException
+		  format: @"Target does not implement %@",
+	NSStringFromSelector(aSelector)];
+    }
+  if (fd >= _watchLimit)
+    {
+      int	limit = (0 == _watchLimit) ? 1024 : _watchLimit;
+
+      while (limit <= fd)
+	{
+	  limit *= 2;
+	}
+      _watchers = NSZoneRealloc(NSDefaultMallocZone(), _watchers,
+	limit * sizeof(GSEpollWatcher));
+      memset(((GSEpollWatcher*)_watchers) + _watchLimit, '\0',
+	(limit - _watchLimit) * sizeof(GSEpollWatcher));
+      _watchLimit = limit;
+    }
+  w = ((GSEpollWatcher*)_watchers) + fd;
+  op = (nil == w->target) ? EPOLL_CTL_ADD : EPOLL_CTL_MOD;
+  w->generation++;
+  ev.events = events | EPOLLET;
+  ev.data.u64 = ((uint64_t)w->generation << 32) | (uint32_t)fd;
+  if (epoll_ctl(_epoll, op, fd, &ev) < 0)
+    {
+      [NSException raise: NSInvalidArgumentException
+		  format: @"Unable to watch descriptor %d: %d", fd, errno];
+    }
+  ASSIGN(w->target, aTarget);
+  w->sel = aSelector;
+  w->imp = imp;
+}
+
+#else	/* No epoll */
+
+- (void) cancelTimer: (id)timer
+{
+  [NSException raise: NSInternalInconsistencyException
+	      format: @"GSEpollThread needs epoll"];
+}
+
+- (id) scheduleTimer: (NSTimeInterval)delay
+	      target: (id)aTarget
+	    selector: (SEL)aSelector
+	      object: (id)anObject
+{
+  [NSException raise: NSInternalInconsistencyException
+	      format: @"GSEpollThread needs epoll"];
+  return nil;
+}
+
+- (void) unwatchDescriptor: (int)fd
+{
+  [NSException raise: NSInternalInconsistencyException
+	      format: @"GSEpollThread needs epoll"];
+}
+
+- (void) watchDescriptor: (int)fd
+		  events: (uint32_t)events
+		  target: (id)aTarget
+		selector: (SEL)aSelector
+{
+  [NSException raise: NSInternalInconsistencyException
+	      format: @"GSEpollThread needs epoll"];
+}
+
+#endif
+
+- (NSTimeInterval) runLoopInterval
+{
+  return _runLoopInterval;
+}
+
+- (void) setRunLoopInterval: (NSTimeInterval)interval
+{
+  if (interval < 0.001)
+    {
+      interval = 0.001;
+    }
+  _runLoopInterval = interval;
+}
+
+@end
+
+@implementation	GSEpollThread (Private)
+
+/* Removes a timer from the heap and releases it.
+ */
+- (void) _remove: (GSEpollTimer*)t
+{
+  GSEpollTimer	**heap = (GSEpollTimer**)_heap;
+  NSUInteger	i = t->index;
+
+  _heapCount--;
+  if (i < _heapCount)
+    {
+      heap[i] = heap[_heapCount];
+      heap[i]->index = i;
+      heapFix(heap, _heapCount, i);
+    }
+  t->index = NSNotFound;
+  [t release];
+}
+
+/* Fires all the timers which are due, recording any which take longer
+ * than threshold (if it is non-zero).
+ */
+- (void) _timers: (NSTimeInterval)threshold
+{
+#if	defined(__linux__)
+  uint64_t	t = now();
+
+  while (_heapCount > 0 && ((GSEpollTimer**)_heap)[0]->when <= t)
+    {
+      GSEpollTimer	*timer = [((GSEpollTimer**)_heap)[0] retain];
+      uint64_t		start;
+
+      [self _remove: timer];
+      start = (threshold > 0.0) ? now() : 0;
+      NS_DURING
+	{
+	  [timer->target performSelector: timer->sel
+			      withObject: timer->object];
+	}
+      NS_HANDLER
+	{
+	  NSLog(@"%@ problem firing timer %@: %@", self,
+	    NSStringFromSelector(timer->sel), localException);
+	}
+      NS_ENDHANDLER
+      if (threshold > 0.0 && (now() - start) / 1000000000.0 > threshold)
+	{
+	  [self _slow: timer->target
+	     selector: timer->sel
+	     duration: (now() - start) / 1000000000.0];
+	}
+      /* The handle may be kept by the caller, so drop the references
+       * to the target and object now that they are no longer needed.
+       */
+      DESTROY(timer->target);
+      DESTROY(timer->object);
+      [timer release];
+    }
+#endif
+}
+
+@end
@@ -29,13 +29,44 @@
 #import  "GNUstep.h"
 #endif
 
+#include <stdio.h>
+#include <string.h>
 
 @class NSArray;
 @class NSCondition;
+@class NSData;
 @class NSNumber;
 @class NSString;
 @class NSThread;
 
+/** Function type used to serialise an item when it is spilled to disk.<br />
+ * The function must return an autoreleased NSData object containing the
+ * encoding of the item, and must not release the item; the FIFO releases
+ * it once the encoding has been written to disk (so spilled items must
+ * be objects, though they need not conform to NSCoding).
+ */
+typedef NSData *(*GSFIFOSpillEncoder)(void *item);
+
+/** Function type used to restore an item spilled to disk.<br />
+ * The function must return a new item (owned by the caller) decoded
+ * from the data produced by the matching GSFIFOSpillEncoder.
+ */
+typedef void *(*GSFIFOSpillDecoder)(NSData *data);
+
+/** Notification posted (in the thread which added the item) when the
+ * number of items in a FIFO reaches its high watermark.<br />
+ * The notification object is the FIFO.  It is not posted again until
+ * the low watermark notification has been posted.
+ */
+extern NSString * const GSFIFOHighWatermarkNotification;
+
+/** Notification posted (in the thread which removed the item) when the
+ * number of items in a FIFO which had reached its high watermark drops
+ * to its low watermark.<br />
+ * The notification object is the FIFO.
+ */
+extern NSString * const GSFIFOLowWatermarkNotification;
+
 
 /** GSFIFO manages a first-in-first-out queue of items.<br />
  * Items in the queue are <em>NOT</em> retained objects ... memory management
@@ -69,7 +100,15 @@
  * While a FIFO fundamentally works on abstract items without memory
  * management, the API provides methods for handling NSObject values
  * threating the FIFO as a container which retains the objects until
- * they are removed from the FIFO.
+ * they are removed from the FIFO.<br />
+ * A FIFO may alternatively be initialised to hold fixed size records
+ * (see -initWithCapacity:recordSize:name:) which are copied into and
+ * out of the FIFO buffer, so that small messages can be passed between
+ * threads without any per-item memory allocation or retain/release.
+ * Such a FIFO must be used with the record methods (-getRecord:,
+ * -putRecord: etc) and the GSGetFastNonBlockingRecordFIFO() and
+ * GSPutFastNonBlockingRecordFIFO() functions rather than the pointer
+ * and object based methods.
  */
 @interface	GSFIFO : NSObject
 {
@@ -86,6 +125,10 @@
   uint64_t		_putTrySuccess;
   void			**_items;
   uint32_t		_capacity;
+  uint32_t		_recordSize;
+  uint32_t		_highWatermark;
+  uint32_t		_lowWatermark;
+  volatile BOOL		_aboveHigh;
 @private
   uint32_t		boundsCount;
   uint16_t		granularity;
@@ -101,6 +144,21 @@
   uint64_t		*putWaitCounts;		// Waits for puts by time
   NSThread		*getThread;		// Single consumer thread
   NSThread		*putThread;		// Single producer thread
+  NSString		*spillPath;		// Spill directory (or nil)
+  NSString		*spillName;		// Segment file name prefix
+  GSFIFOSpillEncoder	spillEncoder;		// Item serialisation
+  GSFIFOSpillDecoder	spillDecoder;		// Item deserialisation
+  FILE			*spillIn;		// Segment being read
+  FILE			*spillOut;		// Segment being written
+  uint32_t		spillReadSeq;		// Number of read segment
+  uint32_t		spillWriteSeq;		// Number of write segment
+  uint32_t		spillSegment;		// Max bytes per segment
+  uint32_t		spillWriteSize;		// Bytes in write segment
+  volatile uint64_t	spillPending;		// Items on disk
+  uint64_t		spillItems;		// Total items spilled
+  uint64_t		spillBytes;		// Total bytes spilled
+  uint64_t		spillRestored;		// Total items restored
+  NSTimeInterval	spillStarted;		// When spilling was enabled
 }
 
 /** Return statistics for all current GSFIFO instances.<br />
@@ -111,7 +169,8 @@
  */
 + (NSString*) stats;
 
-/** Returns the approximate number of items in the FIFO.
+/** Returns the approximate number of items in the FIFO
+ * (including any items which have been spilled to disk).
  */
 - (NSUInteger) count;
 
@@ -134,6 +193,33 @@
      shouldBlock: (BOOL)block
           before: (NSDate*)date;
 
+/** Reads up to count records from a record FIFO into buf (which must
+ * have space for count records of the size returned by -recordSize).<br />
+ * If block is YES, this blocks if necessary until at least one record
+ * is available, and raises an exception if the FIFO is configured
+ * with a timeout and it is exceeded.<br />
+ * Returns the number of records actually read.
+ */
+- (unsigned) getRecords: (void*)buf
+		  count: (unsigned)count
+	    shouldBlock: (BOOL)block;
+
+/** Reads up to count records from a record FIFO into buf.  If blocking is
+ * requested and a before date is specified, the operation blocks until the
+ * specified time and returns 0 if it could not read any records.  The
+ * timeout configured for the FIFO still takes precedence.
+ */
+- (unsigned) getRecords: (void*)buf
+		  count: (unsigned)count
+	    shouldBlock: (BOOL)block
+		 before: (NSDate*)date;
+
+/** Copies the next record from a record FIFO into the memory at record,
+ * blocking if necessary until a record is available.  Raises an exception
+ * if the FIFO is configured with a timeout and it is exceeded.
+ */
+- (void) getRecord: (void*)record;
+
 /** Reads up to count objects from the FIFO (which must contain objects
  * or nil items) into buf and autoreleases them.<br />
  * If block is YES, this blocks if necessary until at least one object
@@ -203,8 +289,27 @@
  * The name string is a unique identifier for the receiver and is used when
  * printing diagnostics and statistics.  If an instance with the same name
  * already exists, the receiveris deallocated and an exception is raised.
+ * A nil name creates an anonymous FIFO, which is not included in +stats
+ * (useful for FIFOs used internally by other objects).
+ */
+- (id) initWithCapacity: (uint32_t)c
+	    granularity: (uint16_t)g
+		timeout: (uint16_t)t
+	  multiProducer: (BOOL)mp
+	  multiConsumer: (BOOL)mc
+	     boundaries: (NSArray*)a
+		   name: (NSString*)n;
+
+/** Initialises the receiver as for
+ * -initWithCapacity:granularity:timeout:multiProducer:multiConsumer:boundaries:name:
+ * but with a buffer holding records of a fixed size rather than pointers
+ * (if r is zero a normal pointer based FIFO is created).<br />
+ * The record size must not exceed 65536 bytes and the total buffer size
+ * (capacity multiplied by record size) must not exceed 1GB, otherwise the
+ * receiver is deallocated and this method returns nil.
  */
 - (id) initWithCapacity: (uint32_t)c
+	     recordSize: (uint32_t)r
 	    granularity: (uint16_t)g
 		timeout: (uint16_t)t
 	  multiProducer: (BOOL)mp
@@ -212,6 +317,14 @@
 	     boundaries: (NSArray*)a
 		   name: (NSString*)n;
 
+/** Initialises the receiver as a multi-producer, multi-consumer FIFO of
+ * records of size r, obtaining configuration overrides from the
+ * NSUserDefaults system as specified in -initWithName:
+ */
+- (id) initWithCapacity: (uint32_t)c
+	     recordSize: (uint32_t)r
+		   name: (NSString*)n;
+
 /** Initialises the receiver as a multi-producer, multi-consumer FIFO with
  * no timeout and with default stats gathering enabled.<br />
  * However, these values (including the supplied capacity) may be overridden
@@ -230,6 +343,13 @@
  * The GSFIFOSingleConsumerNNN boolean is NO by default.<br />
  * The GSFIFOSingleProducerNNN boolean is NO by default.<br />
  * The GSFIFOBoundariesNNN array is missing by default.<br />
+ * The GSFIFOSpillDirectoryNNN string is missing by default, but if it
+ * is set the FIFO is configured to spill objects to disk in that directory
+ * (see -setSpillDirectory:segmentSize:encoder:decoder:).<br />
+ * The GSFIFOSpillSegmentNNN integer is the spill segment size in bytes
+ * (zero by default, meaning the standard size is used).<br />
+ * The GSFIFOHighWatermarkNNN and GSFIFOLowWatermarkNNN integers are zero
+ * by default (see -setHighWatermark:lowWatermark:).<br />
  * If no default is found for the specific named FIFO, the default set
  * for a FIFO with an empty name is used.
  */
@@ -253,6 +373,27 @@
  */
 - (unsigned) put: (void**)buf count: (unsigned)count shouldBlock: (BOOL)block;
 
+/** Copies up to count records from buf into a record FIFO.
+ * If block is YES, this blocks if necessary until at least one record
+ * can be written, and raises an exception if the FIFO is configured
+ * with a timeout and it is exceeded.<br />
+ * Returns the number of records actually written.
+ */
+- (unsigned) putRecords: (const void*)buf
+		  count: (unsigned)count
+	    shouldBlock: (BOOL)block;
+
+/** Copies a record into a record FIFO, blocking if necessary until
+ * there is space in the buffer.  Raises an exception if the FIFO is
+ * configured with a timeout and it is exceeded.
+ */
+- (void) putRecord: (const void*)record;
+
+/** Returns the size of the records held by the receiver, or zero if
+ * the receiver is a normal FIFO of pointers/objects.
+ */
+- (uint32_t) recordSize;
+
 /** Writes up to count objects from buf into the FIFO, retaining each.<br />
  * If block is YES, this blocks if necessary until at least one object
  * can be written, and raises an exception if the FIFO is configured
@@ -290,7 +431,67 @@
  */
 - (void) putObjectConsumed: (NSObject*) NS_CONSUMED item;
 
+/** Configures the receiver to spill items to disk rather than blocking
+ * producers (or raising a timeout exception) when the FIFO is full.<br />
+ * Once the in-memory buffer fills, items are serialised into append-only
+ * segment files in the directory at path, with a new segment being
+ * started each time the current one exceeds size bytes (if size is
+ * zero a segment size of 64MB is used).  While there are items on disk,
+ * new items are also spilled so that ordering is maintained, and
+ * consumers read the spilled items (in order) only after the items in
+ * the buffer, returning to use of the buffer once the spill files are
+ * drained.<br />
+ * Segment files are named from the (sanitised) FIFO name, the process
+ * ID and a number unique to the receiver, so several processes or FIFOs
+ * may safely share a directory.<br />
+ * Spill files are written and read with the receiver's lock held, so
+ * while items are being spilled or restored the other producers and
+ * consumers wait for the disk.  Segments are flushed after each write
+ * but not synced, so spilled items do not survive a system crash.<br />
+ * If enc and dec are NULL, the FIFO must contain objects conforming to
+ * the NSCoding protocol (as added using the -putObject: family of methods)
+ * and these are archived when spilled and unarchived when restored.
+ * For a record FIFO the records are written to disk unchanged and the
+ * encoder and decoder are not used.<br />
+ * Passing a nil path turns spilling off (which is only permitted when
+ * there are no items on disk).<br />
+ * Spilling is only supported for FIFOs configured for multiple producers
+ * or consumers (the inline functions for lock-free access do not check
+ * for spilled items), and an exception is raised if the receiver is
+ * lock-free.<br />
+ * While items are on disk, the -peek and -peekObject methods will only
+ * examine the in-memory buffer.
+ */
+- (void) setSpillDirectory: (NSString*)path
+	       segmentSize: (uint32_t)size
+		   encoder: (GSFIFOSpillEncoder)enc
+		   decoder: (GSFIFOSpillDecoder)dec;
+
+/** Sets the number of items at which the receiver posts a
+ * GSFIFOHighWatermarkNotification, and the number of items to which
+ * the FIFO must subsequently drain before it posts a
+ * GSFIFOLowWatermarkNotification.  Each notification is posted once
+ * per crossing, so producers may use them to slow down (eg stop reading
+ * from a network connection) before the FIFO actually fills.<br />
+ * Setting a high watermark of zero turns this off.  Otherwise the high
+ * watermark must not exceed the capacity and the low watermark must be
+ * less than the high one.<br />
+ * For a lock-free FIFO, crossings are detected on a best effort basis
+ * by the producer and consumer threads.
+ */
+- (void) setHighWatermark: (uint32_t)high lowWatermark: (uint32_t)low;
+
+/** Returns the fill ratio of the receiver (the number of items it
+ * contains divided by its capacity).  This is cheap enough to be
+ * checked before each read from an upstream source.<br />
+ * The value may exceed 1.0 if items have been spilled to disk.
+ */
+- (double) pressure;
+
 /** Return any available statistics for the receiver.<br />
+ * For a FIFO configured to spill to disk, this includes the number of
+ * items and bytes spilled, the number of items restored, and the average
+ * spill and restore rates (items per second) since spilling was enabled.
  */
 - (NSString*) stats;
 
@@ -333,6 +534,23 @@
  */
 - (NSObject*) peekObject;
 
+/** Copies the first available record of a record FIFO into record
+ * without removing it from the FIFO.<br />
+ * Returns NO (leaving record unchanged) if the FIFO is empty.
+ */
+- (BOOL) peekRecord: (void*)record;
+
+/** Copies the first available record of a record FIFO into record,
+ * removing it from the FIFO.<br />
+ * Returns NO (leaving record unchanged) if the FIFO is empty.
+ */
+- (BOOL) tryGetRecord: (void*)record;
+
+/** Attempts to copy a record into a record FIFO, returning YES on
+ * success or NO if the FIFO is full.
+ */
+- (BOOL) tryPutRecord: (const void*)record;
+
 /** Attempts to put an object (or nil) into the FIFO, returning YES
  * on success or NO if the FIFO is full.<br />
  * Implemented using -put:count:shouldBlock:
@@ -346,6 +564,13 @@
 - (BOOL) tryPutObject: (NSObject*)item;
 @end
 
+/** Checks whether the receiver has crossed its high or low watermark
+ * and posts the appropriate notification if it has.<br />
+ * Used by the inline functions for lock-free FIFOs.
+ */
+extern void
+GSFIFOCheckWatermarks(GSFIFO *receiver);
+
 /** Function to efficiently get an item from a fast FIFO.<br />
  * Returns NULL if the FIFO is empty.<br />
  * Warning ... only for use if the FIFO is NOT configured for multiple
@@ -361,6 +586,10 @@ GSGetFastNonBlockingFIFO(GSFIFO *receiver)
       item = receiver->_items[receiver->_tail % receiver->_capacity];
       receiver->_tail++;
       receiver->_getTrySuccess++;
+      if (receiver->_highWatermark > 0)
+	{
+	  GSFIFOCheckWatermarks(receiver);
+	}
       return item;
     }
   receiver->_getTryFailure++;
@@ -397,6 +626,10 @@ GSPutFastNonBlockingFIFO(GSFIFO *receiver, void *item)
       receiver->_items[receiver->_head % receiver->_capacity] = item;
       receiver->_head++;
       receiver->_putTrySuccess++;
+      if (receiver->_highWatermark > 0)
+	{
+	  GSFIFOCheckWatermarks(receiver);
+	}
       return YES;
     }
   receiver->_putTryFailure++;
@@ -418,4 +651,84 @@ GSPutFastFIFO(GSFIFO *receiver, void *item)
     }
 }
 
+/** Function to efficiently copy a record from a fast record FIFO.<br />
+ * Returns YES on success, NO on failure (FIFO is empty).<br />
+ * Warning ... only for use if the FIFO is NOT configured for multiple
+ * consumers.
+ */
+static inline BOOL
+GSGetFastNonBlockingRecordFIFO(GSFIFO *receiver, void *record)
+{
+  if (receiver->_head > receiver->_tail)
+    {
+      memcpy(record, ((uint8_t*)receiver->_items)
+	+ (receiver->_tail % receiver->_capacity) * receiver->_recordSize,
+	receiver->_recordSize);
+      receiver->_tail++;
+      receiver->_getTrySuccess++;
+      if (receiver->_highWatermark > 0)
+	{
+	  GSFIFOCheckWatermarks(receiver);
+	}
+      return YES;
+    }
+  receiver->_getTryFailure++;
+  return NO;
+}
+
+/** Function to efficiently copy a record from a fast record FIFO,
+ * blocking if necessary until a record is available or the timeout
+ * occurs.<br />
+ * Warning ... only for use if the FIFO is NOT configured for multiple
+ * consumers.
+ */
+static inline void
+GSGetFastRecordFIFO(GSFIFO *receiver, void *record)
+{
+  if (NO == GSGetFastNonBlockingRecordFIFO(receiver, record))
+    {
+      [receiver getRecord: record];
+    }
+}
+
+/** Function to efficiently copy a record into a fast record FIFO.<br />
+ * Returns YES on success, NO on failure (FIFO is full).<br />
+ * Warning ... only for use if the FIFO is NOT configured for multiple
+ * producers.
+ */
+static inline BOOL
+GSPutFastNonBlockingRecordFIFO(GSFIFO *receiver, const void *record)
+{
+  if (receiver->_head - receiver->_tail < receiver->_capacity)
+    {
+      memcpy(((uint8_t*)receiver->_items)
+	+ (receiver->_head % receiver->_capacity) * receiver->_recordSize,
+	record, receiver->_recordSize);
+      receiver->_head++;
+      receiver->_putTrySuccess++;
+      if (receiver->_highWatermark > 0)
+	{
+	  GSFIFOCheckWatermarks(receiver);
+	}
+      return YES;
+    }
+  receiver->_putTryFailure++;
+  return NO;
+}
+
+/** Function to efficiently copy a record into a fast record FIFO,
+ * blocking if necessary until there is space in the FIFO or until the
+ * timeout occurs.<br />
+ * Warning ... only for use if the FIFO is NOT configured for multiple
+ * producers.
+ */
+static inline void
+GSPutFastRecordFIFO(GSFIFO *receiver, const void *record)
+{
+  if (NO == GSPutFastNonBlockingRecordFIFO(receiver, record))
+    {
+      [receiver putRecord: record];
+    }
+}
+
 #endif
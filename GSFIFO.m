@@ -22,9 +22,13 @@
    */
 #import "GSFIFO.h"
 #import <Foundation/NSArray.h>
+#import <Foundation/NSAutoreleasePool.h>
+#import <Foundation/NSData.h>
 #import <Foundation/NSException.h>
+#import <Foundation/NSKeyedArchiver.h>
 #import <Foundation/NSLock.h>
 #import <Foundation/NSMapTable.h>
+#import <Foundation/NSNotification.h>
 #import <Foundation/NSString.h>
 #import <Foundation/NSThread.h>
 #import <Foundation/NSUserDefaults.h>
@@ -36,6 +40,13 @@
 #endif
 
 #include <inttypes.h>
+#include <string.h>
+#include <unistd.h>
+
+NSString * const GSFIFOHighWatermarkNotification
+  = @"GSFIFOHighWatermarkNotification";
+NSString * const GSFIFOLowWatermarkNotification
+  = @"GSFIFOLowWatermarkNotification";
 
 @implementation	GSFIFO
 
@@ -45,6 +56,7 @@ static NSArray		*defaultBoundaries = nil;
 static Class		NSDateClass = 0;
 static SEL		tiSel = 0;
 static NSTimeInterval	(*tiImp)(Class, SEL) = 0;
+static uint32_t		spillInstances = 0;
 
 #define	NOW	((*tiImp)(NSDateClass, tiSel))
 
@@ -86,6 +98,127 @@ stats(NSTimeInterval ti, uint32_t max, NSTimeInterval *bounds, uint64_t *bands)
     }
 }
 
+/* Default spill encoder ... archives an object.
+ */
+static NSData *
+spillEncode(void *item)
+{
+  return [NSKeyedArchiver archivedDataWithRootObject: (id)item];
+}
+
+/* Default spill decoder ... unarchives an object and returns it retained.
+ */
+static void *
+spillDecode(NSData *data)
+{
+  return [[NSKeyedUnarchiver unarchiveObjectWithData: data] retain];
+}
+
+/* Removes the item (pointer or record) at the tail of the buffer and
+ * stores it at position index in buf.
+ */
+static inline void
+takeItem(GSFIFO *f, void *buf, unsigned index)
+{
+  uint32_t	pos = (uint32_t)(f->_tail % f->_capacity);
+
+  if (0 == f->_recordSize)
+    {
+      ((void**)buf)[index] = f->_items[pos];
+    }
+  else
+    {
+      memcpy(((uint8_t*)buf) + index * f->_recordSize,
+	((uint8_t*)f->_items) + pos * f->_recordSize, f->_recordSize);
+    }
+  f->_tail++;
+}
+
+/* Adds the item (pointer or record) at position index in buf to the
+ * head of the buffer.
+ */
+static inline void
+giveItem(GSFIFO *f, const void *buf, unsigned index)
+{
+  uint32_t	pos = (uint32_t)(f->_head % f->_capacity);
+
+  if (0 == f->_recordSize)
+    {
+      f->_items[pos] = ((void**)buf)[index];
+    }
+  else
+    {
+      memcpy(((uint8_t*)f->_items) + pos * f->_recordSize,
+	((const uint8_t*)buf) + index * f->_recordSize, f->_recordSize);
+    }
+  f->_head++;
+}
+
+/* Checks for a watermark crossing, returning 1 if the high watermark has
+ * just been reached, -1 if the count has just dropped to the low watermark
+ * and 0 otherwise.  For a locking FIFO this must be called with the lock
+ * held, and any notification posted after the lock is released.
+ * For a lock-free FIFO the producer and consumer may both call this at
+ * once, so the flag is changed using compare-and-swap and only the
+ * thread which actually changes it reports the crossing.
+ */
+static inline int
+watermark(GSFIFO *f)
+{
+  if (f->_highWatermark > 0)
+    {
+      uint64_t	c = f->_head - f->_tail + f->spillPending;
+
+      if (NO == f->_aboveHigh)
+	{
+	  if (c >= f->_highWatermark
+	    && __sync_bool_compare_and_swap(&f->_aboveHigh, NO, YES))
+	    {
+	      return 1;
+	    }
+	}
+      else if (c <= f->_lowWatermark
+	&& __sync_bool_compare_and_swap(&f->_aboveHigh, YES, NO))
+	{
+	  return -1;
+	}
+    }
+  return 0;
+}
+
+static void
+postWatermark(GSFIFO *f, int w)
+{
+  NSAutoreleasePool	*arp = [NSAutoreleasePool new];
+
+  [[NSNotificationCenter defaultCenter]
+    postNotificationName: (w > 0) ? GSFIFOHighWatermarkNotification
+      : GSFIFOLowWatermarkNotification
+    object: f];
+  [arp release];
+}
+
+void
+GSFIFOCheckWatermarks(GSFIFO *receiver)
+{
+  int	w = watermark(receiver);
+
+  if (0 != w)
+    {
+      postWatermark(receiver, w);
+    }
+}
+
+#define	POINTERS	if (_recordSize > 0) \
+[NSException raise: NSInternalInconsistencyException \
+  format: @"[%@-%@] called for record FIFO %@", \
+  NSStringFromClass([self class]), NSStringFromSelector(_cmd), name];
+
+#define	RECORDS	if (0 == _recordSize) \
+[NSException raise: NSInternalInconsistencyException \
+  format: @"[%@-%@] called for non-record FIFO %@", \
+  NSStringFromClass([self class]), NSStringFromSelector(_cmd), name];
+
 + (void) initialize
 {
   if (nil == defaultBoundaries)
@@ -129,7 +262,235 @@ stats(NSTimeInterval ti, uint32_t max, NSTimeInterval *bounds, uint64_t *bands)
   return m;
 }
 
-- (unsigned) _cooperatingGet: (void**)buf
+/* Returns the file system path of the spill segment with the given number.
+ */
+- (const char*) _spillFile: (uint32_t)seq
+{
+  NSString	*p;
+
+  p = [NSString stringWithFormat: @"%@/%@.%"PRIu32".spill",
+    spillPath, spillName, seq];
+  return [p fileSystemRepresentation];
+}
+
+/* Closes any open spill segments and removes them from disk.
+ * Must be called with the condition locked (or from -dealloc).
+ */
+- (void) _spillReset
+{
+  if (0 != spillIn)
+    {
+      fclose(spillIn);
+      spillIn = 0;
+    }
+  if (0 != spillOut)
+    {
+      fclose(spillOut);
+      spillOut = 0;
+    }
+  if (nil != spillPath)
+    {
+      while (spillReadSeq <= spillWriteSeq)
+	{
+	  unlink([self _spillFile: spillReadSeq++]);
+	}
+    }
+  spillReadSeq = 1;
+  spillWriteSeq = 0;
+  spillWriteSize = 0;
+  spillPending = 0;
+}
+
+/* Appends count items to the spill segments, starting a new segment
+ * whenever the current one reaches the configured size.
+ * The whole batch is encoded into memory and written at once, and the
+ * items are only released (and counted) once the write has succeeded,
+ * so a failure leaves the items with the caller and the segment as it
+ * was before the attempt.
+ * The write is done with the lock held (so that segments hold items in
+ * FIFO order), which means consumers wait while we are writing.
+ * Must be called with the condition locked ... unlocks it before raising
+ * an exception if writing fails.
+ */
+- (void) _spill: (const void*)buf count: (unsigned)count
+{
+  NSAutoreleasePool	*arp = [NSAutoreleasePool new];
+  NSMutableData		*batch = [NSMutableData data];
+  BOOL			opened = NO;
+  long			pos = 0;
+  unsigned		index;
+
+  for (index = 0; index < count; index++)
+    {
+      const void	*bytes;
+      uint32_t		len;
+
+      if (_recordSize > 0)
+	{
+	  /* Records are simply copied to disk.
+	   */
+	  bytes = ((const uint8_t*)buf) + index * _recordSize;
+	  len = _recordSize;
+	}
+      else
+	{
+	  NSData	*d = (*spillEncoder)(((void**)buf)[index]);
+
+	  bytes = [d bytes];
+	  len = (uint32_t)[d length];
+	}
+      [batch appendBytes: &len length: sizeof(len)];
+      [batch appendBytes: bytes length: len];
+    }
+
+  if (0 == spillOut || spillWriteSize >= spillSegment)
+    {
+      if (0 != spillOut)
+	{
+	  fclose(spillOut);
+	}
+      spillWriteSize = 0;
+      spillOut = fopen([self _spillFile: spillWriteSeq + 1], "wb");
+      opened = YES;
+    }
+  if (0 != spillOut)
+    {
+      pos = ftell(spillOut);
+    }
+  if (0 == spillOut
+    || fwrite([batch bytes], [batch length], 1, spillOut) != 1
+    || fflush(spillOut) != 0)
+    {
+      if (0 != spillOut)
+	{
+	  /* Discard any partial write so the segment stays readable.
+	   */
+	  clearerr(spillOut);
+	  if (YES == opened)
+	    {
+	      fclose(spillOut);
+	      spillOut = 0;
+	      unlink([self _spillFile: spillWriteSeq + 1]);
+	    }
+	  else
+	    {
+	      if (ftruncate(fileno(spillOut), (off_t)pos) == 0)
+		{
+		  fseek(spillOut, pos, SEEK_SET);
+		}
+	    }
+	}
+      [arp release];
+      [condition unlock];
+      [NSException raise: NSGenericException
+		  format: @"Unable to spill FIFO (%@) items to %@",
+	name, spillPath];
+    }
+  if (YES == opened)
+    {
+      spillWriteSeq++;
+    }
+
+  /* The items are safely on disk, so we can now give up the originals.
+   */
+  if (0 == _recordSize)
+    {
+      for (index = 0; index < count; index++)
+	{
+	  [(id)(((void**)buf)[index]) release];
+	}
+    }
+  spillWriteSize += [batch length];
+  spillBytes += [batch length];
+  spillItems += count;
+  spillPending += count;
+  [arp release];
+}
+
+/* Reads up to count items back from the spill segments, removing each
+ * segment once it has been consumed.
+ * Must be called with the condition locked ... unlocks it before raising
+ * an exception if reading fails.
+ */
+- (unsigned) _unspill: (void*)buf count: (unsigned)count
+{
+  NSAutoreleasePool	*arp = [NSAutoreleasePool new];
+  unsigned		index = 0;
+
+  while (index < count && spillPending > 0)
+    {
+      NSMutableData	*d;
+      uint32_t		len;
+
+      if (0 == spillIn)
+	{
+	  spillIn = fopen([self _spillFile: spillReadSeq], "rb");
+	}
+      else
+	{
+	  clearerr(spillIn);
+	}
+      if (0 == spillIn)
+	{
+	  [arp release];
+	  [condition unlock];
+	  [NSException raise: NSGenericException
+		      format: @"Unable to restore FIFO (%@) items from %@",
+	    name, spillPath];
+	}
+      if (fread(&len, sizeof(len), 1, spillIn) != 1)
+	{
+	  if (spillReadSeq >= spillWriteSeq)
+	    {
+	      [arp release];
+	      [condition unlock];
+	      [NSException raise: NSInternalInconsistencyException
+			  format: @"Spilled items missing for FIFO (%@)", name];
+	    }
+	  /* Reached the end of a completed segment ... move on to the next.
+	   */
+	  fclose(spillIn);
+	  spillIn = 0;
+	  unlink([self _spillFile: spillReadSeq++]);
+	  continue;
+	}
+      d = [[NSMutableData alloc] initWithLength: len];
+      if (len > 0 && fread([d mutableBytes], len, 1, spillIn) != 1)
+	{
+	  [d release];
+	  [arp release];
+	  [condition unlock];
+	  [NSException raise: NSGenericException
+		      format: @"Unable to restore FIFO (%@) items from %@",
+	    name, spillPath];
+	}
+      if (_recordSize > 0)
+	{
+	  NSAssert([d length] == _recordSize, NSInternalInconsistencyException);
+	  memcpy(((uint8_t*)buf) + index * _recordSize,
+	    [d bytes], _recordSize);
+	  index++;
+	}
+      else
+	{
+	  ((void**)buf)[index++] = (*spillDecoder)(d);
+	}
+      [d release];
+      spillPending--;
+      spillRestored++;
+    }
+  if (0 == spillPending)
+    {
+      /* Everything has been restored, so we can discard the segments
+       * and go back to using the in-memory buffer.
+       */
+      [self _spillReset];
+    }
+  [arp release];
+  return index;
+}
+
+- (unsigned) _cooperatingGet: (void*)buf
 		       count: (unsigned)count
 		 shouldBlock: (BOOL)block
                       before: (NSDate*)before
@@ -137,9 +498,10 @@ stats(NSTimeInterval ti, uint32_t max, NSTimeInterval *bounds, uint64_t *bands)
   NSTimeInterval	ti;
   unsigned		index;
   BOOL			wasFull;
+  int			w;
 
   [condition lock];
-  if (_head - _tail == 0)
+  if (_head - _tail == 0 && 0 == spillPending)
     {
       emptyCount++;
       _getTryFailure++;
@@ -152,7 +514,7 @@ stats(NSTimeInterval ti, uint32_t max, NSTimeInterval *bounds, uint64_t *bands)
       START
       if ((0 == timeout) && (before == nil))
 	{
-	  while (_head - _tail == 0)
+	  while (_head - _tail == 0 && 0 == spillPending)
 	    {
 	      [condition wait];
 	    }
@@ -180,7 +542,7 @@ stats(NSTimeInterval ti, uint32_t max, NSTimeInterval *bounds, uint64_t *bands)
             {
               effective = before;
             }
-	  while (_head - _tail == 0)
+	  while (_head - _tail == 0 && 0 == spillPending)
 	    {
 	      if (NO == [condition waitUntilDate: effective])
 		{
@@ -210,6 +572,21 @@ stats(NSTimeInterval ti, uint32_t max, NSTimeInterval *bounds, uint64_t *bands)
       _getTrySuccess++;
     }
 
+  if (_head - _tail == 0)
+    {
+      /* The buffer is empty, so any remaining items are on disk and
+       * (being newer than anything which was in the buffer) must be
+       * restored next.
+       */
+      index = [self _unspill: buf count: count];
+      w = watermark(self);
+      [condition unlock];
+      if (0 != w)
+	{
+	  postWatermark(self, w);
+	}
+      return index;
+    }
   if (_head - _tail == _capacity)
     {
       wasFull = YES;
@@ -220,15 +597,18 @@ stats(NSTimeInterval ti, uint32_t max, NSTimeInterval *bounds, uint64_t *bands)
     }
   for (index = 0; index < count && (_head - _tail) != 0; index++)
     {
-      buf[index] = _items[_tail % _capacity];
-      _tail++;
+      takeItem(self, buf, index);
     }
   if (YES == wasFull)
     {
       [condition broadcast];
     }
+  w = watermark(self);
   [condition unlock];
-
+  if (0 != w)
+    {
+      postWatermark(self, w);
+    }
   return index;
 }
 
@@ -266,6 +646,7 @@ stats(NSTimeInterval ti, uint32_t max, NSTimeInterval *bounds, uint64_t *bands)
 
 - (void*) peek
 {
+  POINTERS
   if (condition != nil)
     {
       return [self _cooperatingPeek];
@@ -279,6 +660,7 @@ stats(NSTimeInterval ti, uint32_t max, NSTimeInterval *bounds, uint64_t *bands)
 
 - (NSObject*) peekObject
 {
+  POINTERS
   if (condition != nil)
     {
       return [self _cooperatingPeekObject];
@@ -290,15 +672,35 @@ stats(NSTimeInterval ti, uint32_t max, NSTimeInterval *bounds, uint64_t *bands)
   return [[(id<NSObject>)_items[_tail % _capacity] retain] autorelease];
 }
 
-- (unsigned) _cooperatingPut: (void**)buf
+- (unsigned) _cooperatingPut: (const void*)buf
 		       count: (unsigned)count
 		 shouldBlock: (BOOL)block
 {
   NSTimeInterval	ti;
   unsigned		index;
   BOOL			wasEmpty;
+  int			w;
 
   [condition lock];
+  if (nil != spillPath && (spillPending > 0 || _head - _tail == _capacity))
+    {
+      /* Once we have started spilling, everything must go to disk until
+       * the consumer has caught up, otherwise items would be reordered.
+       */
+      if (0 == spillPending)
+	{
+	  fullCount++;
+	}
+      _putTrySuccess++;
+      [self _spill: buf count: count];
+      w = watermark(self);
+      [condition unlock];
+      if (0 != w)
+	{
+	  postWatermark(self, w);
+	}
+      return count;
+    }
   if (_head - _tail == _capacity)
     {
       _putTryFailure++;
@@ -354,14 +756,18 @@ stats(NSTimeInterval ti, uint32_t max, NSTimeInterval *bounds, uint64_t *bands)
     }
   for (index = 0; index < count && (_head - _tail < _capacity); index++)
     {
-      _items[_head % _capacity] = buf[index];
-      _head++;
+      giveItem(self, buf, index);
     }
   if (YES == wasEmpty)
     {
       [condition broadcast];
     }
+  w = watermark(self);
   [condition unlock];
+  if (0 != w)
+    {
+      postWatermark(self, w);
+    }
   return index;
 }
 
@@ -370,11 +776,55 @@ stats(NSTimeInterval ti, uint32_t max, NSTimeInterval *bounds, uint64_t *bands)
   NSTimeInterval	ti;
   unsigned		index;
   BOOL			wasEmpty;
+  int			w;
 
+  POINTERS
   NSAssert(nil != condition, NSGenericException);
   NSAssert(count <= _capacity, NSInvalidArgumentException);
 
   [condition lock];
+  if (nil != spillPath
+    && (spillPending > 0 || _capacity - (_head - _tail) < count))
+    {
+      if (0 == spillPending)
+	{
+	  fullCount++;
+	}
+      _putTrySuccess++;
+      if (YES == rtn)
+	{
+	  for (index = 0; index < count; index++)
+	    {
+	      RETAIN((NSObject*)buf[index]);
+	    }
+	}
+      NS_DURING
+	{
+	  [self _spill: buf count: count];
+	}
+      NS_HANDLER
+	{
+	  /* The items were not spilled (and the lock has been released),
+	   * so give up the retains we took for them.
+	   */
+	  if (YES == rtn)
+	    {
+	      for (index = 0; index < count; index++)
+		{
+		  RELEASE((NSObject*)buf[index]);
+		}
+	    }
+	  [localException raise];
+	}
+      NS_ENDHANDLER
+      w = watermark(self);
+      [condition unlock];
+      if (0 != w)
+	{
+	  postWatermark(self, w);
+	}
+      return;
+    }
   if (_head - _tail < count)
     {
       if (_head - _tail == _capacity)
@@ -439,7 +889,12 @@ stats(NSTimeInterval ti, uint32_t max, NSTimeInterval *bounds, uint64_t *bands)
     {
       [condition broadcast];
     }
+  w = watermark(self);
   [condition unlock];
+  if (0 != w)
+    {
+      postWatermark(self, w);
+    }
 }
 
 - (oneway void) release
@@ -452,7 +907,7 @@ stats(NSTimeInterval ti, uint32_t max, NSTimeInterval *bounds, uint64_t *bands)
    * and try to use it while it is being deallocated.
    */
   [classLock lock];
-  if ([self retainCount] == 1
+  if ([self retainCount] == 1 && nil != name
     && NSMapGet(allFIFOs, name) == self)
     {
       NSMapRemove(allFIFOs, name);
@@ -463,6 +918,17 @@ stats(NSTimeInterval ti, uint32_t max, NSTimeInterval *bounds, uint64_t *bands)
 
 - (void) dealloc
 {
+  if (nil != spillPath)
+    {
+      if (spillPending > 0)
+	{
+	  NSLog(@"GSFIFO (%@) discarding %"PRIu64" items spilled to %@",
+	    name, (uint64_t)spillPending, spillPath);
+	}
+      [self _spillReset];
+      [spillPath release];
+    }
+  [spillName release];
   [name release];
   [condition release];
   if (0 != _items)
@@ -486,7 +952,7 @@ stats(NSTimeInterval ti, uint32_t max, NSTimeInterval *bounds, uint64_t *bands)
 
 - (NSUInteger) count
 {
-  return (NSUInteger)(_head - _tail);
+  return (NSUInteger)(_head - _tail + spillPending);
 }
 
 - (NSString*) description
@@ -503,11 +969,13 @@ stats(NSTimeInterval ti, uint32_t max, NSTimeInterval *bounds, uint64_t *bands)
     fullCount];
 }
 
-- (unsigned) get: (void**)buf
-           count: (unsigned)count
-     shouldBlock: (BOOL)block
-          before: (NSDate*)date
-
+/* Gets pointers or records (depending on the configuration of the FIFO)
+ * into buf.
+ */
+- (unsigned) _get: (void*)buf
+	    count: (unsigned)count
+      shouldBlock: (BOOL)block
+	   before: (NSDate*)date
 {
   unsigned		index;
   NSTimeInterval	ti;
@@ -533,10 +1001,13 @@ stats(NSTimeInterval ti, uint32_t max, NSTimeInterval *bounds, uint64_t *bands)
     {
       for (index = 0; index < count && _head > _tail; index++)
 	{
-	  buf[index] = _items[_tail % _capacity];
-	  _tail++;
+	  takeItem(self, buf, index);
 	  _getTrySuccess++;
 	}
+      if (_highWatermark > 0)
+	{
+	  GSFIFOCheckWatermarks(self);
+	}
       return index;
     }
   _getTryFailure++;
@@ -580,12 +1051,48 @@ stats(NSTimeInterval ti, uint32_t max, NSTimeInterval *bounds, uint64_t *bands)
   ENDGET
   for (index = 0; index < count && _head > _tail; index++)
     {
-      buf[index] = _items[_tail % _capacity];
-      _tail++;
+      takeItem(self, buf, index);
+    }
+  if (_highWatermark > 0)
+    {
+      GSFIFOCheckWatermarks(self);
     }
   return index;
 }
 
+- (unsigned) get: (void**)buf
+           count: (unsigned)count
+     shouldBlock: (BOOL)block
+          before: (NSDate*)date
+{
+  POINTERS
+  return [self _get: buf count: count shouldBlock: block before: date];
+}
+
+- (unsigned) getRecords: (void*)buf
+		  count: (unsigned)count
+	    shouldBlock: (BOOL)block
+		 before: (NSDate*)date
+{
+  RECORDS
+  return [self _get: buf count: count shouldBlock: block before: date];
+}
+
+- (unsigned) getRecords: (void*)buf
+		  count: (unsigned)count
+	    shouldBlock: (BOOL)block
+{
+  RECORDS
+  return [self _get: buf count: count shouldBlock: block before: nil];
+}
+
+- (void) getRecord: (void*)record
+{
+  RECORDS
+  while (0 == [self _get: record count: 1 shouldBlock: YES before: nil])
+    ;
+}
+
 
 - (unsigned) get: (void**)buf count: (unsigned)count shouldBlock: (BOOL)block
 {
@@ -658,15 +1165,46 @@ stats(NSTimeInterval ti, uint32_t max, NSTimeInterval *bounds, uint64_t *bands)
 	     boundaries: (NSArray*)a
 		   name: (NSString*)n
 {
-  if (c < 1 || c > 100000000)
+  return [self initWithCapacity: c
+		     recordSize: 0
+		    granularity: g
+			timeout: t
+		  multiProducer: mp
+		  multiConsumer: mc
+		     boundaries: a
+			   name: n];
+}
+
+- (id) initWithCapacity: (uint32_t)c
+	     recordSize: (uint32_t)r
+	    granularity: (uint16_t)g
+		timeout: (uint16_t)t
+	  multiProducer: (BOOL)mp
+	  multiConsumer: (BOOL)mc
+	     boundaries: (NSArray*)a
+		   name: (NSString*)n
+{
+  if (c < 1 || c > 100000000 || r > 65536
+    || (uint64_t)c * r > (uint64_t)0x40000000)
     {
       [self release];
       return nil;
     }
   _capacity = c;
+  _recordSize = r;
   granularity = g;
   timeout = t;
-  _items = (void*)NSAllocateCollectable(c * sizeof(void*), NSScannedOption);
+  if (0 == r)
+    {
+      _items = (void*)NSAllocateCollectable(c * sizeof(void*),
+	NSScannedOption);
+    }
+  else
+    {
+      /* Records are copied into the buffer, so it contains no pointers.
+       */
+      _items = (void*)NSAllocateCollectable(c * r, 0);
+    }
   if (YES == mp || YES == mc)
     {
       condition = [NSCondition new];
@@ -715,6 +1253,10 @@ stats(NSTimeInterval ti, uint32_t max, NSTimeInterval *bounds, uint64_t *bands)
 	  l = t;
 	}
     }
+  if (nil == name)
+    {
+      return self;		// Anonymous ... not registered
+    }
   [classLock lock];
   if (nil != NSMapGet(allFIFOs, name))
     {
@@ -730,6 +1272,13 @@ stats(NSTimeInterval ti, uint32_t max, NSTimeInterval *bounds, uint64_t *bands)
 
 - (id) initWithCapacity: (uint32_t)c
 		   name: (NSString*)n
+{
+  return [self initWithCapacity: c recordSize: 0 name: n];
+}
+
+- (id) initWithCapacity: (uint32_t)c
+	     recordSize: (uint32_t)r
+		   name: (NSString*)n
 {
   NSUserDefaults	*defs = [NSUserDefaults standardUserDefaults];
   NSString		*key;
@@ -739,6 +1288,9 @@ stats(NSTimeInterval ti, uint32_t max, NSTimeInterval *bounds, uint64_t *bands)
   BOOL			mc;
   BOOL			mp;
   NSArray		*b;
+  NSString		*d;
+  NSInteger		h;
+  NSInteger		l;
 
   key = [NSString stringWithFormat: @"GSFIFOCapacity%@", n];
   if (nil == [defs objectForKey: key]) key = @"GSFIFOCapacity";
@@ -763,14 +1315,40 @@ stats(NSTimeInterval ti, uint32_t max, NSTimeInterval *bounds, uint64_t *bands)
   key = [NSString stringWithFormat: @"GSFIFOBoundaries%@", n];
   if (nil == [defs objectForKey: key]) key = @"GSFIFOBoundaries";
   b = [defs arrayForKey: key];
-
-  return [self initWithCapacity: c
+  key = [NSString stringWithFormat: @"GSFIFOSpillDirectory%@", n];
+  if (nil == [defs objectForKey: key]) key = @"GSFIFOSpillDirectory";
+  d = [defs stringForKey: key];
+  key = [NSString stringWithFormat: @"GSFIFOSpillSegment%@", n];
+  if (nil == [defs objectForKey: key]) key = @"GSFIFOSpillSegment";
+  i = [defs integerForKey: key];
+  key = [NSString stringWithFormat: @"GSFIFOHighWatermark%@", n];
+  if (nil == [defs objectForKey: key]) key = @"GSFIFOHighWatermark";
+  h = [defs integerForKey: key];
+  key = [NSString stringWithFormat: @"GSFIFOLowWatermark%@", n];
+  if (nil == [defs objectForKey: key]) key = @"GSFIFOLowWatermark";
+  l = [defs integerForKey: key];
+
+  self = [self initWithCapacity: c
+		     recordSize: r
 		    granularity: g
 			timeout: t
 		  multiProducer: mp
 		  multiConsumer: mc
 		     boundaries: b
 			   name: n];
+  if (nil != self && [d length] > 0)
+    {
+      [self setSpillDirectory: d
+		  segmentSize: (i > 0 ? (uint32_t)i : 0)
+		      encoder: 0
+		      decoder: 0];
+    }
+  if (nil != self && h > 0)
+    {
+      [self setHighWatermark: (uint32_t)h
+		lowWatermark: (l > 0 ? (uint32_t)l : 0)];
+    }
+  return self;
 }
 
 - (id) initWithName: (NSString*)n
@@ -778,7 +1356,12 @@ stats(NSTimeInterval ti, uint32_t max, NSTimeInterval *bounds, uint64_t *bands)
   return [self initWithCapacity: 10000 name: n];
 }
 
-- (unsigned) put: (void**)buf count: (unsigned)count shouldBlock: (BOOL)block
+/* Puts pointers or records (depending on the configuration of the FIFO)
+ * from buf.
+ */
+- (unsigned) _put: (const void*)buf
+	    count: (unsigned)count
+      shouldBlock: (BOOL)block
 {
   NSTimeInterval	sum;
   unsigned		index;
@@ -804,10 +1387,13 @@ stats(NSTimeInterval ti, uint32_t max, NSTimeInterval *bounds, uint64_t *bands)
     {
       for (index = 0; index < count && _head - _tail < _capacity; index++)
 	{
-	  _items[_head % _capacity] = buf[index];
-	  _head++;
+	  giveItem(self, buf, index);
 	}
       _putTrySuccess++;
+      if (_highWatermark > 0)
+	{
+	  GSFIFOCheckWatermarks(self);
+	}
       return index;
     }
   _putTryFailure++;
@@ -846,12 +1432,36 @@ stats(NSTimeInterval ti, uint32_t max, NSTimeInterval *bounds, uint64_t *bands)
   ENDPUT
   for (index = 0; index < count && _head - _tail < _capacity; index++)
     {
-      _items[_head % _capacity] = buf[index];
-      _head++;
+      giveItem(self, buf, index);
+    }
+  if (_highWatermark > 0)
+    {
+      GSFIFOCheckWatermarks(self);
     }
   return index;
 }
 
+- (unsigned) put: (void**)buf count: (unsigned)count shouldBlock: (BOOL)block
+{
+  POINTERS
+  return [self _put: buf count: count shouldBlock: block];
+}
+
+- (unsigned) putRecords: (const void*)buf
+		  count: (unsigned)count
+	    shouldBlock: (BOOL)block
+{
+  RECORDS
+  return [self _put: buf count: count shouldBlock: block];
+}
+
+- (void) putRecord: (const void*)record
+{
+  RECORDS
+  while (0 == [self _put: record count: 1 shouldBlock: YES])
+    ;
+}
+
 - (unsigned) putObjects: (NSObject**)buf
                   count: (unsigned)count
             shouldBlock: (BOOL)block
@@ -868,7 +1478,22 @@ stats(NSTimeInterval ti, uint32_t max, NSTimeInterval *bounds, uint64_t *bands)
     {
       [buf[index] retain];
     }
-  result = [self put: (void**)buf count: count shouldBlock: block];
+  NS_DURING
+    {
+      result = [self put: (void**)buf count: count shouldBlock: block];
+    }
+  NS_HANDLER
+    {
+      /* Nothing was added (eg we timed out or failed to spill to disk).
+       */
+      for (index = 0; index < count; index++)
+	{
+	  [buf[index] release];
+	}
+      [localException raise];
+      result = 0;
+    }
+  NS_ENDHANDLER
   while (count-- > result)
     {
       [buf[count] release];
@@ -896,6 +1521,100 @@ stats(NSTimeInterval ti, uint32_t max, NSTimeInterval *bounds, uint64_t *bands)
     ;
 }
 
+- (void) setHighWatermark: (uint32_t)high lowWatermark: (uint32_t)low
+{
+  if (high > _capacity || (high > 0 && low >= high))
+    {
+      [NSException raise: NSInvalidArgumentException
+		  format: @"[%@-%@] bad watermarks (%"PRIu32"/%"PRIu32")"
+	@" for %@ with capacity %"PRIu32,
+	NSStringFromClass([self class]), NSStringFromSelector(_cmd),
+	high, low, name, _capacity];
+    }
+  [condition lock];
+  _highWatermark = 0;
+  _lowWatermark = low;
+  _aboveHigh = NO;
+  _highWatermark = high;
+  [condition unlock];
+}
+
+- (void) setSpillDirectory: (NSString*)path
+	       segmentSize: (uint32_t)size
+		   encoder: (GSFIFOSpillEncoder)enc
+		   decoder: (GSFIFOSpillDecoder)dec
+{
+  if (nil == condition)
+    {
+      [NSException raise: NSInternalInconsistencyException
+		  format: @"[%@-%@] called for lock-free FIFO %@",
+	NSStringFromClass([self class]), NSStringFromSelector(_cmd), name];
+    }
+  if ((0 == enc) != (0 == dec))
+    {
+      [NSException raise: NSInvalidArgumentException
+		  format: @"[%@-%@] needs both encoder and decoder",
+	NSStringFromClass([self class]), NSStringFromSelector(_cmd)];
+    }
+  if (0 == size)
+    {
+      size = 64 * 1024 * 1024;
+    }
+  if (0 == enc)
+    {
+      enc = spillEncode;
+      dec = spillDecode;
+    }
+  path = AUTORELEASE([path copy]);
+  if (nil != path && nil == spillName)
+    {
+      NSMutableString	*m;
+      NSUInteger	i;
+
+      /* The segment names must not clash with those of other FIFOs (in
+       * this or another process), and the FIFO name must not introduce
+       * a directory separator.
+       */
+      m = [NSMutableString stringWithString: (nil == name) ? @"GSFIFO" : name];
+      i = [m length];
+      while (i-- > 0)
+	{
+	  unichar	c = [m characterAtIndex: i];
+
+	  if ('/' == c || '\\' == c || ':' == c || c < ' ')
+	    {
+	      [m replaceCharactersInRange: NSMakeRange(i, 1) withString: @"_"];
+	    }
+	}
+      spillName = [[NSString alloc] initWithFormat: @"%@.%d.%"PRIu32,
+	m, (int)getpid(), __sync_add_and_fetch(&spillInstances, 1)];
+    }
+
+  [condition lock];
+  if (spillPending > 0)
+    {
+      [condition unlock];
+      [NSException raise: NSInternalInconsistencyException
+		  format: @"[%@-%@] called while FIFO %@ has items on disk",
+	NSStringFromClass([self class]), NSStringFromSelector(_cmd), name];
+    }
+  if (nil != spillPath)
+    {
+      [self _spillReset];
+    }
+  ASSIGN(spillPath, path);
+  spillSegment = size;
+  spillEncoder = enc;
+  spillDecoder = dec;
+  spillReadSeq = 1;
+  spillWriteSeq = 0;
+  spillItems = 0;
+  spillBytes = 0;
+  spillRestored = 0;
+  spillStarted = NOW;
+  [condition unlock];
+}
+
 - (void) _getStats: (NSMutableString*)s
 {
   [s appendFormat:
@@ -949,6 +1668,21 @@ stats(NSTimeInterval ti, uint32_t max, NSTimeInterval *bounds, uint64_t *bands)
     }
 }
 
+- (void) _spillStats: (NSMutableString*)s
+{
+  NSTimeInterval	elapsed = NOW - spillStarted;
+
+  if (elapsed <= 0.0)
+    {
+      elapsed = 1.0;
+    }
+  [s appendFormat: @"  spilled:%"PRIu64" bytes:%"PRIu64
+    @" restored:%"PRIu64" pending:%"PRIu64"\n",
+    spillItems, spillBytes, spillRestored, (uint64_t)spillPending];
+  [s appendFormat: @"  spill rate:%g restore rate:%g (per second)\n",
+    spillItems / elapsed, spillRestored / elapsed];
+}
+
 - (NSString*) stats
 {
   NSMutableString	*s = [NSMutableString stringWithCapacity: 100];
@@ -970,6 +1704,12 @@ stats(NSTimeInterval ti, uint32_t max, NSTimeInterval *bounds, uint64_t *bands)
       [self _putStats: s];
       [condition unlock];
     }
+  if (nil != spillPath)
+    {
+      [condition lock];
+      [self _spillStats: s];
+      [condition unlock];
+    }
   return s;
 }
 
@@ -1033,6 +1773,52 @@ stats(NSTimeInterval ti, uint32_t max, NSTimeInterval *bounds, uint64_t *bands)
   return s;
 }
 
+- (double) pressure
+{
+  return (double)(_head - _tail + spillPending) / (double)_capacity;
+}
+
+- (BOOL) peekRecord: (void*)record
+{
+  BOOL	found = NO;
+
+  RECORDS
+  [condition lock];
+  if (_head - _tail > 0)
+    {
+      memcpy(record, ((uint8_t*)_items) + (_tail % _capacity) * _recordSize,
+	_recordSize);
+      found = YES;
+    }
+  [condition unlock];
+  return found;
+}
+
+- (uint32_t) recordSize
+{
+  return _recordSize;
+}
+
+- (BOOL) tryGetRecord: (void*)record
+{
+  RECORDS
+  if (1 == [self _get: record count: 1 shouldBlock: NO before: nil])
+    {
+      return YES;
+    }
+  return NO;
+}
+
+- (BOOL) tryPutRecord: (const void*)record
+{
+  RECORDS
+  if (1 == [self _put: record count: 1 shouldBlock: NO])
+    {
+      return YES;
+    }
+  return NO;
+}
+
 - (void*) tryGet
 {
   void	*item = nil;
@@ -1077,12 +1863,13 @@ stats(NSTimeInterval ti, uint32_t max, NSTimeInterval *bounds, uint64_t *bands)
       return 0;
     }
   return size
-   + (_capacity * sizeof(void)) // item storage
+   + (_capacity * (_recordSize > 0 ? _recordSize : sizeof(void*))) // items
    + (boundsCount * sizeof(NSTimeInterval)) // boundaries
    + (2 * (boundsCount + 1) * sizeof(uint64_t)) // get and put counts
    + [condition sizeInBytesExcluding: excluding]
    + [name sizeInBytesExcluding: excluding]
    + [putThread sizeInBytesExcluding: excluding]
+   + [spillPath sizeInBytesExcluding: excluding]
    + [getThread sizeInBytesExcluding: excluding];
 }
 @end
@@ -0,0 +1,215 @@
+#if	!defined(INCLUDED_GSIOFILESERVICE)
+#define	INCLUDED_GSIOFILESERVICE	1
+/**
+   Copyright (C) 2026 Free Software Foundation, Inc.
+
+   Written by:  Richard Frith-Macdonald <rfm@gnu.org>
+   Date:        October 2026
+
+   This file is part of the Performance Library.
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 3 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; if not, write to the Free
+   Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111 USA.
+   */
+#import <Foundation/NSObject.h>
+#import <Foundation/NSDate.h>
+
+@class	GSFIFO;
+@class	GSIOThreadPool;
+@class	GSThreadPool;
+@class	NSData;
+@class	NSLock;
+@class	NSString;
+@class	NSThread;
+
+/** The operations which may be performed by a GSIOFileRequest.
+ */
+typedef enum {
+  GSIOFileRead = 0,	/** Read from the descriptor at an offset */
+  GSIOFileWrite,	/** Write to the descriptor at an offset */
+  GSIOFileSync		/** Flush the descriptor to storage (fsync) */
+} GSIOFileOperation;
+
+/** A GSIOFileRequest describes a single read, write or fsync to be
+ * performed by a GSIOFileService, and holds the outcome once the
+ * operation has completed.<br />
+ * When the operation completes, the request is either put into a FIFO
+ * (see -setFIFO:) or passed as the argument to a method performed in
+ * the thread which submitted it (see -setTarget:selector:).
+ */
+@interface	GSIOFileRequest : NSObject
+{
+@private
+  GSIOFileOperation	operation;
+  int			descriptor;
+  uint64_t		offset;
+  NSUInteger		length;
+  NSData		*data;
+  id			target;
+  SEL			selector;
+  GSFIFO		*fifo;
+  NSThread		*thread;
+  id			context;
+  int64_t		result;
+  uint64_t		submitted;
+  uint64_t		completed;
+}
+
+/** Returns an autoreleased request to read up to length bytes from the
+ * descriptor starting at offset.  On completion -data contains the
+ * bytes read.
+ */
++ (GSIOFileRequest*) readDescriptor: (int)fd
+			     offset: (uint64_t)offset
+			     length: (NSUInteger)length;
+
+/** Returns an autoreleased request to flush the descriptor to storage.
+ */
++ (GSIOFileRequest*) syncDescriptor: (int)fd;
+
+/** Returns an autoreleased request to write the bytes of someData to the
+ * descriptor starting at offset.
+ */
++ (GSIOFileRequest*) writeDescriptor: (int)fd
+			      offset: (uint64_t)offset
+				data: (NSData*)someData;
+
+/** Returns the object set by -setContext:
+ */
+- (id) context;
+
+/** Returns the data read (for a completed read) or to be written.
+ */
+- (NSData*) data;
+
+/** Returns the file descriptor the request operates on.
+ */
+- (int) descriptor;
+
+/** Returns YES once the operation has completed.
+ */
+- (BOOL) isComplete;
+
+/** Returns the time (in seconds) from submission of the request to the
+ * completion of its operation, or zero if it has not completed.
+ */
+- (NSTimeInterval) latency;
+
+/** Returns the offset at which data is read or written.
+ */
+- (uint64_t) offset;
+
+/** Returns the operation performed by the request.
+ */
+- (GSIOFileOperation) operation;
+
+/** Returns the outcome of the operation ... the number of bytes read or
+ * written (zero for a sync), or a negative errno value on failure.
+ */
+- (int64_t) result;
+
+/** Sets an object (retained) for use by the code handling completion.
+ */
+- (void) setContext: (id)anObject;
+
+/** Sets a FIFO into which the request is put (retained) on completion,
+ * rather than using a target and selector.
+ */
+- (void) setFIFO: (GSFIFO*)aFIFO;
+
+/** Sets a method to be performed, with the completed request as its
+ * argument, in the thread which submits the request.  That thread must
+ * be a GSIOThread or must run its run loop.
+ */
+- (void) setTarget: (id)aTarget selector: (SEL)aSelector;
+@end
+
+/** A GSIOFileService performs file reads, writes and fsyncs without
+ * blocking the threads which request them, so pools need not be sized
+ * to hide disk latency.<br />
+ * Where the Linux io_uring interface is available, requests are put
+ * directly into a submission ring from the requesting thread and their
+ * completions are collected by a GSIOThread acquired from a
+ * GSIOThreadPool, which is woken through an eventfd.  Otherwise (or if
+ * the ring is full or the kernel refuses a submission) requests are
+ * performed by a GSThreadPool of helper threads using blocking system
+ * calls.<br />
+ * A service records the number of requests in progress and the latency
+ * of completed requests (see -stats).  A service is expected to last
+ * for the life of the process.
+ */
+@interface	GSIOFileService : NSObject
+{
+@private
+  NSLock		*lock;
+  GSIOThreadPool	*ioPool;
+  NSThread		*ioThread;
+  GSThreadPool		*helpers;
+  void			*ring;
+  int			event;
+  NSUInteger		ringDepth;
+  NSUInteger		depth;
+  NSUInteger		peak;
+  uint64_t		submitted;
+  uint64_t		completed;
+  uint64_t		failed;
+  uint64_t		fallbacks;
+  uint64_t		latencyTotal;
+  uint64_t		latencyMax;
+  uint64_t		histogram[32];
+}
+
+/** Returns a shared service, created using a private GSIOThreadPool,
+ * a ring size taken from the GSIOFileServiceEntries user default and
+ * a helper pool sized by the GSIOFileServiceHelpers user default.
+ */
++ (GSIOFileService*) sharedService;
+
+/** Returns the number of requests submitted but not yet completed.
+ */
+- (NSUInteger) depth;
+
+/** <init />
+ * Initialises the receiver to collect io_uring completions in a thread
+ * acquired from pool (a private pool of one thread if this is nil), with
+ * a submission ring of entries slots (256 if this is zero), and using
+ * helperPool (a private pool of four threads if this is nil) to perform
+ * requests when the ring is unavailable or full.
+ */
+- (id) initWithPool: (GSIOThreadPool*)pool
+	    entries: (unsigned)entries
+	    helpers: (GSThreadPool*)helperPool;
+
+/** Returns the largest number of requests which have been in progress
+ * at the same time.
+ */
+- (NSUInteger) peakDepth;
+
+/** Returns a description of the counts of requests and the distribution
+ * of their latencies.
+ */
+- (NSString*) stats;
+
+/** Submits the request to be performed.  A request may only be submitted
+ * once.  The request is retained until it has completed.
+ */
+- (void) submit: (GSIOFileRequest*)request;
+
+/** Returns YES if the receiver uses io_uring, NO if all requests are
+ * performed by helper threads.
+ */
+- (BOOL) usesRing;
+@end
+
+#endif
@@ -0,0 +1,859 @@
+/**
+   Copyright (C) 2026 Free Software Foundation, Inc.
+
+   Written by:  Richard Frith-Macdonald <rfm@gnu.org>
+   Date:        October 2026
+
+   This file is part of the Performance Library.
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 3 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; if not, write to the Free
+   Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111 USA.
+   */
+#include <inttypes.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#if	defined(__linux__) && defined(GNUSTEP)
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#if	defined(__has_include)
+#if	__has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#endif
+#endif
+/* IORING_FEAT_RW_CUR_POS came with the IORING_OP_READ and IORING_OP_WRITE
+ * operations (Linux 5.6), so we use it to check that they are known.
+ */
+#if	defined(__NR_io_uring_setup) && defined(IORING_FEAT_RW_CUR_POS)
+#define	HAVE_URING	1
+#endif
+#endif
+
+#import <Foundation/NSData.h>
+#import <Foundation/NSException.h>
+#import <Foundation/NSLock.h>
+#import <Foundation/NSRunLoop.h>
+#import <Foundation/NSString.h>
+#import <Foundation/NSThread.h>
+#import <Foundation/NSUserDefaults.h>
+#import "GSIOFileService.h"
+#import "GSEpollThread.h"
+#import "GSFIFO.h"
+#import "GSIOThreadPool.h"
+#import "GSThreadPool.h"
+
+#if !defined (GNUSTEP)
+#import  "GNUstep.h"
+#endif
+
+static inline uint64_t
+nanoseconds()
+{
+  struct timespec	ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+@interface	GSIOFileRequest (Private)
+- (void) _complete: (int64_t)r;
+- (void) _deliver;
+- (void*) _bytes;
+- (NSUInteger) _length;
+- (void) _submitted;
+@end
+
+@implementation	GSIOFileRequest
+
++ (GSIOFileRequest*) readDescriptor: (int)fd
+			     offset: (uint64_t)offset
+			     length: (NSUInteger)length
+{
+  GSIOFileRequest	*r = [[self new] autorelease];
+
+  r->operation = GSIOFileRead;
+  r->descriptor = fd;
+  r->offset = offset;
+  r->length = length;
+  r->data = [[NSMutableData alloc] initWithLength: length];
+  return r;
+}
+
++ (GSIOFileRequest*) syncDescriptor: (int)fd
+{
+  GSIOFileRequest	*r = [[self new] autorelease];
+
+  r->operation = GSIOFileSync;
+  r->descriptor = fd;
+  return r;
+}
+
++ (GSIOFileRequest*) writeDescriptor: (int)fd
+			      offset: (uint64_t)offset
+				data: (NSData*)someData
+{
+  GSIOFileRequest	*r = [[self new] autorelease];
+
+  r->operation = GSIOFileWrite;
+  r->descriptor = fd;
+  r->offset = offset;
+  r->data = [someData copy];
+  r->length = [r->data length];
+  return r;
+}
+
+- (id) context
+{
+  return context;
+}
+
+- (NSData*) data
+{
+  return data;
+}
+
+- (void) dealloc
+{
+  [context release];
+  [data release];
+  [fifo release];
+  [target release];
+  [thread release];
+  [super dealloc];
+}
+
+- (NSString*) description
+{
+  static const char	*names[] = { "read", "write", "sync" };
+
+  return [NSString stringWithFormat:
+    @"%@ %s fd:%d offset:%"PRIu64" length:%"PRIuPTR" result:%"PRId64,
+    [super description], names[operation], descriptor, offset,
+    (uintptr_t)length, result];
+}
+
+- (int) descriptor
+{
+  return descriptor;
+}
+
+- (BOOL) isComplete
+{
+  return (0 == completed) ? NO : YES;
+}
+
+- (NSTimeInterval) latency
+{
+  if (0 == completed)
+    {
+      return 0.0;
+    }
+  return (completed - submitted) / 1000000000.0;
+}
+
+- (uint64_t) offset
+{
+  return offset;
+}
+
+- (GSIOFileOperation) operation
+{
+  return operation;
+}
+
+- (int64_t) result
+{
+  return result;
+}
+
+- (void) setContext: (id)anObject
+{
+  ASSIGN(context, anObject);
+}
+
+- (void) setFIFO: (GSFIFO*)aFIFO
+{
+  ASSIGN(fifo, aFIFO);
+}
+
+- (void) setTarget: (id)aTarget selector: (SEL)aSelector
+{
+  ASSIGN(target, aTarget);
+  selector = aSelector;
+}
+
+@end
+
+@implementation	GSIOFileRequest (Private)
+
+- (void*) _bytes
+{
+  if (GSIOFileRead == operation)
+    {
+      return [(NSMutableData*)data mutableBytes];
+    }
+  return (void*)[data bytes];
+}
+
+/* Records the outcome of the operation, trimming read data to the
+ * number of bytes actually read.
+ */
+- (void) _complete: (int64_t)r
+{
+  result = r;
+  if (GSIOFileRead == operation)
+    {
+      [(NSMutableData*)data setLength: (r > 0) ? (NSUInteger)r : 0];
+    }
+  completed = nanoseconds();
+}
+
+/* Passes the completed request to the FIFO or to the target in the
+ * thread which submitted it.
+ */
+- (void) _deliver
+{
+  if (nil != fifo)
+    {
+      [fifo putObject: self];
+    }
+  else if (nil != target && 0 != selector)
+    {
+      if ([thread isKindOfClass: [GSIOThread class]])
+	{
+	  [(GSIOThread*)thread postSelector: selector
+				     target: target
+				     object: self];
+	}
+      else if (NO == [thread isFinished])
+	{
+	  [target performSelector: selector
+			 onThread: thread
+		       withObject: self
+		    waitUntilDone: NO];
+	}
+    }
+}
+
+- (NSUInteger) _length
+{
+  return length;
+}
+
+/* Records the submission time and thread, raising an exception if the
+ * request has already been submitted.
+ */
+- (void) _submitted
+{
+  if (0 != submitted)
+    {
+      [NSException raise: NSInvalidArgumentException
+		  format: @"[%@-submit:] request already submitted",
+	NSStringFromClass([GSIOFileService class])];
+    }
+  submitted = nanoseconds();
+  ASSIGN(thread, [NSThread currentThread]);
+}
+
+@end
+
+
+#if	defined(HAVE_URING)
+
+/* The mapped submission and completion queues of an io_uring instance.
+ */
+typedef struct {
+  int			fd;
+  unsigned		entries;
+  unsigned		cqEntries;
+  void			*sqMap;
+  size_t		sqMapSize;
+  void			*cqMap;
+  size_t		cqMapSize;
+  struct io_uring_sqe	*sqes;
+  size_t		sqesSize;
+  unsigned		*sqHead;
+  unsigned		*sqTail;
+  unsigned		*sqMask;
+  unsigned		*sqArray;
+  unsigned		*cqHead;
+  unsigned		*cqTail;
+  unsigned		*cqMask;
+  struct io_uring_cqe	*cqes;
+} GSRing;
+
+static void
+ringDestroy(GSRing *r)
+{
+  if (0 != r->sqes)
+    {
+      munmap(r->sqes, r->sqesSize);
+    }
+  if (0 != r->cqMap && r->cqMap != r->sqMap)
+    {
+      munmap(r->cqMap, r->cqMapSize);
+    }
+  if (0 != r->sqMap)
+    {
+      munmap(r->sqMap, r->sqMapSize);
+    }
+  close(r->fd);
+  free(r);
+}
+
+/* Sets up a ring of the requested size which signals completions using
+ * the eventfd, returning 0 if io_uring is not usable.
+ */
+static GSRing*
+ringCreate(unsigned entries, int event)
+{
+  struct io_uring_params	p;
+  GSRing			*r;
+  void				*m;
+  int				fd;
+
+  memset(&p, '\0', sizeof(p));
+  fd = (int)syscall(__NR_io_uring_setup, entries, &p);
+  if (fd < 0)
+    {
+      return 0;
+    }
+  r = (GSRing*)calloc(1, sizeof(GSRing));
+  r->fd = fd;
+  if (0 == (p.features & IORING_FEAT_RW_CUR_POS))
+    {
+      ringDestroy(r);		// Kernel lacks IORING_OP_READ/WRITE
+      return 0;
+    }
+  r->entries = p.sq_entries;
+  r->cqEntries = p.cq_entries;
+  r->sqMapSize = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+  r->cqMapSize = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+  if (p.features & IORING_FEAT_SINGLE_MMAP)
+    {
+      if (r->cqMapSize > r->sqMapSize)
+	{
+	  r->sqMapSize = r->cqMapSize;
+	}
+      r->cqMapSize = r->sqMapSize;
+    }
+  m = mmap(0, r->sqMapSize, PROT_READ | PROT_WRITE,
+    MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+  if (MAP_FAILED == m)
+    {
+      ringDestroy(r);
+      return 0;
+    }
+  r->sqMap = m;
+  if (p.features & IORING_FEAT_SINGLE_MMAP)
+    {
+      r->cqMap = r->sqMap;
+    }
+  else
+    {
+      m = mmap(0, r->cqMapSize, PROT_READ | PROT_WRITE,
+	MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+      if (MAP_FAILED == m)
+	{
+	  ringDestroy(r);
+	  return 0;
+	}
+      r->cqMap = m;
+    }
+  r->sqesSize = p.sq_entries * sizeof(struct io_uring_sqe);
+  m = mmap(0, r->sqesSize, PROT_READ | PROT_WRITE,
+    MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+  if (MAP_FAILED == m)
+    {
+      ringDestroy(r);
+      return 0;
+    }
+  r->sqes = (struct io_uring_sqe*)m;
+  r->sqHead = (unsigned*)((char*)r->sqMap + p.sq_off.head);
+  r->sqTail = (unsigned*)((char*)r->sqMap + p.sq_off.tail);
+  r->sqMask = (unsigned*)((char*)r->sqMap + p.sq_off.ring_mask);
+  r->sqArray = (unsigned*)((char*)r->sqMap + p.sq_off.array);
+  r->cqHead = (unsigned*)((char*)r->cqMap + p.cq_off.head);
+  r->cqTail = (unsigned*)((char*)r->cqMap + p.cq_off.tail);
+  r->cqMask = (unsigned*)((char*)r->cqMap + p.cq_off.ring_mask);
+  r->cqes = (struct io_uring_cqe*)((char*)r->cqMap + p.cq_off.cqes);
+  if (syscall(__NR_io_uring_register, fd, IORING_REGISTER_EVENTFD,
+    &event, 1) < 0)
+    {
+      ringDestroy(r);
+      return 0;
+    }
+  return r;
+}
+
+/* Puts a request into the submission queue and tells the kernel about it.
+ * Must be called with the service lock held.  Returns NO if the queue
+ * is full or the kernel did not take the request.
+ */
+static BOOL
+ringSubmit(GSRing *r, GSIOFileRequest *q)
+{
+  unsigned		tail = *r->sqTail;
+  unsigned		index;
+  struct io_uring_sqe	*sqe;
+  int			n;
+
+  if (tail - *(volatile unsigned*)r->sqHead >= r->entries)
+    {
+      return NO;
+    }
+  index = tail & *r->sqMask;
+  sqe = &r->sqes[index];
+  memset(sqe, '\0', sizeof(*sqe));
+  switch ([q operation])
+    {
+      case GSIOFileRead:	sqe->opcode = IORING_OP_READ; break;
+      case GSIOFileWrite:	sqe->opcode = IORING_OP_WRITE; break;
+      default:			sqe->opcode = IORING_OP_FSYNC; break;
+    }
+  sqe->fd = [q descriptor];
+  if (IORING_OP_FSYNC != sqe->opcode)
+    {
+      sqe->off = [q offset];
+      sqe->addr = (uint64_t)(uintptr_t)[q _bytes];
+      sqe->len = (uint32_t)[q _length];
+    }
+  sqe->user_data = (uint64_t)(uintptr_t)q;
+  r->sqArray[index] = index;
+  __sync_synchronize();
+  *(volatile unsigned*)r->sqTail = tail + 1;
+  __sync_synchronize();
+
+  /* Submit everything in the queue, in case the kernel has not yet
+   * taken an earlier entry.
+   */
+  while ((n = (int)syscall(__NR_io_uring_enter, r->fd,
+    tail + 1 - *(volatile unsigned*)r->sqHead, 0, 0, 0, 0)) < 0
+    && EINTR == errno)
+    ;
+  __sync_synchronize();
+  if (*(volatile unsigned*)r->sqHead != tail + 1)
+    {
+      /* The kernel did not take the entry (eg EAGAIN or EBUSY while
+       * completions are backed up).  We do not use SQPOLL and we hold the
+       * lock, so nothing else can consume the queue; rather than leave
+       * the entry waiting for some later submission (which may never
+       * come), we withdraw it and have a helper thread do the work.
+       */
+      if (n < 0)
+	{
+	  NSLog(@"GSIOFileService io_uring_enter failed: %d", errno);
+	}
+      *(volatile unsigned*)r->sqTail = tail;
+      __sync_synchronize();
+      return NO;
+    }
+  return YES;
+}
+
+#endif	/* HAVE_URING */
+
+
+@interface	GSIOFileService (Private)
+- (void) _attach;
+- (void) _complete: (GSIOFileRequest*)q result: (int64_t)r ring: (BOOL)fromRing;
+- (void) _perform: (GSIOFileRequest*)q;
+- (void) _reap;
+- (void) descriptor: (int)fd events: (uint32_t)events;
+@end
+
+@implementation	GSIOFileService
+
+static GSIOFileService	*shared = nil;
+
++ (void) initialize
+{
+  if ([GSIOFileService class] == self && nil == shared)
+    {
+      NSUserDefaults	*defs = [NSUserDefaults standardUserDefaults];
+      NSInteger		entries;
+      NSInteger		size;
+      GSThreadPool	*pool = nil;
+
+      entries = [defs integerForKey: @"GSIOFileServiceEntries"];
+      if (entries < 0)
+	{
+	  entries = 0;
+	}
+      size = [defs integerForKey: @"GSIOFileServiceHelpers"];
+      if (size > 0)
+	{
+	  pool = [[GSThreadPool new] autorelease];
+	  [pool setPoolName: @"GSIOFileService"];
+	  [pool setThreads: size];
+	}
+      shared = [[self alloc] initWithPool: nil
+				  entries: (unsigned)entries
+				  helpers: pool];
+    }
+}
+
++ (GSIOFileService*) sharedService
+{
+  return shared;
+}
+
+- (void) dealloc
+{
+#if	defined(HAVE_URING)
+  if (0 != ring)
+    {
+      ringDestroy((GSRing*)ring);
+    }
+  if (event >= 0)
+    {
+      close(event);
+    }
+#endif
+  if (nil != ioThread)
+    {
+      [ioPool unacquireThread: ioThread];
+      [ioThread release];
+    }
+  [ioPool release];
+  [helpers release];
+  [lock release];
+  [super dealloc];
+}
+
+- (NSUInteger) depth
+{
+  NSUInteger	d;
+
+  [lock lock];
+  d = depth;
+  [lock unlock];
+  return d;
+}
+
+- (id) init
+{
+  return [self initWithPool: nil entries: 0 helpers: nil];
+}
+
+- (id) initWithPool: (GSIOThreadPool*)pool
+	    entries: (unsigned)entries
+	    helpers: (GSThreadPool*)helperPool
+{
+  if ((self = [super init]) != nil)
+    {
+      lock = [NSLock new];
+      event = -1;
+      if (nil == helperPool)
+	{
+	  helperPool = [[GSThreadPool new] autorelease];
+	  [helperPool setPoolName: @"GSIOFileService"];
+	  [helperPool setThreads: 4];
+	}
+      helpers = [helperPool retain];
+      if (0 == entries)
+	{
+	  entries = 256;
+	}
+#if	defined(HAVE_URING)
+      event = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+      if (event >= 0)
+	{
+	  ring = ringCreate(entries, event);
+	}
+      if (0 == ring)
+	{
+	  if (event >= 0)
+	    {
+	      close(event);
+	      event = -1;
+	    }
+	}
+      else
+	{
+	  if (nil == pool)
+	    {
+	      pool = [[GSIOThreadPool new] autorelease];
+	      [pool setPoolName: @"GSIOFileService"];
+	      [pool setThreads: 1];
+	    }
+	  ioPool = [pool retain];
+	  ioThread = [[ioPool acquireThread] retain];
+	  if ([ioThread isKindOfClass: [GSIOThread class]])
+	    {
+	      [(GSIOThread*)ioThread postSelector: @selector(_attach)
+					   target: self
+					   object: nil];
+	    }
+	  else
+	    {
+	      [self performSelector: @selector(_attach)
+			   onThread: ioThread
+			 withObject: nil
+		      waitUntilDone: NO];
+	    }
+	}
+#endif
+    }
+  return self;
+}
+
+- (NSUInteger) peakDepth
+{
+  NSUInteger	p;
+
+  [lock lock];
+  p = peak;
+  [lock unlock];
+  return p;
+}
+
+- (NSString*) stats
+{
+  NSMutableString	*s = [NSMutableString stringWithCapacity: 200];
+  uint64_t		pc[3] = { 0, 0, 0 };
+  static const double	quantiles[3] = { 0.5, 0.99, 0.999 };
+  uint64_t		seen = 0;
+  unsigned		q = 0;
+  unsigned		i;
+
+  [lock lock];
+  /* The histogram buckets count latencies of up to 2^i microseconds,
+   * so each percentile is reported as the upper bound of its bucket.
+   */
+  for (i = 0; i < 32 && q < 3; i++)
+    {
+      seen += histogram[i];
+      while (q < 3 && completed > 0 && seen >= quantiles[q] * completed)
+	{
+	  pc[q++] = (uint64_t)1 << i;
+	}
+    }
+  [s appendFormat: @"%@ ring:%s depth:%"PRIuPTR" peak:%"PRIuPTR"\n",
+    [super description], (0 == ring) ? "no" : "yes",
+    (uintptr_t)depth, (uintptr_t)peak];
+  [s appendFormat: @"  submitted:%"PRIu64" completed:%"PRIu64
+    @" failed:%"PRIu64" helpers:%"PRIu64"\n",
+    submitted, completed, failed, fallbacks];
+  [s appendFormat: @"  latency avg:%"PRIu64"us max:%"PRIu64"us"
+    @" p50:<%"PRIu64"us p99:<%"PRIu64"us p999:<%"PRIu64"us\n",
+    (0 == completed) ? 0 : latencyTotal / completed / 1000,
+    latencyMax / 1000, pc[0], pc[1], pc[2]];
+  [lock unlock];
+  return s;
+}
+
+- (void) submit: (GSIOFileRequest*)request
+{
+  BOOL	queued = NO;
+
+  if (NO == [request isKindOfClass: [GSIOFileRequest class]])
+    {
+      [NSException raise: NSInvalidArgumentException
+		  format: @"[%@-%@] bad request",
+	NSStringFromClass([self class]), NSStringFromSelector(_cmd)];
+    }
+  [request _submitted];
+  [request retain];		// Released on completion
+  [lock lock];
+  submitted++;
+  if (++depth > peak)
+    {
+      peak = depth;
+    }
+#if	defined(HAVE_URING)
+  if (0 != ring && ringDepth < ((GSRing*)ring)->cqEntries)
+    {
+      queued = ringSubmit((GSRing*)ring, request);
+      if (YES == queued)
+	{
+	  ringDepth++;
+	}
+    }
+#endif
+  if (NO == queued)
+    {
+      fallbacks++;
+    }
+  [lock unlock];
+  if (NO == queued)
+    {
+      [helpers scheduleSelector: @selector(_perform:)
+		     onReceiver: self
+		     withObject: request];
+    }
+}
+
+- (BOOL) usesRing
+{
+  return (0 == ring) ? NO : YES;
+}
+
+@end
+
+@implementation	GSIOFileService (Private)
+
+/* Starts watching the eventfd for completions ... performed in ioThread.
+ */
+- (void) _attach
+{
+#if	defined(HAVE_URING)
+  if ([ioThread isKindOfClass: [GSEpollThread class]])
+    {
+      [(GSEpollThread*)ioThread watchDescriptor: event
+					 events: EPOLLIN
+					 target: self
+				       selector: @selector(descriptor:events:)];
+    }
+  else
+    {
+      [[NSRunLoop currentRunLoop] addEvent: (void*)(uintptr_t)event
+				      type: ET_RDESC
+				   watcher: (id<RunLoopEvents>)self
+				   forMode: NSDefaultRunLoopMode];
+    }
+  [self _reap];		// Anything completed before we started watching
+#endif
+}
+
+/* Records statistics for a completed request and delivers it.
+ */
+- (void) _complete: (GSIOFileRequest*)q result: (int64_t)r ring: (BOOL)fromRing
+{
+  uint64_t	ns;
+  unsigned	bucket = 0;
+  uint64_t	us;
+
+  [q _complete: r];
+  ns = (uint64_t)([q latency] * 1000000000.0);
+  us = ns / 1000;
+  while (bucket < 31 && ((uint64_t)1 << bucket) < us)
+    {
+      bucket++;
+    }
+  [lock lock];
+  depth--;
+  if (YES == fromRing)
+    {
+      ringDepth--;
+    }
+  completed++;
+  if (r < 0)
+    {
+      failed++;
+    }
+  latencyTotal += ns;
+  if (ns > latencyMax)
+    {
+      latencyMax = ns;
+    }
+  histogram[bucket]++;
+  [lock unlock];
+  NS_DURING
+    {
+      [q _deliver];
+    }
+  NS_HANDLER
+    {
+      NSLog(@"%@ problem delivering %@: %@", self, q, localException);
+    }
+  NS_ENDHANDLER
+  [q release];
+}
+
+/* Performs a request using blocking calls in a helper thread.
+ */
+- (void) _perform: (GSIOFileRequest*)q
+{
+  int64_t	r;
+
+  switch ([q operation])
+    {
+      case GSIOFileRead:
+	r = pread([q descriptor], [q _bytes], [q _length], (off_t)[q offset]);
+	break;
+      case GSIOFileWrite:
+	r = pwrite([q descriptor], [q _bytes], [q _length], (off_t)[q offset]);
+	break;
+      default:
+	r = fsync([q descriptor]);
+	break;
+    }
+  if (r < 0)
+    {
+      r = -errno;
+    }
+  [self _complete: q result: r ring: NO];
+}
+
+/* Collects completions from the ring ... performed in ioThread.
+ */
+- (void) _reap
+{
+#if	defined(HAVE_URING)
+  GSRing	*r = (GSRing*)ring;
+  uint64_t	v;
+
+  while (read(event, &v, sizeof(v)) > 0)
+    ;
+  for (;;)
+    {
+      unsigned	head = *r->cqHead;
+      unsigned	tail = *(volatile unsigned*)r->cqTail;
+
+      __sync_synchronize();
+      if (head == tail)
+	{
+	  break;
+	}
+      while (head != tail)
+	{
+	  struct io_uring_cqe	*cqe = &r->cqes[head & *r->cqMask];
+	  GSIOFileRequest	*q = (GSIOFileRequest*)(uintptr_t)cqe->user_data;
+	  int64_t		res = cqe->res;
+
+	  head++;
+	  __sync_synchronize();
+	  *(volatile unsigned*)r->cqHead = head;
+	  [self _complete: q result: res ring: YES];
+	}
+    }
+#endif
+}
+
+/* Handler for the eventfd when ioThread is a GSEpollThread.
+ */
+- (void) descriptor: (int)fd events: (uint32_t)events
+{
+  [self _reap];
+}
+
+#if	defined(GNUSTEP)
+/* Handler for the eventfd when ioThread runs a standard run loop.
+ */
+- (void) receivedEvent: (void*)data
+		  type: (RunLoopEventType)type
+		 extra: (void*)extra
+	       forMode: (NSString*)mode
+{
+  [self _reap];
+}
+#endif
+
+@end
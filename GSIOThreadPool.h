@@ -24,11 +24,38 @@
    */
 #import <Foundation/NSObject.h>
 #import <Foundation/NSThread.h>
+#import "GSThreadPool.h"
 
 
+@class	NSArray;
+@class	NSDictionary;
+@class	NSIndexSet;
 @class	NSMutableArray;
 @class	NSTimer;
 
+/** Keys for the dictionaries returned by [GSIOThread-slowCallbacks]
+ * and [GSIOThreadPool-lagStatistics].<br />
+ * GSIOThreadCallbackKey is a string identifying a slow callback as
+ * '-[Class selector]', or '(run loop)' when the thread's load probe
+ * was delayed by something outside the mailbox (such as a run loop
+ * timer or input handler).<br />
+ * GSIOThreadDateKey is the date at which a slow callback finished.<br />
+ * GSIOThreadDurationKey is the time (in seconds) taken by a slow
+ * callback, or by which the probe was late.<br />
+ * GSIOThreadLagKey and GSIOThreadLoadKey are the values returned by
+ * [GSIOThread-lag] and [GSIOThread-load].<br />
+ * GSIOThreadLagHistogramKey is the array returned by
+ * [GSIOThread-lagHistogram].<br />
+ * GSIOThreadSlowKey is the array returned by [GSIOThread-slowCallbacks].
+ */
+extern NSString * const GSIOThreadCallbackKey;
+extern NSString * const GSIOThreadDateKey;
+extern NSString * const GSIOThreadDurationKey;
+extern NSString * const GSIOThreadLagHistogramKey;
+extern NSString * const GSIOThreadLagKey;
+extern NSString * const GSIOThreadLoadKey;
+extern NSString * const GSIOThreadSlowKey;
+
 /** This is the class for threads in the pool.<br />
  * Each thread runs a runloop and is kept 'alive' waiting for a timer in
  * the far future, but can be terminated earlier using the -terminate:
@@ -40,7 +67,65 @@
 @private
   NSTimer	*_timer;                /** Pool termination timer */
   NSUInteger	_count;                 /** Number of times acquired */ 
+  GSThreadPlacement	_placement;     /** CPU placement policy */
+  NSIndexSet	*_cpus;                 /** CPUs for placement */
+  NSUInteger	_index;                 /** Thread (or node) for placement */
+  id		_probe;                 /** Load measurement timer */
+  NSTimeInterval _probeInterval;        /** Time between measurements */
+  NSTimeInterval _expected;             /** When the probe should fire */
+  NSTimeInterval _lastProbe;            /** When the probe last fired */
+  NSTimeInterval _lastCPU;              /** Thread CPU time at last probe */
+  double	_load;                  /** Smoothed busy ratio */
+  NSTimeInterval _lag;                  /** Smoothed timer lag */
+  void		*_mailHead;             /** Last message posted */
+  void		*_mailTail;             /** Last message performed */
+  int		_mailSignalled;         /** Set while a wakeup is pending */
+  uint32_t	_lagCounts[32];         /** Histogram of probe lag */
+  NSTimeInterval _slowThreshold;        /** Duration of a slow callback */
+  NSMutableArray *_slow;                /** Recent slow callbacks */
 }
+
+/** Returns the recent average time by which the load measurement timer
+ * of the thread has been late to fire (a measure of how long events wait
+ * to be handled by the run loop), or zero if the load is not measured
+ * (see [GSIOThreadPool-setLoadInterval:]).
+ */
+- (NSTimeInterval) lag;
+
+/** Returns an array of counts of the times the load measurement timer
+ * has fired (see [GSIOThreadPool-setLoadInterval:]) by lateness, where
+ * the count at index zero is for less than a microsecond and the count
+ * at each following index N is for times from 2^(N-1) up to 2^N
+ * microseconds (the last count also includes all longer times).
+ */
+- (NSArray*) lagHistogram;
+
+/** Returns the recent average proportion of time for which the thread has
+ * been busy (using CPU) from 0.0 to 1.0, or zero if the load is not
+ * measured (see [GSIOThreadPool-setLoadInterval:]) or CPU time for
+ * threads is not available on this system.
+ */
+- (double) load;
+
+/** Asks the thread to perform aSelector on aTarget with anObject as its
+ * argument, like -performSelector:onThread:withObject:waitUntilDone:
+ * with a wait of NO, but much more cheaply.<br />
+ * The message is added to a lock-free queue (mailbox) belonging to the
+ * thread, and the thread is woken only when the mailbox was empty, so
+ * a burst of messages posted by any number of threads is handled in a
+ * single batch.  Messages are performed in the order posted and the
+ * target and object are retained until then.<br />
+ * May be called from any thread.  Messages posted to a thread which has
+ * finished are discarded.
+ */
+- (void) postSelector: (SEL)aSelector target: (id)aTarget object: (id)anObject;
+
+/** Returns the most recent (up to 32) slow callbacks detected in the
+ * thread (see [GSIOThreadPool-setSlowThreshold:]), oldest first, each
+ * described by a dictionary as documented for GSIOThreadCallbackKey.
+ */
+- (NSArray*) slowCallbacks;
+
 /** Terminates the thread by the specified date (as soon as possible if
  * the date is nil or is in the past).<br />
  * If called from another thread, this method asks the receiver thread to
@@ -64,7 +149,8 @@
 /** This class provides a thread pool for performing methods which need to
  * make use of a runloop for I/O and/or timers.<br />
  * Operations are performed on these threads using the standard
- * -performSelector:onThread:withObject:waitUntilDone: method ... the
+ * -performSelector:onThread:withObject:waitUntilDone: method (or the
+ * cheaper [GSIOThread-postSelector:target:object:] method) ... the
  * pool is simply used to keep track of allocation of threads so that
  * you can share jobs between them.<br />
  * NB. The threading API in OSX 10.4 and earlier is incapable of supporting
@@ -79,6 +165,10 @@
   Class                 threadClass;
   NSString		*poolName;
   unsigned		created;
+  GSThreadPlacement	placement;
+  NSIndexSet		*placementCPUs;
+  NSTimeInterval	loadInterval;
+  NSTimeInterval	slowThreshold;
 }
 
 /** Returns an instance intended for sharing between sections of code which
@@ -95,20 +185,101 @@
 
 /** Selects a thread from the pool to be used for some job.<br />
  * This method selectes the least used thread in the pool (ie the
- * one with the lowest acquire count).<br />
+ * one with the lowest acquire count, or the lowest measured load if
+ * -setLoadInterval: has been used).<br />
+ * If the pool uses the GSThreadPlacementNode policy, the thread is chosen
+ * from those on the NUMA node of the calling thread unless that node
+ * already has its share of the threads of the pool and they are all
+ * in use, in which case a less used thread on another node may be
+ * chosen.<br />
  * If the receiver is configured with a size of zero, the main thread
  * is returned.
  */
 - (NSThread*) acquireThread;
 
+/** Selects a thread from the pool to be used for work associated with
+ * aKey (eg a connection or shard), so that all the work for a key is
+ * done in the same thread and its state need not be shared.<br />
+ * The thread is chosen using consistent (jump) hashing of the -hash of
+ * the key over -maxThreads slots, so that when the pool size is changed
+ * using -setThreads: only the keys needing to move to or from the
+ * added or removed slots are given different threads.<br />
+ * Each slot is one of the threads of the pool (the threads are created
+ * as needed), so keyed work shares the threads used by -acquireThread
+ * and the pool never exceeds -maxThreads threads other than while the
+ * threads beyond a reduced limit finish their work.<br />
+ * The thread is acquired as for -acquireThread, and must be released
+ * using -unacquireThread: when the work is finished.<br />
+ * If the receiver is configured with a size of zero, the main thread
+ * is returned.
+ */
+- (NSThread*) acquireThreadForKey: (id)aKey;
+
+/** Returns a dictionary keyed by the names of the threads in the pool,
+ * whose values are dictionaries containing the GSIOThreadLagKey,
+ * GSIOThreadLoadKey, GSIOThreadLagHistogramKey and GSIOThreadSlowKey
+ * values for each thread.
+ */
+- (NSDictionary*) lagStatistics;
+
 /** Returns the acquire count for the specified thread.
  */
 - (NSUInteger) countForThread: (NSThread*)aThread;
 
+/** Returns the interval at which threads measure their load, or zero
+ * if load is not measured.
+ */
+- (NSTimeInterval) loadInterval;
+
 /** Returns the currently configured maximum number of threads in the pool.
  */
 - (NSUInteger) maxThreads;
 
+/** Supports moving new work away from a busy thread.  If aThread (which
+ * must have been acquired from the receiver) has a -load greater than
+ * the threshold, and another thread in the pool is less loaded, this
+ * releases aThread, acquires the less loaded thread and returns it.
+ * Otherwise aThread is returned unchanged.<br />
+ * Call this when a new job (eg a new connection) would otherwise be
+ * added to the thread, so that existing work stays where it is.
+ */
+- (NSThread*) migrateThread: (NSThread*)aThread ifLoadAbove: (double)threshold;
+
+/** Returns the placement policy for threads of the pool.
+ */
+- (GSThreadPlacement) placement;
+
+/** Sets the policy for placing the threads of the pool on CPUs, with
+ * cpus being the set of CPUs to be used (nil means all CPUs) for the
+ * GSThreadPlacementPinned and GSThreadPlacementSpread policies.<br />
+ * The policy applies to threads created after this call.<br />
+ * With the GSThreadPlacementNode policy each thread is bound to the CPUs
+ * of one NUMA node, and -acquireThread prefers threads on the node of
+ * the calling thread.
+ */
+- (void) setPlacement: (GSThreadPlacement)policy cpus: (NSIndexSet*)cpus;
+
+/** Sets the interval (in seconds) at which the threads of the pool
+ * measure their -load and -lag, or turns off measurement if the interval
+ * is zero (the default).<br />
+ * While load is measured, -acquireThread chooses the thread with the
+ * lowest combination of load and lag (relative to the interval) rather
+ * than simply the thread with the lowest acquire count.
+ */
+- (void) setLoadInterval: (NSTimeInterval)interval;
+
+/** Sets the time (in seconds) above which a callback in a thread of
+ * the pool is considered slow, or turns off detection if it is zero (the
+ * default).<br />
+ * Messages performed from the mailbox of a thread (and, for a
+ * GSEpollThread, descriptor handlers and timers) are timed, and any
+ * which take longer than the threshold are logged and recorded with
+ * their selector (see [GSIOThread-slowCallbacks]).  If load is measured
+ * (see -setLoadInterval:), a probe timer which is late by more than the
+ * threshold is recorded as a slow '(run loop)' callback.
+ */
+- (void) setSlowThreshold: (NSTimeInterval)threshold;
+
 /** Sets the base name for threads in this pool.  As threads are created they
  * are given names formed by assing the value of a counter to the base name.
  */
@@ -130,6 +301,11 @@
  */
 - (void) setThreads: (NSUInteger)max;
 
+/** Returns the threshold for slow callback detection, or zero if
+ * detection is turned off.
+ */
+- (NSTimeInterval) slowThreshold;
+
 /** Specifies the timeout allowed for a thread to close down when the pool
  * is deallocated or has its size decreased.  Any operations in progress in
  * the thread need to close down within this period.
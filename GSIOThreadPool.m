@@ -21,14 +21,23 @@
    Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111 USA.
    */
 
+#include <inttypes.h>
+#include <time.h>
+
 #import <Foundation/NSArray.h>
 #import <Foundation/NSDate.h>
+#import <Foundation/NSDictionary.h>
+#import <Foundation/NSIndexSet.h>
 #import <Foundation/NSLock.h>
+#import <Foundation/NSNull.h>
 #import <Foundation/NSRunLoop.h>
+#import <Foundation/NSString.h>
 #import <Foundation/NSThread.h>
 #import <Foundation/NSTimer.h>
 #import <Foundation/NSException.h>
 #import <Foundation/NSUserDefaults.h>
+#import <Foundation/NSValue.h>
+#import <Foundation/NSZone.h>
 #import <Foundation/NSAutoreleasePool.h>
 #import	"GSIOThreadPool.h"
 
@@ -41,11 +50,71 @@
 static NSRecursiveLock   *classLock = nil;
 
 @interface	GSIOThread (Private)
+- (void) _cancelProbe: (id)handle;
 - (NSUInteger) _count;
+- (void) _drainMailbox;
 - (void) _finish: (NSTimer*)t;
+- (NSUInteger) _node;
+- (void) _probe: (NSTimer*)t;
+- (id) _scheduleProbe: (NSTimeInterval)interval;
+- (double) _score;
 - (void) _setCount: (NSUInteger)c;
+- (void) _setLoadInterval: (NSTimeInterval)interval;
+- (void) _setProbeInterval: (NSNumber*)interval;
+- (void) _setPlacement: (GSThreadPlacement)p
+		  cpus: (NSIndexSet*)c
+		 index: (NSUInteger)i;
+- (void) _setSlowThreshold: (NSTimeInterval)threshold;
+- (void) _setup;
+- (void) _signalMailbox;
+- (void) _slow: (id)target selector: (SEL)sel duration: (NSTimeInterval)d;
+- (NSTimeInterval) _slowThreshold;
 @end
 
+NSString * const GSIOThreadCallbackKey = @"Callback";
+NSString * const GSIOThreadDateKey = @"Date";
+NSString * const GSIOThreadDurationKey = @"Duration";
+NSString * const GSIOThreadLagHistogramKey = @"LagHistogram";
+NSString * const GSIOThreadLagKey = @"Lag";
+NSString * const GSIOThreadLoadKey = @"Load";
+NSString * const GSIOThreadSlowKey = @"Slow";
+
+/* Returns a monotonic time in seconds, for measuring intervals.
+ */
+static inline NSTimeInterval
+monotonic()
+{
+  struct timespec	ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1000000000.0;
+}
+
+/* Returns the histogram bucket for a time in seconds.
+ */
+static inline unsigned
+bucket(NSTimeInterval t)
+{
+  uint64_t	us = (uint64_t)(t * 1000000.0);
+  unsigned	b;
+
+  if (0 == us)
+    {
+      return 0;
+    }
+  b = 64 - __builtin_clzll(us);
+  return (b < 32) ? b : 31;
+}
+
+/* A message in the mailbox of a thread.
+ */
+typedef struct GSIOMessage {
+  struct GSIOMessage	*next;
+  id			target;
+  SEL			selector;
+  id			object;
+} GSIOMessage;
+
 @implementation	GSIOThread (Private)
 
 + (void) initialize
@@ -61,15 +130,185 @@ static NSRecursiveLock   *classLock = nil;
   return _count;
 }
 
+/* Performs all the messages in the mailbox ... must be called in the
+ * thread.  The mailbox is a Vyukov style queue, where producers swap
+ * themselves in at the head and the consumer follows the links from the
+ * tail (the last message performed).  The signalled flag is cleared
+ * before draining, so that anything posted from then on wakes us again.
+ */
+- (void) _drainMailbox
+{
+  NSAutoreleasePool	*arp = [NSAutoreleasePool new];
+  NSTimeInterval	threshold = _slowThreshold;
+  NSTimeInterval	start = 0.0;
+
+  __sync_lock_test_and_set(&_mailSignalled, 0);
+  __sync_synchronize();
+  for (;;)
+    {
+      GSIOMessage	*tail = (GSIOMessage*)_mailTail;
+      GSIOMessage	*next = *(GSIOMessage* volatile*)&tail->next;
+      id		target;
+      id		object;
+
+      if (0 == next)
+	{
+	  /* Empty, or a producer is part way through posting, in which
+	   * case it will signal us again when it completes.
+	   */
+	  break;
+	}
+      _mailTail = next;
+      NSZoneFree(NSDefaultMallocZone(), tail);
+      target = next->target;
+      object = next->object;
+      next->target = nil;
+      next->object = nil;
+      if (threshold > 0.0)
+	{
+	  start = monotonic();
+	}
+      NS_DURING
+	{
+	  [target performSelector: next->selector withObject: object];
+	}
+      NS_HANDLER
+	{
+	  NSLog(@"%@ problem performing %@: %@", self,
+	    NSStringFromSelector(next->selector), localException);
+	}
+      NS_ENDHANDLER
+      if (threshold > 0.0 && monotonic() - start > threshold)
+	{
+	  [self _slow: target
+	     selector: next->selector
+	     duration: monotonic() - start];
+	}
+      [target release];
+      [object release];
+    }
+  [arp release];
+}
+
 /* Force termination of this thread.
  */
 - (void) _finish: (NSTimer*)t
 {
   _timer = nil;
+  if (nil != _probe)
+    {
+      [self _cancelProbe: _probe];
+      DESTROY(_probe);
+    }
   [self shutdown];
   [NSThread exit];
 }
 
+/* Returns the NUMA node the thread is placed on, or NSNotFound.
+ */
+- (NSUInteger) _node
+{
+  if (GSThreadPlacementNode == _placement)
+    {
+      return _index;
+    }
+  return NSNotFound;
+}
+
+/* Returns the CPU time used by the current thread, or zero if that
+ * is not available.
+ */
+static NSTimeInterval
+threadCPU()
+{
+#if	defined(CLOCK_THREAD_CPUTIME_ID)
+  struct timespec	ts;
+
+  if (0 == clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts))
+    {
+      return ts.tv_sec + ts.tv_nsec / 1000000000.0;
+    }
+#endif
+  return 0.0;
+}
+
+/* Measures the load of the thread.  This is called by a timer in the
+ * thread itself, so the delay in firing shows how long events wait to be
+ * handled and the CPU time used since the last call shows how busy the
+ * thread is.  Both are smoothed as exponentially weighted averages.
+ */
+- (void) _probe: (NSTimer*)t
+{
+  NSTimeInterval	now = monotonic();
+  NSTimeInterval	cpu = threadCPU();
+  NSTimeInterval	lag = now - _expected;
+  double		busy = 0.0;
+
+  if (lag < 0.0)
+    {
+      lag = 0.0;
+    }
+  if (now > _lastProbe && cpu > 0.0)
+    {
+      busy = (cpu - _lastCPU) / (now - _lastProbe);
+      if (busy > 1.0)
+	{
+	  busy = 1.0;
+	}
+    }
+  [classLock lock];
+  _load = _load * 0.75 + busy * 0.25;
+  _lag = _lag * 0.75 + lag * 0.25;
+  _lagCounts[bucket(lag)]++;
+  [classLock unlock];
+  if (_slowThreshold > 0.0 && lag > _slowThreshold)
+    {
+      [self _slow: nil selector: 0 duration: lag];
+    }
+  _lastProbe = now;
+  _lastCPU = cpu;
+  DESTROY(_probe);
+  if (_probeInterval > 0.0)
+    {
+      _expected = now + _probeInterval;
+      _probe = [self _scheduleProbe: _probeInterval];
+    }
+}
+
+/* Cancels a probe scheduled by -_scheduleProbe:
+ */
+- (void) _cancelProbe: (id)handle
+{
+  [(NSTimer*)handle invalidate];
+}
+
+/* Arranges for -_probe: to be called after the interval, returning a
+ * retained handle for -_cancelProbe:.  Subclasses which run their own
+ * event loop override this so that the probe measures that loop.
+ */
+- (id) _scheduleProbe: (NSTimeInterval)interval
+{
+  return [[NSTimer scheduledTimerWithTimeInterval: interval
+					   target: self
+					 selector: @selector(_probe:)
+					 userInfo: nil
+					  repeats: NO] retain];
+}
+
+/* Returns a value for comparing the load of threads, lower is better.
+ * This must be called with the class lock held.
+ */
+- (double) _score
+{
+  double	score = _load;
+
+  if (_probeInterval > 0.0)
+    {
+      score += _lag / _probeInterval;
+    }
+  return score + _count * 0.01;		// Break ties by acquire count
+}
+
 - (void) _setCount: (NSUInteger)c
 {
   if (NSNotFound != _count)
@@ -78,10 +317,169 @@ static NSRecursiveLock   *classLock = nil;
     }
 }
 
+- (void) _setSlowThreshold: (NSTimeInterval)threshold
+{
+  _slowThreshold = threshold;
+}
+
+/* Prepares the thread for running its event loop ... called at the
+ * start of -main (in the new thread).
+ */
+- (void) _setup
+{
+  if (GSThreadPlacementNone != _placement
+    && NO == GSThreadPoolPlaceCurrentThread(_placement, _cpus, _index))
+    {
+      NSLog(@"%@ unable to set CPU affinity", self);
+    }
+  [self startup];
+  if (_probeInterval > 0.0)
+    {
+      NSTimeInterval	i = _probeInterval;
+
+      _probeInterval = 0.0;
+      [self _setProbeInterval: [NSNumber numberWithDouble: i]];
+    }
+}
+
+/* Wakes the thread to drain its mailbox.  Subclasses running their own
+ * event loop override this.
+ */
+- (void) _signalMailbox
+{
+  if (NO == [self isFinished])
+    {
+      [self performSelector: @selector(_drainMailbox)
+		   onThread: self
+		 withObject: nil
+	      waitUntilDone: NO];
+    }
+}
+
+/* Records a slow callback (or a late probe if target is nil).
+ */
+- (void) _slow: (id)target selector: (SEL)sel duration: (NSTimeInterval)d
+{
+  NSDictionary	*info;
+  NSString	*n;
+
+  if (nil == target)
+    {
+      n = @"(run loop)";
+    }
+  else
+    {
+      n = [NSString stringWithFormat: @"%c[%@ %@]",
+	([target class] == target) ? '+' : '-',
+	NSStringFromClass([target class]), NSStringFromSelector(sel)];
+    }
+  NSLog(@"%@ slow callback %@ took %g seconds", self, n, d);
+  info = [NSDictionary dictionaryWithObjectsAndKeys:
+    n, GSIOThreadCallbackKey,
+    [NSDate date], GSIOThreadDateKey,
+    [NSNumber numberWithDouble: d], GSIOThreadDurationKey,
+    nil];
+  [classLock lock];
+  if (nil == _slow)
+    {
+      _slow = [NSMutableArray new];
+    }
+  if ([_slow count] >= 32)
+    {
+      [_slow removeObjectAtIndex: 0];
+    }
+  [_slow addObject: info];
+  [classLock unlock];
+}
+
+- (NSTimeInterval) _slowThreshold
+{
+  return _slowThreshold;
+}
+
+/* Sets the load measurement interval before the thread is started.
+ */
+- (void) _setLoadInterval: (NSTimeInterval)interval
+{
+  _probeInterval = interval;
+}
+
+/* Starts or stops load measurement ... must be called in the thread.
+ */
+- (void) _setProbeInterval: (NSNumber*)interval
+{
+  _probeInterval = [interval doubleValue];
+  if (_probeInterval > 0.0)
+    {
+      if (nil == _probe)
+	{
+	  _lastProbe = monotonic();
+	  _lastCPU = threadCPU();
+	  _expected = _lastProbe + _probeInterval;
+	  _probe = [self _scheduleProbe: _probeInterval];
+	}
+    }
+  else
+    {
+      if (nil != _probe)
+	{
+	  [self _cancelProbe: _probe];
+	  DESTROY(_probe);
+	}
+      [classLock lock];
+      _load = 0.0;
+      _lag = 0.0;
+      [classLock unlock];
+    }
+}
+
+/* Sets the placement to be applied when the thread starts.
+ */
+- (void) _setPlacement: (GSThreadPlacement)p
+		  cpus: (NSIndexSet*)c
+		 index: (NSUInteger)i
+{
+  _placement = p;
+  ASSIGNCOPY(_cpus, c);
+  _index = i;
+}
+
 @end
 
 @implementation	GSIOThread
 
+- (void) dealloc
+{
+  GSIOMessage	*m = (GSIOMessage*)_mailTail;
+
+  while (0 != m)
+    {
+      GSIOMessage	*next = m->next;
+
+      [m->target release];
+      [m->object release];
+      NSZoneFree(NSDefaultMallocZone(), m);
+      m = next;
+    }
+  DESTROY(_cpus);
+  DESTROY(_probe);
+  DESTROY(_slow);
+  [super dealloc];
+}
+
+- (id) init
+{
+  if ((self = [super init]) != nil)
+    {
+      GSIOMessage	*stub;
+
+      stub = (GSIOMessage*)NSZoneCalloc(NSDefaultMallocZone(),
+	1, sizeof(GSIOMessage));
+      _mailHead = _mailTail = stub;
+    }
+  return self;
+}
+
 /* Run the thread's main runloop until terminated.
  */
 - (void) main
@@ -90,7 +488,7 @@ static NSRecursiveLock   *classLock = nil;
   NSDate		*when = [NSDate distantFuture];
   NSTimeInterval	delay = [when timeIntervalSinceNow];
 
-  [self startup];
+  [self _setup];
   _timer = [NSTimer scheduledTimerWithTimeInterval: delay
 					    target: self
 					  selector: @selector(_finish:)
@@ -100,6 +498,75 @@ static NSRecursiveLock   *classLock = nil;
   [pool release];
 }
 
+- (NSTimeInterval) lag
+{
+  NSTimeInterval	l;
+
+  [classLock lock];
+  l = _lag;
+  [classLock unlock];
+  return l;
+}
+
+- (NSArray*) lagHistogram
+{
+  NSMutableArray	*a = [NSMutableArray arrayWithCapacity: 32];
+  unsigned		i;
+
+  [classLock lock];
+  for (i = 0; i < 32; i++)
+    {
+      [a addObject: [NSNumber numberWithUnsignedInt: _lagCounts[i]]];
+    }
+  [classLock unlock];
+  return a;
+}
+
+- (double) load
+{
+  double	l;
+
+  [classLock lock];
+  l = _load;
+  [classLock unlock];
+  return l;
+}
+
+- (void) postSelector: (SEL)aSelector target: (id)aTarget object: (id)anObject
+{
+  GSIOMessage	*m;
+  GSIOMessage	*prev;
+
+  if (nil == aTarget || 0 == aSelector)
+    {
+      [NSException raise: NSInvalidArgumentException
+		  format: @"[%@-%@] nil target or null selector",
+	NSStringFromClass([self class]), NSStringFromSelector(_cmd)];
+    }
+  m = (GSIOMessage*)NSZoneMalloc(NSDefaultMallocZone(), sizeof(GSIOMessage));
+  m->next = 0;
+  m->target = [aTarget retain];
+  m->selector = aSelector;
+  m->object = [anObject retain];
+  prev = (GSIOMessage*)__sync_lock_test_and_set(&_mailHead, (void*)m);
+  __sync_synchronize();
+  *(GSIOMessage* volatile*)&prev->next = m;
+  if (__sync_bool_compare_and_swap(&_mailSignalled, 0, 1))
+    {
+      [self _signalMailbox];
+    }
+}
+
+- (NSArray*) slowCallbacks
+{
+  NSArray	*a;
+
+  [classLock lock];
+  a = [NSArray arrayWithArray: _slow];
+  [classLock unlock];
+  return a;
+}
+
 - (void) shutdown
 {
   return;
@@ -190,20 +657,60 @@ static NSRecursiveLock   *classLock = nil;
 @end
 
 
+@interface	GSIOThreadPool (Private)
+- (GSIOThread*) _create: (NSUInteger)index;
+- (GSIOThread*) _replace: (NSUInteger)slot;
+@end
+
 @implementation	GSIOThreadPool
 
 static GSIOThreadPool	*shared = nil;
 
-/* Return the thread with the lowest usage.
+/* Jump consistent hash (Lamping and Veach) ... maps a key to one of
+ * count buckets, such that changing the number of buckets from N to M
+ * only moves |N-M|/max(N,M) of the keys.  The key is mixed first, since
+ * the -hash of many objects is not well distributed.
+ */
+static NSUInteger
+jump(NSUInteger hash, NSUInteger count)
+{
+  uint64_t	key = (uint64_t)hash;
+  int64_t	b = -1;
+  int64_t	j = 0;
+
+  key ^= key >> 33;
+  key *= 0xff51afd7ed558ccdULL;
+  key ^= key >> 33;
+  key *= 0xc4ceb9fe1a85ec53ULL;
+  key ^= key >> 33;
+  while (j < (int64_t)count)
+    {
+      b = j;
+      key = key * 2862933555777941757ULL + 1;
+      j = (int64_t)((b + 1)
+	* ((double)(1LL << 31) / (double)((key >> 33) + 1)));
+    }
+  return (NSUInteger)b;
+}
+
+/* Return the thread with the lowest usage (acquire count, or load score
+ * if byLoad is YES).
  * If there are more threads in the array than we want to use,
  * those excess threads are excluded from the check so that
  * their usage can drop to zero and they can be terminated.
+ * A dead thread is replaced in place (rather than removed) so that the
+ * threads after it keep their indices, which key affinity depends on.
+ * If node is not NSNotFound, only threads on that NUMA node are
+ * considered, and the number of them is returned in found.
  */
 static GSIOThread *
-best(NSMutableArray *a, NSUInteger max)
+best(GSIOThreadPool *p, NSMutableArray *a, NSUInteger max, NSUInteger node,
+  NSUInteger *found, BOOL byLoad)
 {
   NSUInteger	c = [a count];
   NSUInteger	l = NSNotFound;
+  double	score = 0.0;
+  NSUInteger	n = 0;
   GSIOThread	*t = nil;
 
   if (c > max)
@@ -213,21 +720,40 @@ best(NSMutableArray *a, NSUInteger max)
   while (c-- > 0)
     {
       GSIOThread	*o = [a objectAtIndex: c];
+      NSUInteger	i;
 
-      if ([o isExecuting])
-        {
-          NSUInteger    i;
+      if ([o isCancelled] || [o isFinished])
+	{
+	  o = [p _replace: c];
+	}
+      else if (NO == [o isExecuting])
+	{
+	  continue;
+	}
+      if (NSNotFound != node && [o _node] != node)
+	{
+	  continue;
+	}
+      n++;
+      if (YES == byLoad)
+	{
+	  double	d = [o _score];
 
-          if ((i = [o _count]) < l)
-            {
-              t = o;
-              l = i;
-            }
-        }
-      else if ([o isCancelled] || [o isFinished])
-        {
-          [a removeObjectAtIndex: c];
-        }
+	  if (nil == t || d < score)
+	    {
+	      t = o;
+	      score = d;
+	    }
+	}
+      else if ((i = [o _count]) < l)
+	{
+	  t = o;
+	  l = i;
+	}
+    }
+  if (0 != found)
+    {
+      *found = n;
     }
   return t;
 }
@@ -258,7 +784,9 @@ best(NSMutableArray *a, NSUInteger max)
 - (NSThread*) acquireThread
 {
   GSIOThread	*t;
-  NSUInteger    c;
+  NSUInteger    c = 0;
+  NSUInteger	node = NSNotFound;
+  BOOL		byLoad = (loadInterval > 0.0) ? YES : NO;
 
   if (0 == maxThreads)
     {
@@ -266,21 +794,54 @@ best(NSMutableArray *a, NSUInteger max)
     }
 
   [classLock lock];
-  t = best(threads, maxThreads);
-  if (nil == t || ((c = [t _count]) > 0 && [threads count] < maxThreads))
+  if (GSThreadPlacementNode == placement && GSThreadPoolNodeCount() > 1)
     {
-      NSString	*n;
+      NSUInteger	nodes = GSThreadPoolNodeCount();
+      NSUInteger	share = (maxThreads + nodes - 1) / nodes;
+      NSUInteger	found;
+
+      /* Use a thread on the local node, creating one if all the local
+       * threads are in use and the node has less than its share.
+       * Only spill over to another node if the local one is saturated.
+       */
+      node = GSThreadPoolCurrentNode();
+      t = best(self, threads, maxThreads, node, &found, byLoad);
+      if (nil != t)
+	{
+	  c = [t _count];
+	}
+      if (nil == t || c > 0)
+	{
+	  if (found < share && [threads count] < maxThreads)
+	    {
+	      t = nil;
+	    }
+	  else
+	    {
+	      GSIOThread	*o;
+
+	      o = best(self, threads, maxThreads, NSNotFound, 0, byLoad);
 
-      t = [threadClass new];
-      if (nil == (n = poolName))
+	      if (nil != o && (nil == t || (YES == byLoad
+		? [o _score] < [t _score] : [o _count] < c)))
+		{
+		  t = o;
+		  c = [t _count];
+		}
+	    }
+	}
+    }
+  else
+    {
+      t = best(self, threads, maxThreads, NSNotFound, 0, byLoad);
+      if (nil != t && (c = [t _count]) > 0 && [threads count] < maxThreads)
 	{
-	  n = @"GSIOThreadPool";
+	  t = nil;
 	}
-      n = [NSString stringWithFormat: @"%@-%u", n, ++created];
-      [t setName: n];
-      [threads addObject: t];
-      [t release];
-      [t start];
+    }
+  if (nil == t)
+    {
+      t = [self _create: ((NSNotFound == node) ? created : node)];
       c = 0;
     }
   [t _setCount: c + 1];
@@ -288,6 +849,88 @@ best(NSMutableArray *a, NSUInteger max)
   return t;
 }
 
+- (NSThread*) acquireThreadForKey: (id)aKey
+{
+  GSIOThread	*t;
+  NSUInteger	slot;
+  NSUInteger	nodes = 1;
+
+  if (0 == maxThreads)
+    {
+      return [NSThread mainThread];
+    }
+
+  [classLock lock];
+  if (GSThreadPlacementNode == placement)
+    {
+      nodes = GSThreadPoolNodeCount();
+    }
+  slot = jump([aKey hash], maxThreads);
+
+  /* Slot N is the thread at index N in the pool, so we create any
+   * threads missing up to the slot, and replace a dead thread in place
+   * so that the other keys keep their threads.
+   */
+  while ([threads count] <= slot)
+    {
+      NSUInteger	index = [threads count];
+
+      [self _create: (nodes > 1) ? index % nodes : created];
+    }
+  t = [threads objectAtIndex: slot];
+  if ([t isCancelled] || [t isFinished] || NSNotFound == [t _count])
+    {
+      t = [self _replace: slot];
+    }
+  [t _setCount: [t _count] + 1];
+  [classLock unlock];
+  return t;
+}
+
+/* Creates and starts a new thread, adding it to the pool.
+ * Must be called with the class lock held.
+ */
+- (GSIOThread*) _create: (NSUInteger)index
+{
+  GSIOThread	*t;
+  NSString	*n;
+
+  t = [threadClass new];
+  [t _setPlacement: placement cpus: placementCPUs index: index];
+  [t _setLoadInterval: loadInterval];
+  [t _setSlowThreshold: slowThreshold];
+  if (nil == (n = poolName))
+    {
+      n = @"GSIOThreadPool";
+    }
+  n = [NSString stringWithFormat: @"%@-%u", n, ++created];
+  [t setName: n];
+  [threads addObject: t];
+  [t release];
+  [t start];
+  return t;
+}
+
+/* Creates and starts a new thread to replace the dead one at slot,
+ * keeping the indices of the other threads in the pool unchanged.
+ * Must be called with the class lock held.
+ */
+- (GSIOThread*) _replace: (NSUInteger)slot
+{
+  NSUInteger	nodes = 1;
+  GSIOThread	*t;
+
+  if (GSThreadPlacementNode == placement)
+    {
+      nodes = GSThreadPoolNodeCount();
+    }
+  t = [[self _create: (nodes > 1) ? slot % nodes : created] retain];
+  [threads removeObjectIdenticalTo: t];
+  [threads replaceObjectAtIndex: slot withObject: t];
+  [t release];
+  return t;
+}
+
 - (NSUInteger) countForThread: (NSThread*)aThread
 {
   NSUInteger	count = 0;
@@ -320,6 +963,7 @@ best(NSMutableArray *a, NSUInteger max)
   [classLock unlock];
 #endif
   DESTROY(poolName);
+  DESTROY(placementCPUs);
   [super dealloc];
 }
 
@@ -339,11 +983,74 @@ best(NSMutableArray *a, NSUInteger max)
   return self;
 }
 
+- (NSDictionary*) lagStatistics
+{
+  NSMutableDictionary	*d = [NSMutableDictionary dictionary];
+  NSArray		*a;
+  NSUInteger		i;
+
+  [classLock lock];
+  a = [NSArray arrayWithArray: threads];
+  [classLock unlock];
+  for (i = 0; i < [a count]; i++)
+    {
+      GSIOThread	*t = [a objectAtIndex: i];
+
+      [d setObject: [NSDictionary dictionaryWithObjectsAndKeys:
+	[NSNumber numberWithDouble: [t lag]], GSIOThreadLagKey,
+	[NSNumber numberWithDouble: [t load]], GSIOThreadLoadKey,
+	[t lagHistogram], GSIOThreadLagHistogramKey,
+	[t slowCallbacks], GSIOThreadSlowKey,
+	nil]
+	    forKey: [t name]];
+    }
+  return d;
+}
+
+- (NSTimeInterval) loadInterval
+{
+  return loadInterval;
+}
+
 - (NSUInteger) maxThreads
 {
   return maxThreads;
 }
 
+- (NSThread*) migrateThread: (NSThread*)aThread ifLoadAbove: (double)threshold
+{
+  GSIOThread	*t = nil;
+
+  [classLock lock];
+  if (loadInterval > 0.0
+    && [threads indexOfObjectIdenticalTo: aThread] != NSNotFound
+    && [(GSIOThread*)aThread load] > threshold)
+    {
+      t = best(self, threads, maxThreads, NSNotFound, 0, YES);
+      if (nil == t || t == aThread
+	|| [t load] >= [(GSIOThread*)aThread load])
+	{
+	  t = nil;
+	}
+      else
+	{
+	  [t _setCount: [t _count] + 1];
+	}
+    }
+  [classLock unlock];
+  if (nil == t)
+    {
+      return aThread;
+    }
+  [self unacquireThread: aThread];
+  return t;
+}
+
+- (GSThreadPlacement) placement
+{
+  return placement;
+}
+
 - (NSString*) poolName
 {
   NSString	*n;
@@ -368,9 +1075,63 @@ best(NSMutableArray *a, NSUInteger max)
   [classLock unlock];
 }
 
+- (void) setLoadInterval: (NSTimeInterval)interval
+{
+  NSNumber	*n;
+  NSUInteger	i;
+
+  if (interval < 0.0)
+    {
+      interval = 0.0;
+    }
+  n = [NSNumber numberWithDouble: interval];
+  [classLock lock];
+  loadInterval = interval;
+  for (i = 0; i < [threads count]; i++)
+    {
+      GSIOThread	*t = [threads objectAtIndex: i];
+
+      if ([t isExecuting])
+	{
+	  [t performSelector: @selector(_setProbeInterval:)
+		    onThread: t
+		  withObject: n
+	       waitUntilDone: NO];
+	}
+    }
+  [classLock unlock];
+}
+
+- (void) setSlowThreshold: (NSTimeInterval)threshold
+{
+  NSUInteger	i;
+
+  if (threshold < 0.0)
+    {
+      threshold = 0.0;
+    }
+  [classLock lock];
+  slowThreshold = threshold;
+  for (i = 0; i < [threads count]; i++)
+    {
+      [[threads objectAtIndex: i] _setSlowThreshold: threshold];
+    }
+  [classLock unlock];
+}
+
+- (void) setPlacement: (GSThreadPlacement)policy cpus: (NSIndexSet*)cpus
+{
+  [classLock lock];
+  placement = policy;
+  ASSIGNCOPY(placementCPUs, cpus);
+  [classLock unlock];
+}
+
 - (void) setThreads: (NSUInteger)max
 {
+  [classLock lock];
   maxThreads = max;
+  [classLock unlock];
 }
 
 - (void) setThreadClass: (Class)aClass
@@ -388,6 +1149,11 @@ best(NSMutableArray *a, NSUInteger max)
   timeout = t;
 }
 
+- (NSTimeInterval) slowThreshold
+{
+  return slowThreshold;
+}
+
 - (NSTimeInterval) timeout
 {
   return timeout;
@@ -395,8 +1161,11 @@ best(NSMutableArray *a, NSUInteger max)
 
 - (void) unacquireThread: (NSThread*)aThread
 {
+  NSUInteger	index;
+
   [classLock lock];
-  if ([threads indexOfObjectIdenticalTo: aThread] != NSNotFound)
+  index = [threads indexOfObjectIdenticalTo: aThread];
+  if (index != NSNotFound)
     {
       NSUInteger        c;
 
@@ -408,7 +1177,11 @@ best(NSMutableArray *a, NSUInteger max)
 		      format: @"-unacquireThread: called too many times"];
 	}
       [((GSIOThread*)aThread) _setCount: --c];
-      if (0 == c && [threads count] > maxThreads)
+
+      /* Only threads beyond the configured size are terminated, so that
+       * the remaining threads keep their positions (and their keys).
+       */
+      if (0 == c && index >= maxThreads)
         {
           [aThread retain];
           [threads removeObjectIdenticalTo: aThread];
@@ -423,4 +1196,3 @@ best(NSMutableArray *a, NSUInteger max)
 }
 
 @end
-
@@ -0,0 +1,182 @@
+#if	!defined(INCLUDED_GSPRIORITYFIFO)
+#define	INCLUDED_GSPRIORITYFIFO	1
+/**
+   Copyright (C) 2026 Free Software Foundation, Inc.
+
+   Written by:  Richard Frith-Macdonald <rfm@gnu.org>
+   Date:        October 2026
+
+   This file is part of the Performance Library.
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 3 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; if not, write to the Free
+   Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111 USA.
+   */
+#import <Foundation/NSObject.h>
+#import <Foundation/NSDate.h>
+
+#if !defined (GNUSTEP)
+#import  "GNUstep.h"
+#endif
+
+@class GSFIFO;
+@class NSArray;
+@class NSCondition;
+@class NSString;
+
+/** GSPriorityFIFO manages a set of first-in-first-out queues of items,
+ * one for each of a number of priority classes, with consumers taking
+ * items from all the classes through a single blocking -get method.<br />
+ * This allows urgent items (eg control messages or heartbeats) to
+ * overtake bulk items which were added to the same queue earlier, so that
+ * their latency stays flat even when the queue is flooded with bulk work.
+ * <br />
+ * Priority class zero is the most urgent.  Items are taken either in
+ * strict priority order (an item is only taken from a class if all more
+ * urgent classes are empty) or using weighted round robin selection
+ * (each non-empty class in turn supplies up to its weight in items), so
+ * that less urgent classes can not be completely starved.<br />
+ * Each class is held in a GSFIFO buffer, and all the buffers are
+ * protected by a single lock, so any number of producer and consumer
+ * threads may use the queue.<br />
+ * As with GSFIFO, items are not retained unless the object based
+ * methods are used.
+ */
+@interface	GSPriorityFIFO : NSObject
+{
+@private
+  NSCondition		*condition;
+  NSString		*name;
+  GSFIFO		**fifos;	// One buffer per class
+  uint32_t		levels;		// Number of classes
+  uint32_t		current;	// Round robin position
+  uint32_t		*weights;	// Weights (or NULL if strict)
+  uint32_t		*credits;	// Items left in round robin turn
+  uint16_t		timeout;
+  uint64_t		total;		// Total items in all classes
+  uint64_t		*putCounts;	// Items added by class
+  uint64_t		*getCounts;	// Items removed by class
+  uint64_t		*fullCounts;	// Waits for space by class
+  uint64_t		*maxCounts;	// Peak depth by class
+  uint64_t		emptyCount;	// Waits for any item
+}
+
+/** Returns the approximate number of items in all classes.
+ */
+- (NSUInteger) count;
+
+/** Returns the approximate number of items in the specified class.
+ */
+- (NSUInteger) countForPriority: (uint32_t)level;
+
+/** Reads up to count items from the queue into buf, choosing each item
+ * according to the configured priority policy.  If priorities is not
+ * NULL, the class from which each item was taken is stored in the
+ * corresponding element of that array.<br />
+ * If block is YES, this blocks if necessary until at least one item
+ * is available (in any class) or until the before date (if not nil),
+ * and raises an exception if the queue is configured with a timeout and
+ * it is exceeded.<br />
+ * Returns the number of items actually read.
+ */
+- (unsigned) get: (void**)buf
+      priorities: (uint32_t*)priorities
+	   count: (unsigned)count
+     shouldBlock: (BOOL)block
+	  before: (NSDate*)date;
+
+/** Gets the next item from the queue, blocking if necessary until an
+ * item is available in any class.<br />
+ * Implemented using -get:priorities:count:shouldBlock:before:
+ */
+- (void*) get;
+
+/** Gets the next object from the queue (which must contain objects or
+ * nil items), blocking if necessary until an object is available.
+ * Autoreleases the object before returning it.
+ */
+- (NSObject*) getObject;
+
+/** <init/>
+ * Initialises the receiver with k priority classes,
+ * each having a buffer of capacity c.<br />
+ * If w is nil, items are taken in strict priority order, otherwise
+ * it must be an array of k positive integers giving the number of
+ * items to be taken from each class in each round of weighted round robin
+ * selection.<br />
+ * If the timeout value is non-zero, it is treated as the total time in
+ * milliseconds for which a -get or -put:priority: operation may block,
+ * and a longer delay will cause those methods to raise an exception.<br />
+ * The name (GSPriorityFIFO if n is nil) is used for diagnostics and
+ * statistics.  The buffer for each class is an anonymous GSFIFO, so it
+ * does not appear separately in +[GSFIFO stats].<br />
+ * Returns nil if k or c is zero.
+ */
+- (id) initWithLevels: (uint32_t)k
+	     capacity: (uint32_t)c
+	      weights: (NSArray*)w
+	      timeout: (uint16_t)t
+		 name: (NSString*)n;
+
+/** Initialises the receiver using the specified name and obtaining other
+ * details from the NSUserDefaults system using defaults keys where 'NNN'
+ * is the supplied name.<br />
+ * The GSPriorityFIFOLevelsNNN integer is the number of priority classes
+ * (2 by default).<br />
+ * The GSPriorityFIFOCapacityNNN integer is the capacity of each class
+ * (1000 by default).<br />
+ * The GSPriorityFIFOWeightsNNN array is missing by default (meaning that
+ * strict priority is used).<br />
+ * The GSPriorityFIFOTimeoutNNN integer is zero by default.<br />
+ * If no default is found for the specific named queue, the default set
+ * for a queue with an empty name is used.
+ */
+- (id) initWithName: (NSString*)n;
+
+/** Returns the number of priority classes of the receiver.
+ */
+- (uint32_t) levels;
+
+/** Adds an item to the specified priority class, blocking if necessary
+ * until there is space in the buffer for that class.  Raises an exception
+ * if the queue is configured with a timeout and it is exceeded, or if the
+ * priority is not less than the number of classes.
+ */
+- (void) put: (void*)item priority: (uint32_t)level;
+
+/** Adds an object to the specified class (retaining the object), blocking
+ * if necessary until there is space in the buffer for that class.
+ */
+- (void) putObject: (NSObject*)item priority: (uint32_t)level;
+
+/** Returns statistics for the receiver, broken down by class.
+ */
+- (NSString*) stats;
+
+/** Checks the queue and returns the next available item or NULL if all
+ * the classes are empty.
+ */
+- (void*) tryGet;
+
+/** Attempts to put an item into the specified class, returning YES
+ * on success or NO if the buffer for that class is full.
+ */
+- (BOOL) tryPut: (void*)item priority: (uint32_t)level;
+
+/** Returns YES if the receiver is using weighted round robin selection,
+ * NO if it is using strict priority.
+ */
+- (BOOL) weighted;
+@end
+
+#endif
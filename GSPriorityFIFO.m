@@ -0,0 +1,474 @@
+/**
+   Copyright (C) 2026 Free Software Foundation, Inc.
+
+   Written by:  Richard Frith-Macdonald <rfm@gnu.org>
+   Date:        October 2026
+
+   This file is part of the Performance Library.
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 3 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; if not, write to the Free
+   Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111 USA.
+   */
+#import "GSPriorityFIFO.h"
+#import "GSFIFO.h"
+#import <Foundation/NSArray.h>
+#import <Foundation/NSException.h>
+#import <Foundation/NSLock.h>
+#import <Foundation/NSString.h>
+#import <Foundation/NSUserDefaults.h>
+#import <Foundation/NSValue.h>
+#import <Foundation/NSZone.h>
+
+#include <inttypes.h>
+
+@implementation	GSPriorityFIFO
+
+/* Chooses the class from which the next item should be taken.
+ * Must be called with the lock held and with at least one item queued.
+ */
+static inline uint32_t
+choose(GSPriorityFIFO *q)
+{
+  uint32_t	level;
+
+  if (0 == q->weights)
+    {
+      for (level = 0; level < q->levels - 1; level++)
+	{
+	  if (q->fifos[level]->_head > q->fifos[level]->_tail)
+	    {
+	      break;
+	    }
+	}
+      return level;
+    }
+
+  /* Weighted round robin ... the current class supplies items until its
+   * credit is used up or it is empty, then we move on to the next.
+   * This terminates since there is at least one item in some class.
+   */
+  for (;;)
+    {
+      level = q->current;
+      if (q->fifos[level]->_head > q->fifos[level]->_tail)
+	{
+	  if (0 == --q->credits[level])
+	    {
+	      q->credits[level] = q->weights[level];
+	      q->current = (level + 1) % q->levels;
+	    }
+	  return level;
+	}
+      q->credits[level] = q->weights[level];
+      q->current = (level + 1) % q->levels;
+    }
+}
+
+- (NSUInteger) count
+{
+  return (NSUInteger)total;
+}
+
+- (NSUInteger) countForPriority: (uint32_t)level
+{
+  if (level >= levels)
+    {
+      return 0;
+    }
+  return (NSUInteger)(fifos[level]->_head - fifos[level]->_tail);
+}
+
+- (void) dealloc
+{
+  if (0 != fifos)
+    {
+      uint32_t	level;
+
+      for (level = 0; level < levels; level++)
+	{
+	  [fifos[level] release];
+	}
+      NSZoneFree(NSDefaultMallocZone(), fifos);
+    }
+  if (0 != weights)
+    {
+      NSZoneFree(NSDefaultMallocZone(), weights);
+    }
+  if (0 != putCounts)
+    {
+      NSZoneFree(NSDefaultMallocZone(), putCounts);
+    }
+  [condition release];
+  [name release];
+  [super dealloc];
+}
+
+- (NSString*) description
+{
+  return [NSString stringWithFormat:
+    @"%@ (%@) levels:%"PRIu32" policy:%s count:%"PRIu64"",
+    [super description], name, levels,
+    ((0 == weights) ? "strict" : "weighted"), total];
+}
+
+- (unsigned) get: (void**)buf
+      priorities: (uint32_t*)priorities
+	   count: (unsigned)count
+     shouldBlock: (BOOL)block
+	  before: (NSDate*)date
+{
+  unsigned	index;
+  BOOL		wasFull = NO;
+
+  if (0 == count)
+    {
+      return 0;
+    }
+
+  [condition lock];
+  if (0 == total)
+    {
+      emptyCount++;
+      if (NO == block)
+	{
+	  [condition unlock];
+	  return 0;
+	}
+      if (0 == timeout && nil == date)
+	{
+	  while (0 == total)
+	    {
+	      [condition wait];
+	    }
+	}
+      else
+	{
+	  NSDate	*d = nil;
+	  NSDate	*effective = date;
+
+	  if (timeout > 0)
+	    {
+	      d = [[NSDate alloc]
+		initWithTimeIntervalSinceNow: timeout / 1000.0f];
+	      if (nil == date || [d earlierDate: date] == d)
+		{
+		  effective = d;
+		}
+	    }
+	  while (0 == total)
+	    {
+	      if (NO == [condition waitUntilDate: effective])
+		{
+		  BOOL	timedOut = (effective == d) ? YES : NO;
+
+		  [d release];
+		  [condition unlock];
+		  if (YES == timedOut)
+		    {
+		      [NSException raise: NSGenericException
+			format: @"Timeout waiting for new data in FIFO"];
+		    }
+		  return 0;
+		}
+	    }
+	  [d release];
+	}
+    }
+
+  for (index = 0; index < count && total > 0; index++)
+    {
+      uint32_t	level = choose(self);
+      GSFIFO	*f = fifos[level];
+
+      if (f->_head - f->_tail == f->_capacity)
+	{
+	  wasFull = YES;
+	}
+      buf[index] = GSGetFastNonBlockingFIFO(f);
+      total--;
+      getCounts[level]++;
+      if (0 != priorities)
+	{
+	  priorities[index] = level;
+	}
+    }
+  if (YES == wasFull)
+    {
+      [condition broadcast];
+    }
+  [condition unlock];
+  return index;
+}
+
+- (void*) get
+{
+  void	*item = 0;
+
+  while (0 == [self get: &item
+	     priorities: 0
+		  count: 1
+	    shouldBlock: YES
+		 before: nil])
+    ;
+  return item;
+}
+
+- (NSObject*) getObject
+{
+  return [(NSObject*)[self get] autorelease];
+}
+
+- (id) initWithLevels: (uint32_t)k
+	     capacity: (uint32_t)c
+	      weights: (NSArray*)w
+	      timeout: (uint16_t)t
+		 name: (NSString*)n
+{
+  uint32_t	level;
+  NSArray	*none = [NSArray array];
+
+  if (0 == k || 0 == c)
+    {
+      [self release];
+      return nil;
+    }
+  if (nil != w)
+    {
+      if ([w count] != k)
+	{
+	  [self release];
+	  [NSException raise: NSInvalidArgumentException
+		      format: @"Bad weights"];
+	}
+      weights = (uint32_t*)NSZoneCalloc(NSDefaultMallocZone(),
+	2 * k, sizeof(uint32_t));
+      credits = weights + k;
+      for (level = 0; level < k; level++)
+	{
+	  NSNumber	*number = [w objectAtIndex: level];
+	  NSInteger	i;
+
+	  if (NO == [number isKindOfClass: [NSNumber class]]
+	    || (i = [number integerValue]) <= 0)
+	    {
+	      [self release];
+	      [NSException raise: NSInvalidArgumentException
+			  format: @"Bad weights"];
+	    }
+	  weights[level] = credits[level] = (uint32_t)i;
+	}
+    }
+  if (nil == n)
+    {
+      n = @"GSPriorityFIFO";
+    }
+  levels = k;
+  timeout = t;
+  name = [n copy];
+  condition = [NSCondition new];
+  putCounts = (uint64_t*)NSZoneCalloc(NSDefaultMallocZone(),
+    4 * k, sizeof(uint64_t));
+  getCounts = putCounts + k;
+  fullCounts = getCounts + k;
+  maxCounts = fullCounts + k;
+  fifos = (GSFIFO**)NSZoneCalloc(NSDefaultMallocZone(), k, sizeof(GSFIFO*));
+  for (level = 0; level < k; level++)
+    {
+      /* The buffers are only accessed with our lock held, so they can
+       * be lock-free and need no wait time stats of their own.  They
+       * are anonymous so that they don't clash with the names of other
+       * FIFOs, and our -stats reports on them.
+       */
+      fifos[level] = [[GSFIFO alloc] initWithCapacity: c
+					  granularity: 0
+					      timeout: 0
+					multiProducer: NO
+					multiConsumer: NO
+					   boundaries: none
+						 name: nil];
+    }
+  return self;
+}
+
+- (id) initWithName: (NSString*)n
+{
+  NSUserDefaults	*defs = [NSUserDefaults standardUserDefaults];
+  NSString		*key;
+  NSInteger		k;
+  NSInteger		c;
+  NSInteger		t;
+  NSArray		*w;
+
+  key = [NSString stringWithFormat: @"GSPriorityFIFOLevels%@", n];
+  if (nil == [defs objectForKey: key]) key = @"GSPriorityFIFOLevels";
+  k = [defs integerForKey: key];
+  if (k <= 0)
+    {
+      k = 2;
+    }
+  key = [NSString stringWithFormat: @"GSPriorityFIFOCapacity%@", n];
+  if (nil == [defs objectForKey: key]) key = @"GSPriorityFIFOCapacity";
+  c = [defs integerForKey: key];
+  if (c <= 0)
+    {
+      c = 1000;
+    }
+  key = [NSString stringWithFormat: @"GSPriorityFIFOWeights%@", n];
+  if (nil == [defs objectForKey: key]) key = @"GSPriorityFIFOWeights";
+  w = [defs arrayForKey: key];
+  key = [NSString stringWithFormat: @"GSPriorityFIFOTimeout%@", n];
+  if (nil == [defs objectForKey: key]) key = @"GSPriorityFIFOTimeout";
+  t = [defs integerForKey: key];
+
+  return [self initWithLevels: (uint32_t)k
+		     capacity: (uint32_t)c
+		      weights: w
+		      timeout: (uint16_t)t
+			 name: n];
+}
+
+- (uint32_t) levels
+{
+  return levels;
+}
+
+- (BOOL) _put: (void*)item priority: (uint32_t)level shouldBlock: (BOOL)block
+{
+  GSFIFO	*f;
+  uint64_t	depth;
+
+  if (level >= levels)
+    {
+      [NSException raise: NSInvalidArgumentException
+		  format: @"[%@-%@] priority %"PRIu32" out of range for %@",
+	NSStringFromClass([self class]), NSStringFromSelector(_cmd),
+	level, name];
+    }
+  f = fifos[level];
+
+  [condition lock];
+  if (f->_head - f->_tail == f->_capacity)
+    {
+      fullCounts[level]++;
+      if (NO == block)
+	{
+	  [condition unlock];
+	  return NO;
+	}
+      if (0 == timeout)
+	{
+	  while (f->_head - f->_tail == f->_capacity)
+	    {
+	      [condition wait];
+	    }
+	}
+      else
+	{
+	  NSDate	*d;
+
+	  d = [[NSDate alloc] initWithTimeIntervalSinceNow: timeout / 1000.0f];
+	  while (f->_head - f->_tail == f->_capacity)
+	    {
+	      if (NO == [condition waitUntilDate: d])
+		{
+		  [d release];
+		  [condition unlock];
+		  [NSException raise: NSGenericException
+			      format: @"Timeout waiting for space in FIFO"];
+		}
+	    }
+	  [d release];
+	}
+    }
+  GSPutFastNonBlockingFIFO(f, item);
+  if (0 == total++)
+    {
+      [condition broadcast];
+    }
+  putCounts[level]++;
+  depth = f->_head - f->_tail;
+  if (depth > maxCounts[level])
+    {
+      maxCounts[level] = depth;
+    }
+  [condition unlock];
+  return YES;
+}
+
+- (void) put: (void*)item priority: (uint32_t)level
+{
+  [self _put: item priority: level shouldBlock: YES];
+}
+
+- (void) putObject: (NSObject*)item priority: (uint32_t)level
+{
+  [item retain];
+  NS_DURING
+    {
+      [self _put: item priority: level shouldBlock: YES];
+    }
+  NS_HANDLER
+    {
+      /* The item was not added (bad priority or timeout).
+       */
+      [item release];
+      [localException raise];
+    }
+  NS_ENDHANDLER
+}
+
+- (NSString*) stats
+{
+  NSMutableString	*s = [NSMutableString stringWithCapacity: 200];
+  uint32_t		level;
+
+  [condition lock];
+  [s appendFormat: @"%@ (%@) levels:%"PRIu32" policy:%s\n",
+    [super description], name, levels,
+    ((0 == weights) ? "strict" : "weighted")];
+  [s appendFormat: @"  count:%"PRIu64" empty:%"PRIu64"\n",
+    total, emptyCount];
+  for (level = 0; level < levels; level++)
+    {
+      GSFIFO	*f = fifos[level];
+
+      [s appendFormat: @"  %"PRIu32": weight:%"PRIu32" capacity:%"PRIu32
+	@" count:%"PRIu64" peak:%"PRIu64" put:%"PRIu64" get:%"PRIu64
+	@" full:%"PRIu64"\n",
+	level, ((0 == weights) ? 0 : weights[level]), f->_capacity,
+	(uint64_t)(f->_head - f->_tail), maxCounts[level],
+	putCounts[level], getCounts[level], fullCounts[level]];
+    }
+  [condition unlock];
+  return s;
+}
+
+- (void*) tryGet
+{
+  void	*item = 0;
+
+  [self get: &item priorities: 0 count: 1 shouldBlock: NO before: nil];
+  return item;
+}
+
+- (BOOL) tryPut: (void*)item priority: (uint32_t)level
+{
+  return [self _put: item priority: level shouldBlock: NO];
+}
+
+- (BOOL) weighted
+{
+  return (0 == weights) ? NO : YES;
+}
+@end
@@ -23,11 +23,242 @@
    Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111 USA.
    */
 #import <Foundation/NSObject.h>
+#import "GSLinkedList.h"
 
-@class	GSLinkedList;
+@class	GSThreadPool;
+@class	GSThreadPoolCancelToken;
+@class	NSIndexSet;
+@class	NSMapTable;
+
+/** Policies for placing the threads of a GSThreadPool or GSIOThreadPool
+ * on CPUs.<br />
+ * GSThreadPlacementNone lets the operating system schedule threads on
+ * any CPU (the default).<br />
+ * GSThreadPlacementPinned restricts every thread to the set of CPUs
+ * given.<br />
+ * GSThreadPlacementSpread binds each new thread to a single CPU from the
+ * set given, taking the CPUs in turn.<br />
+ * GSThreadPlacementNode binds each new thread to the CPUs of a single
+ * NUMA node, and places work on the node of the thread submitting it.
+ * <br />
+ * Placement is only supported on Linux, and is ignored elsewhere.
+ */
+typedef enum {
+  GSThreadPlacementNone = 0,
+  GSThreadPlacementPinned,
+  GSThreadPlacementSpread,
+  GSThreadPlacementNode
+} GSThreadPlacement;
+
+/** Returns the number of NUMA nodes in the system (one if the system is
+ * not NUMA or the information is not available).
+ */
+extern NSUInteger	GSThreadPoolNodeCount();
+
+/** Returns the set of CPUs belonging to the specified NUMA node, or nil
+ * if there is no such node.
+ */
+extern NSIndexSet	*GSThreadPoolNodeCPUs(NSUInteger node);
+
+/** Returns the NUMA node of the CPU the current thread is running on
+ * (zero if this is not known).
+ */
+extern NSUInteger	GSThreadPoolCurrentNode();
+
+/** Applies a placement policy to the current thread, which is the
+ * index'th thread to be placed using the policy and CPU set (used to
+ * choose the CPU or node for the GSThreadPlacementSpread and
+ * GSThreadPlacementNode policies).  A nil CPU set means all CPUs.<br />
+ * Returns YES on success, NO if the placement could not be applied.
+ */
+extern BOOL	GSThreadPoolPlaceCurrentThread(GSThreadPlacement placement,
+  NSIndexSet *cpus, NSUInteger index);
+
+/** Keys for the dictionaries of statistics returned by the
+ * [GSThreadPool-operationStatistics] method.<br />
+ * GSThreadPoolCountKey is the number of operations completed.<br />
+ * GSThreadPoolWaitTotalKey and GSThreadPoolWaitMaximumKey are the total
+ * and maximum time (in seconds) for which operations waited in the queue.
+ * <br />
+ * GSThreadPoolRunTotalKey and GSThreadPoolRunMaximumKey are the total
+ * and maximum time (in seconds) taken to perform operations.<br />
+ * GSThreadPoolWaitHistogramKey and GSThreadPoolRunHistogramKey are arrays
+ * of counts of operations by wait/run time, where the count at index
+ * zero is for times of less than a microsecond and the count at each
+ * following index N is for times from 2^(N-1) up to 2^N microseconds
+ * (the last count also includes all longer times).
+ */
+extern NSString * const GSThreadPoolCountKey;
+extern NSString * const GSThreadPoolRunHistogramKey;
+extern NSString * const GSThreadPoolRunMaximumKey;
+extern NSString * const GSThreadPoolRunTotalKey;
+extern NSString * const GSThreadPoolWaitHistogramKey;
+extern NSString * const GSThreadPoolWaitMaximumKey;
+extern NSString * const GSThreadPoolWaitTotalKey;
+@class	NSArray;
+@class	NSCondition;
 @class	NSDate;
+@class	NSException;
+@class	NSMutableArray;
+@class	NSMutableDictionary;
 @class	NSRecursiveLock;
 
+/** Describes a single operation for batch scheduling using the
+ * -scheduleSelectors:count: method.
+ */
+typedef struct {
+  SEL		selector;
+  NSObject	*receiver;
+  NSObject	*argument;
+} GSThreadPoolTask;
+
+#if	defined(__BLOCKS__)
+/** The type of block which may be scheduled to run in a pool thread.
+ */
+typedef void (^GSThreadPoolBlock)(void);
+
+/** The type of block which may be submitted to run in a pool thread
+ * producing a result for a future.
+ */
+typedef id (^GSThreadPoolResultBlock)(void);
+#endif
+
+/** A GSThreadPoolFuture is a handle for an operation submitted to a
+ * GSThreadPool using the -submitSelector:onReceiver:withObject: or
+ * -submitBlock: methods.  It allows any number of threads to wait for
+ * completion of the operation and to collect its result (or the
+ * exception it raised), and allows continuations to be performed when
+ * the operation completes.
+ */
+@interface	GSThreadPoolFuture : NSObject
+{
+@private
+  NSCondition		*condition;
+  id			result;
+  NSException		*exception;
+  NSMutableArray	*continuations;
+  BOOL			done;
+  BOOL			returnsObject;
+}
+
+/** Returns the exception raised by the operation, or nil if the operation
+ * has not completed or completed without raising an exception.<br />
+ * An operation which is removed from the pool by -flush (or by the pool
+ * being deallocated) completes with an exception.
+ */
+- (NSException*) exception;
+
+/** Returns YES if the operation has completed, NO otherwise.
+ */
+- (BOOL) isDone;
+
+#if	defined(__BLOCKS__)
+/** Arranges for the block to be called with the receiver as its argument
+ * when the operation completes.  The block is called in the thread which
+ * completed the operation, or immediately (in the current thread) if the
+ * operation has already completed.
+ */
+- (void) onCompletion: (void (^)(GSThreadPoolFuture*))aBlock;
+#endif
+
+/** Arranges for the selector to be performed on the target (with the
+ * receiver as its argument) when the operation completes.  The method is
+ * performed in the thread which completed the operation, or immediately
+ * (in the current thread) if the operation has already completed.<br />
+ * The target is retained until the method has been performed.
+ */
+- (void) onCompletionPerform: (SEL)aSelector target: (NSObject*)aTarget;
+
+/** Returns the result of the operation, or nil if the operation has
+ * not completed, raised an exception, or does not return an object.
+ */
+- (id) result;
+
+/** Waits until the operation has completed and returns its result.
+ */
+- (id) wait;
+
+/** Waits until the operation has completed or the specified date is
+ * reached.  Returns YES if the operation has completed, NO otherwise.
+ */
+- (BOOL) waitUntil: (NSDate*)date;
+@end
+
+/** A GSThreadPoolCancelToken is used to cancel a group of operations
+ * (eg all the work being done for a client which has disconnected).
+ * The token is passed to the scheduling methods which accept one, and
+ * when it is cancelled, any of its operations which have not yet started
+ * are removed from the queues of their pools without being performed
+ * (their futures, if any, are completed with an exception), freeing
+ * their places in the queues immediately.<br />
+ * Operations which are already running are not interrupted, but may
+ * check -isCancelled (a cheap call) to stop early, obtaining the token
+ * of the running operation using +currentToken if necessary.
+ */
+@interface	GSThreadPoolCancelToken : NSObject
+{
+  @private
+  NSLock		*lock;
+  NSMutableArray	*pools;		// Pools which may hold operations
+  volatile BOOL		cancelled;
+}
+
+/** Returns the token of the operation being performed by the current
+ * thread, or nil if the current thread is not performing a pool operation
+ * or the operation was scheduled without a token.
+ */
++ (GSThreadPoolCancelToken*) currentToken;
+
+/** Cancels the receiver, removing its operations which have not yet
+ * started from their pools.  Operations scheduled with the receiver
+ * after it has been cancelled are never performed.
+ */
+- (void) cancel;
+
+/** Returns YES if the receiver has been cancelled, NO otherwise.
+ */
+- (BOOL) isCancelled;
+@end
+
+/** A GSThreadPoolTimer is a handle for an operation scheduled to be
+ * performed by a GSThreadPool after a delay or at regular intervals,
+ * using the -scheduleSelector:onReceiver:withObject:after: or
+ * -scheduleSelector:onReceiver:withObject:every: methods.<br />
+ * The timers of all pools are held in a single hierarchical timing wheel
+ * (with a resolution of one millisecond) serviced by one internal thread,
+ * so adding and cancelling a timer are constant time operations and
+ * very large numbers of timers may be pending at once.  When a timer
+ * fires, its operation is added to the queue of its pool (regardless of
+ * the limit set by -setOperations:) to be performed by a pool thread.
+ */
+@interface	GSThreadPoolTimer : GSListLink
+{
+  @public	// For internal use only
+  GSThreadPool		*pool;
+  SEL			sel;
+  NSObject		*arg;
+  uint64_t		expires;	// Milliseconds
+  uint64_t		interval;	// Milliseconds (zero if not repeating)
+  BOOL			cancelled;
+  BOOL			fired;
+}
+
+/** Cancels the timer so that its operation will not be added to the
+ * pool again.  Cancelling a timer at the moment it fires may not stop
+ * that firing, but will stop any repeats.
+ */
+- (void) cancel;
+
+/** Returns the repeat interval of the timer, or zero if it does not repeat.
+ */
+- (NSTimeInterval) interval;
+
+/** Returns YES if the timer may still fire, NO if it has been cancelled
+ * or has fired and does not repeat.
+ */
+- (BOOL) isValid;
+@end
+
 /** This class provides a thread pool for performing methods
  * of objects in parallel in other threads.<br />
  * This is similar to the NSOperationQueue class but is a
@@ -46,9 +277,35 @@
   GSLinkedList		*idle;
   GSLinkedList		*live;
   NSUInteger		maxOperations;
-  GSLinkedList		*operations;
+  GSLinkedList		**lanes;	// Queues by priority
+  NSUInteger		laneCount;
+  NSUInteger		queued;		// Operations in all lanes
+  NSUInteger		*weights;	// Weights (or NULL if strict)
+  NSUInteger		*credits;	// Operations left in round robin turn
+  NSUInteger		*reserve;	// Threads reserved for higher lanes
+  NSUInteger		currentLane;	// Round robin position
+  GSLinkedList		*barriers;
+  uint64_t		sequence;
   GSLinkedList		*unused;
   NSUInteger		processed;
+  BOOL			workStealing;
+  volatile NSUInteger	localCount;	// Operations in worker deques
+  NSUInteger		stolen;
+  NSCondition		*drainCondition;
+  BOOL			barrierRunning;
+  NSUInteger		minThreads;
+  NSTimeInterval	idleTimeout;	// Zero means never reap
+  NSUInteger		growDepth;
+  NSTimeInterval	growDelay;
+  NSUInteger		reaped;
+  NSMutableDictionary	*serialQueues;	// Waiting operations by key
+  NSUInteger		serialCount;	// Total waiting for their keys
+  BOOL			timing;		// Collect operation statistics
+  NSLock		*statsLock;
+  NSMapTable		*stats;		// Statistics by class and selector
+  GSThreadPlacement	placement;
+  NSIndexSet		*placementCPUs;
+  NSArray		*nodePools;	// Sub-pools for NUMA nodes
 }
 
 /** Returns an instance intended for sharing between sections of code which
@@ -59,8 +316,39 @@
  */
 + (GSThreadPool*) sharedPool;
 
+#if	defined(__BLOCKS__)
+/** Calls the block count times, with index arguments from zero to
+ * count-1, spreading the work between the calling thread and the
+ * threads of the pool, and returns when all the calls have completed.
+ * <br />
+ * The range of indices is split into chunks which are claimed in turn by
+ * the participating threads, so the work is balanced even if the cost
+ * of each call varies.  The calling thread always takes part, and up to
+ * -maxThreads threads from the pool help it.<br />
+ * If any call raises an exception, the rest of the chunk in which it was
+ * raised is skipped and, once all other chunks have completed, the first
+ * such exception is raised again in the calling thread.
+ */
+- (void) applyCount: (NSUInteger)count block: (void (^)(NSUInteger))aBlock;
+#endif
+
+/** As for -applyCount:block: but performs aSelector on aReceiver with
+ * each index.  The method must take a single NSUInteger argument and
+ * return nothing.
+ */
+- (void) applyCount: (NSUInteger)count
+	   selector: (SEL)aSelector
+	 onReceiver: (NSObject*)aReceiver;
+
+/** Returns YES if the pool is collecting statistics about the times
+ * that operations wait in the queue and take to run, NO otherwise.
+ */
+- (BOOL) collectsStatistics;
+
 /** Waits until the pool of operations is empty (and idle) or until the
  * specified timestamp.  Returns YES if the pool was emptied, NO otherwise.
+ * <br />
+ * The waiting thread is woken as soon as the last operation completes.
  */
 - (BOOL) drain: (NSDate*)before;
 
@@ -81,19 +369,50 @@
  */
 - (BOOL) isIdle;
 
+/** Returns the statistics collected while -collectsStatistics is YES.
+ * The result is a dictionary keyed by strings of the form
+ * '-[Class selector]' (the receiver class and the selector of the
+ * operations, with blocks appearing as '-[Class (block)]'), whose values
+ * are dictionaries containing the statistics for those operations, as
+ * described for GSThreadPoolCountKey.<br />
+ * Operations performed immediately in the scheduling thread (rather than
+ * being queued) are not included.
+ */
+- (NSDictionary*) operationStatistics;
+
 /** Returns YES if startup of new operations is suspended, NO otherwise.
  */
 - (BOOL) isSuspended;
 
+/** Returns the placement policy for threads of the pool.
+ */
+- (GSThreadPlacement) placement;
+
 /** Returns the currently configured maximum number of operations which
  * may be scheduled at any one time.
  */
 - (NSUInteger) maxOperations;
 
 /** Returns the currently configured maximum number of threads in the pool.
+ * <br />
+ * With the GSThreadPlacementNode policy the node sub-pools have threads
+ * in addition to these (see -setPlacement:cpus:).
  */
 - (NSUInteger) maxThreads;
 
+/** Returns the number of seconds an idle thread waits for work before
+ * terminating (zero if idle threads are never reaped).
+ */
+- (NSTimeInterval) idleTimeout;
+
+/** Returns the currently configured minimum number of threads in the pool.
+ */
+- (NSUInteger) minThreads;
+
+/** Returns the number of priority levels for operations in the pool.
+ */
+- (NSUInteger) priorityLevels;
+
 /** Returns the name of the pool as set using the -setPoolName: method.
  */
 - (NSString*) poolName;
@@ -115,6 +434,243 @@
                onReceiver: (NSObject*)aReceiver
 	       withObject: (NSObject*)anArgument;
 
+#if	defined(__BLOCKS__)
+/** Adds a barrier block to the queue of operations.  This is like
+ * -scheduleBarrierSelector:onReceiver:withObject: but using a block.
+ */
+- (void) scheduleBarrierBlock: (GSThreadPoolBlock)aBlock;
+#endif
+
+/** Adds a barrier operation to the queue of operations to be performed.
+ * <br />
+ * A barrier is not started until all the operations scheduled before it
+ * (including those already in progress) have completed, and while it is
+ * in progress no other operation is started, so operations scheduled
+ * after it do not start until it has completed.<br />
+ * A barrier is always queued (even if the queue is full) unless the
+ * pool is configured with zero threads, in which case it is performed
+ * immediately.<br />
+ * NB. In work-stealing mode, operations added to a thread's deque by
+ * operations running before the barrier also complete before it.<br />
+ * Raises an NSInternalInconsistencyException if the pool uses the
+ * GSThreadPlacementNode policy with sub-pools (see -setPlacement:cpus:).
+ */
+- (void) scheduleBarrierSelector: (SEL)aSelector
+		      onReceiver: (NSObject*)aReceiver
+		      withObject: (NSObject*)anArgument;
+
+#if	defined(__BLOCKS__)
+/** Adds a block to the queue of operations to be performed.<br />
+ * The block is copied and then behaves exactly like an operation
+ * scheduled using -scheduleSelector:onReceiver:withObject: (so if the
+ * queue is full it is simply run immediately).
+ */
+- (void) scheduleBlock: (GSThreadPoolBlock)aBlock;
+
+/** Adds a block to the queue of operations to be performed at the
+ * specified priority level (see -setPriorityLevels:weights:reserved:).
+ */
+- (void) scheduleBlock: (GSThreadPoolBlock)aBlock
+	      priority: (NSUInteger)level;
+
+/** Adds a block to the queue of operations to be performed, as for the
+ * -scheduleBlock: method, but the block is not performed if the token is
+ * cancelled before the block starts.
+ */
+- (void) scheduleBlock: (GSThreadPoolBlock)aBlock
+		 token: (GSThreadPoolCancelToken*)aToken;
+
+/** Adds all the blocks in the array to the queue of operations to be
+ * performed, taking the pool lock once and waking as many idle threads
+ * as are needed in one go.<br />
+ * Any blocks which do not fit in the queue are run immediately.
+ */
+- (void) scheduleBlocks: (NSArray*)blocks;
+#endif
+
+/** Adds the object to the queue for which operations should be performed,
+ * at the specified priority level (see -setPriorityLevels:weights:reserved:)
+ * rather than at the default (least urgent) level.<br />
+ * Raises an exception if the level is not less than -priorityLevels.
+ */
+- (void) scheduleSelector: (SEL)aSelector
+               onReceiver: (NSObject*)aReceiver
+	       withObject: (NSObject*)anArgument
+		 priority: (NSUInteger)level;
+
+/** Adds the object to the queue for which operations should be performed,
+ * ensuring that operations scheduled with the same serial key (compared
+ * using -isEqual:) are performed one at a time in the order in which
+ * they were scheduled, while those with different keys may be performed
+ * concurrently.<br />
+ * An operation whose key is in use waits in a queue for that key (so no
+ * thread is blocked waiting for it) and is moved to the main queue
+ * when the previous operation for the key completes.<br />
+ * Keyed operations are always queued (the limit set by -setOperations:
+ * does not apply) unless the pool has no threads, in which case they
+ * are performed immediately.<br />
+ * If aKey is nil this is equivalent to
+ * -scheduleSelector:onReceiver:withObject:
+ */
+- (void) scheduleSelector: (SEL)aSelector
+               onReceiver: (NSObject*)aReceiver
+	       withObject: (NSObject*)anArgument
+		serialKey: (id<NSCopying>)aKey;
+
+/** Arranges for the operation to be added to the queue of operations to
+ * be performed after the specified delay (in seconds).<br />
+ * Returns a timer which may be used to cancel the operation.
+ */
+- (GSThreadPoolTimer*) scheduleSelector: (SEL)aSelector
+			     onReceiver: (NSObject*)aReceiver
+			     withObject: (NSObject*)anArgument
+				  after: (NSTimeInterval)delay;
+
+/** Arranges for the operation to be added to the queue of operations to
+ * be performed repeatedly, at the specified interval (in seconds, with
+ * the first time being after one interval).  If the timer thread falls
+ * behind, missed repeats are skipped rather than added all at once.<br />
+ * Returns a timer which must be used to cancel the repeats.
+ */
+- (GSThreadPoolTimer*) scheduleSelector: (SEL)aSelector
+			     onReceiver: (NSObject*)aReceiver
+			     withObject: (NSObject*)anArgument
+				  every: (NSTimeInterval)interval;
+
+/** Adds the operation to the queue of operations to be performed, as for
+ * the -scheduleSelector:onReceiver:withObject: method, but the operation
+ * is not performed if the token is cancelled before it starts.
+ */
+- (void) scheduleSelector: (SEL)aSelector
+               onReceiver: (NSObject*)aReceiver
+	       withObject: (NSObject*)anArgument
+		    token: (GSThreadPoolCancelToken*)aToken;
+
+/** Adds count operations from the tasks array to the queue of operations
+ * to be performed.  This is equivalent to repeated calls to
+ * -scheduleSelector:onReceiver:withObject: but takes the pool lock once
+ * and wakes as many idle threads as are needed in one go, so it is much
+ * cheaper when scheduling large numbers of small operations.<br />
+ * Any operations which do not fit in the queue are performed immediately.
+ * <br />
+ * Raises an exception (before scheduling anything) if any task has a
+ * null selector or nil receiver.
+ */
+- (void) scheduleSelectors: (GSThreadPoolTask*)tasks count: (NSUInteger)count;
+
+#if	defined(__BLOCKS__)
+/** Adds a block to the queue of operations to be performed as for the
+ * -scheduleBlock: method, but returns a future which may be used to wait
+ * for completion and obtain the object returned by the block.
+ */
+- (GSThreadPoolFuture*) submitBlock: (GSThreadPoolResultBlock)aBlock;
+#endif
+
+/** Schedules an operation exactly as for the
+ * -scheduleSelector:onReceiver:withObject: method, but returns a future
+ * which may be used to wait for completion of the operation and to obtain
+ * its result (if the method returns an object) or the exception it raised
+ * (such exceptions are not logged).
+ */
+- (GSThreadPoolFuture*) submitSelector: (SEL)aSelector
+			    onReceiver: (NSObject*)aReceiver
+			    withObject: (NSObject*)anArgument;
+
+/** Schedules an operation as for the
+ * -scheduleSelector:onReceiver:withObject:token: method, but returns a
+ * future as for the -submitSelector:onReceiver:withObject: method.
+ * If the token is cancelled before the operation starts, the future
+ * is completed with an exception.
+ */
+- (GSThreadPoolFuture*) submitSelector: (SEL)aSelector
+			    onReceiver: (NSObject*)aReceiver
+			    withObject: (NSObject*)anArgument
+				 token: (GSThreadPoolCancelToken*)aToken;
+
+/** Turns on or off the collection of statistics about operations.
+ * While this is on, each operation added to the queue records the times
+ * at which it was queued, started and finished (using a monotonic clock),
+ * and the wait and run times are accumulated by receiver class and
+ * selector for -operationStatistics and -updateThroughput.<br />
+ * Turning collection on discards any previously collected statistics.
+ */
+- (void) setCollectsStatistics: (BOOL)flag;
+
+/** Sets the conditions under which the pool creates a new thread (up
+ * to -maxThreads) when there is work queued and no idle thread, once it
+ * already has -minThreads threads.<br />
+ * If depth is non-zero, a thread is created when more than depth
+ * operations are waiting.  If delay is non-zero, a thread is created when
+ * the oldest waiting operation has waited for at least delay seconds.
+ * These conditions are checked whenever an operation is scheduled or
+ * completes.<br />
+ * The default (both zero) is to create a thread whenever one is needed.
+ */
+- (void) setGrowthQueueDepth: (NSUInteger)depth delay: (NSTimeInterval)delay;
+
+/** Sets the time for which an idle thread waits for work before it
+ * terminates (as long as the pool has more than -minThreads threads).
+ * <br />
+ * Default is zero, meaning that idle threads are never terminated.
+ */
+- (void) setIdleTimeout: (NSTimeInterval)seconds;
+
+/** Specify the minimum number of threads in the pool.  Threads are still
+ * created on demand, but once created they are not terminated after the
+ * -idleTimeout if that would leave fewer than this number.<br />
+ * Default is zero.
+ */
+- (void) setMinThreads: (NSUInteger)min;
+
+/** Configures count priority levels, each with its own queue of
+ * operations.  Level zero is the most urgent, and operations scheduled
+ * without an explicit priority use the least urgent level.<br />
+ * If w is nil, operations are started in strict priority order (an
+ * operation is only started if no more urgent operation is waiting),
+ * otherwise it must be an array of count positive integers giving the
+ * number of operations to be started from each level in each round of
+ * weighted round robin selection.<br />
+ * If r is not nil, it must be an array of count non-negative integers
+ * giving the number of threads reserved for each level: an operation
+ * is not started if that would leave fewer idle (or not yet created)
+ * threads than the total reserved for more urgent levels.<br />
+ * The maximum number of waiting operations (see -setOperations:) applies
+ * to the total for all levels.<br />
+ * Raises an exception if operations are waiting.  The default is a
+ * single level.
+ */
+- (void) setPriorityLevels: (NSUInteger)count
+		   weights: (NSArray*)w
+		  reserved: (NSArray*)r;
+
+/** Sets the policy for placing the threads of the pool on CPUs, with
+ * cpus being the set of CPUs to be used (nil means all CPUs) for the
+ * GSThreadPlacementPinned and GSThreadPlacementSpread policies.<br />
+ * The policy applies to threads started after this call, so it should
+ * normally be set before any operations are scheduled.<br />
+ * On a system with more than one NUMA node, GSThreadPlacementNode
+ * creates a sub-pool for each node, with its threads pinned to the CPUs
+ * of that node, and divides -maxThreads between them.  The receiver
+ * keeps up to -maxThreads threads of its own as well, so the total may
+ * approach twice -maxThreads (the -info string reports the limit).
+ * Operations scheduled at the lowest priority without a serial key are
+ * then given to the sub-pool for the node of the scheduling thread,
+ * unless that sub-pool is saturated (all its threads are busy and
+ * operations are already waiting, or its queue is full) and another is
+ * less loaded.
+ * Other operations (serial keyed and prioritised operations, timers and
+ * apply calls) continue to use the threads of the receiver, which are
+ * spread across the nodes.<br />
+ * Suspension, work stealing, statistics collection and the limits on
+ * threads and operations are passed on to the sub-pools, and their
+ * statistics are included in -operationStatistics.  Barriers can't order
+ * work given to the sub-pools, so they may not be used with this policy:
+ * setting it raises an NSInternalInconsistencyException while barriers
+ * are queued or running, and scheduling a barrier while it is in effect
+ * raises the same exception.
+ */
+- (void) setPlacement: (GSThreadPlacement)policy cpus: (NSIndexSet*)cpus;
+
 /** Specify the number of operations which may be waiting.<br />
  * Default is 100.<br />
  * Setting a value of zero ensures that operations are performed
@@ -142,6 +698,37 @@
 /** Turns off startup of new operations.
  */
 - (void) suspend;
+
+/** Sets whether the pool uses work-stealing (default is NO).<br />
+ * In work-stealing mode, an operation scheduled from within an operation
+ * already running in one of the pool's threads is added to a private
+ * queue (deque) belonging to that thread rather than to the shared queue,
+ * so it may be scheduled and picked up again without taking the pool lock.
+ * The thread takes work from its own deque most recently added first,
+ * and idle threads steal work from the other end of busy threads' deques.
+ * <br />
+ * Operations scheduled from other threads, or while a barrier is waiting
+ * or running, still go to the shared queue.  No work is taken from the
+ * deques while the pool is suspended.<br />
+ * NB. In this mode the order in which operations are started is not
+ * the order in which they were scheduled.
+ */
+- (void) setWorkStealing: (BOOL)flag;
+
+/** Adds the counts and run times of operations completed since the last
+ * call to GSThroughput instances, allowing the pool statistics to be
+ * reported using that class.  There is one instance for each receiver
+ * class and selector, named with the pool name followed by the key used
+ * for -operationStatistics.<br />
+ * As GSThroughput instances are used by a single thread, the instances
+ * belong to the thread in which this method is first called, and it must
+ * always be called in that thread (eg from a timer once a second).
+ */
+- (void) updateThroughput;
+
+/** Returns YES if the pool is in work-stealing mode, NO otherwise.
+ */
+- (BOOL) workStealing;
 @end
 
 #endif
@@ -1,12 +1,37 @@
+#if	defined(__linux__) && !defined(_GNU_SOURCE)
+#define	_GNU_SOURCE	1	// For CPU affinity
+#endif
 #include <inttypes.h>
+#include <errno.h>
+#include <stdio.h>
+#include <time.h>
+#include <pthread.h>
+#if	defined(__linux__)
+#include <linux/futex.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#else
+#include <sys/time.h>
+#endif
 
 #import "GSLinkedList.h"
 #import "GSThreadPool.h"
+#import "GSThroughput.h"
+#import "GSTicker.h"
+#import <Foundation/NSArray.h>
 #import <Foundation/NSAutoreleasePool.h>
+#import <Foundation/NSData.h>
 #import <Foundation/NSDate.h>
+#import <Foundation/NSDictionary.h>
+#import <Foundation/NSIndexSet.h>
 #import <Foundation/NSLock.h>
+#import <Foundation/NSMapTable.h>
+#import <Foundation/NSMethodSignature.h>
+#import <Foundation/NSProcessInfo.h>
 #import <Foundation/NSThread.h>
 #import <Foundation/NSString.h>
+#import <Foundation/NSValue.h>
 #import <Foundation/NSException.h>
 
 #if !defined (GNUSTEP)
@@ -16,507 +41,3603 @@
 
 @class	GSThreadPool;
 
+/* An operation is either a selector to be performed on the item, or
+ * (if sel is null) a block held as the item.
+ */
 @interface	GSOperation : GSListLink
 {
   @public
-  SEL		sel;
-  NSObject	*arg;
+  SEL			sel;
+  NSObject		*arg;
+  GSThreadPoolFuture	*future;
+  BOOL			barrier;
+  NSTimeInterval	queued;		// When added to the shared queue
+  uint64_t		seq;		// Order in which it was queued
+  NSObject		*key;		// Serial key (if any)
+  uint64_t		enqueued;	// Nanoseconds (zero if not timed)
+  GSThreadPoolCancelToken	*token;	// Cancellation token (if any)
 }
 @end
 @implementation	GSOperation
 - (void) dealloc
 {
   [arg release];
+  [future release];
+  [token release];
+  [key release];
   [super dealloc];
 }
 @end
 
-@interface	GSThreadLink : GSListLink
+@interface	GSThreadPoolFuture (Internal)
+- (id) _initReturningObject: (BOOL)flag;
+- (BOOL) _returnsObject;
+- (void) _setResult: (id)anObject exception: (NSException*)anException;
+@end
+
+/* Holds a selector continuation for a future.
+ */
+@interface	GSFutureCallback : NSObject
 {
   @public
-  GSThreadPool		*pool;	// Not retained
-  NSConditionLock	*lock;
-  GSOperation		*op;
+  NSObject	*target;
+  SEL		sel;
 }
 @end
-
-@implementation	GSThreadLink
+@implementation	GSFutureCallback
 - (void) dealloc
 {
-  [lock release];
+  [target release];
   [super dealloc];
 }
-
-- (id) init
-{
-  if ((self = [super init]) != nil)
-    {
-      lock = [[NSConditionLock alloc] initWithCondition: 0];
-    }
-  return self;
-}
-@end
-
-@interface	GSThreadPool (Internal)
-- (void) _any;
-- (void) _dead: (GSThreadLink*)link;
-- (BOOL) _idle: (GSThreadLink*)link;
-- (BOOL) _more: (GSThreadLink*)link;
-- (void) _run: (GSThreadLink*)link;
 @end
 
+/* Returns a monotonic time in nanoseconds.
+ */
+static inline uint64_t
+monotonicNanoseconds()
+{
+#if	defined(CLOCK_MONOTONIC)
+  struct timespec	ts;
 
-@implementation	GSThreadPool
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#else
+  return (uint64_t)(GSTickerTimeNow() * 1000000000.0);
+#endif
+}
 
-static GSThreadPool	*shared = nil;
+/* Returns a monotonic time in milliseconds.
+ */
+static inline uint64_t
+monotonicMilliseconds()
+{
+  return monotonicNanoseconds() / 1000000;
+}
 
-+ (void) initialize
+/* Sets up an operation, recording the time it was queued if timed is YES.
+ */
+static inline void
+fill(GSOperation *op, GSThreadPoolTask *task, GSThreadPoolFuture *future,
+  BOOL timed)
 {
-  if ([GSThreadPool class] == self && nil == shared)
-    {
-      shared = [self new];
-    }
+  [op setItem: task->receiver];
+  op->sel = task->selector;
+  op->arg = [task->argument retain];
+  op->future = [future retain];
+  op->enqueued = (YES == timed) ? monotonicNanoseconds() : 0;
 }
 
-+ (GSThreadPool*) sharedPool
+/* Statistics for the operations with a particular receiver class and
+ * selector.  The class and selector are the key in the map table, so
+ * they must be the first fields.  Times are in nanoseconds and the
+ * histograms count times by powers of two of microseconds.
+ */
+#define	STATS_BUCKETS	32
+
+typedef struct {
+  Class		cls;
+  SEL		sel;
+  uint64_t	count;
+  uint64_t	waitTotal;
+  uint64_t	waitMax;
+  uint64_t	runTotal;
+  uint64_t	runMax;
+  uint64_t	fedCount;	// Count added to GSThroughput
+  uint64_t	fedRun;		// Run time added to GSThroughput
+  uint64_t	fedWait;	// Wait time added to GSThroughput
+  uint32_t	wait[STATS_BUCKETS];
+  uint32_t	run[STATS_BUCKETS];
+} GSOperationStats;
+
+static NSUInteger
+statsHash(NSMapTable *t, const void *k)
 {
-  return shared;
+  /* Selectors may not be unique pointers, so only the class is hashed.
+   */
+  return (NSUInteger)(uintptr_t)((GSOperationStats*)k)->cls >> 4;
 }
 
-- (void) dealloc
+static BOOL
+statsEqual(NSMapTable *t, const void *a, const void *b)
 {
-  GSThreadLink	*link;
+  const GSOperationStats	*s1 = (const GSOperationStats*)a;
+  const GSOperationStats	*s2 = (const GSOperationStats*)b;
 
-  if (self == shared)
+  if (s1->cls != s2->cls)
     {
-      [self retain];
-      [NSException raise: NSInternalInconsistencyException
-	format: @"[GSThreadPool-dealloc] attempt to deallocate shared pool"];
+      return NO;
     }
-  [poolLock lock];
-  [operations release];
-  operations = nil;
-  [unused release];
-  unused = nil;
-  if (nil != idle)
+  if (s1->sel == s2->sel)
     {
-      while (nil != (link = (GSThreadLink*)idle->head))
-	{
-	  GSLinkedListRemove(link, idle);
-	  [link->lock lock];
-	  [link->lock unlockWithCondition: 1];
-	}
-      [idle release];
-      idle = nil;
+      return YES;
     }
-  if (nil != live)
+  if (0 == s1->sel || 0 == s2->sel)
     {
-      while (nil != (link = (GSThreadLink*)live->head))
-	{
-	  GSLinkedListRemove(link, live);
-	  link->pool = nil;
-	}
-      [live release];
-      live = nil;
+      return NO;
     }
-  [poolName release];
-  [poolLock unlock];
-  [poolLock release];
-  [super dealloc];
+  return sel_isEqual(s1->sel, s2->sel) ? YES : NO;
 }
 
-- (NSString*) description
-{
-  NSString	*result = [self info];
-
-  [poolLock lock];
-  result = [NSString stringWithFormat: @"%@ %@ %@",
-    [super description], poolName, result];
-  [poolLock unlock];
-  return result;
-}
+static const NSMapTableKeyCallBacks statsKeyCallBacks = {
+  statsHash,
+  statsEqual,
+  NULL,
+  NULL,
+  NULL,
+  NSNotAPointerMapKey
+};
 
-- (BOOL) drain: (NSDate*)before
+/* Returns the histogram bucket for a time in nanoseconds.
+ */
+static inline unsigned
+bucket(uint64_t ns)
 {
-  BOOL	result = ([self isEmpty] && [self isIdle]) ? YES : NO;
+  uint64_t	us = ns / 1000;
+  unsigned	b;
 
-  while (NO == result && [before timeIntervalSinceNow] > 0.0)
+  if (0 == us)
     {
-#if !defined (GNUSTEP) && (MAC_OS_X_VERSION_MAX_ALLOWED<=MAC_OS_X_VERSION_10_4)
-      NSDate	*when;
-
-      when = [[NSDate alloc] initWithTimeIntervalSinceNow: 0.1];
-      [NSThread sleepUntilDate: when];
-      [when release];
-#else
-      [NSThread sleepForTimeInterval: 0.1];
-#endif
-      result = ([self isEmpty] && [self isIdle]) ? YES : NO;
+      return 0;
     }
-  return result;
+  b = 64 - __builtin_clzll(us);
+  return (b < STATS_BUCKETS) ? b : STATS_BUCKETS - 1;
 }
 
-- (NSUInteger) flush
-{
-  NSUInteger	counter;
-
-  [poolLock lock];
-  counter = operations->count;
-  [operations empty];
-  [poolLock unlock];
-  return counter;
-}
+NSString * const GSThreadPoolCountKey = @"Count";
+NSString * const GSThreadPoolRunHistogramKey = @"RunHistogram";
+NSString * const GSThreadPoolRunMaximumKey = @"RunMaximum";
+NSString * const GSThreadPoolRunTotalKey = @"RunTotal";
+NSString * const GSThreadPoolWaitHistogramKey = @"WaitHistogram";
+NSString * const GSThreadPoolWaitMaximumKey = @"WaitMaximum";
+NSString * const GSThreadPoolWaitTotalKey = @"WaitTotal";
 
-- (id) init
+/* Returns the key used to report statistics for a class and selector.
+ */
+static NSString *
+statsName(GSOperationStats *st)
 {
-  if ((self = [super init]) != nil)
-    {
-      poolLock = [NSRecursiveLock new];
-      poolName = @"GSThreadPool";
-      idle = [GSLinkedList new];
-      live = [GSLinkedList new];
-      operations = [GSLinkedList new];
-      unused = [GSLinkedList new];
-      [self setOperations: 100];
-      [self setThreads: 2];
-    }
-  return self;
+  return [NSString stringWithFormat: @"-[%@ %@]",
+    NSStringFromClass(st->cls),
+    (0 == st->sel) ? @"(block)" : NSStringFromSelector(st->sel)];
 }
 
-- (NSString*) info
+/* Adds the statistics in other (as returned by -operationStatistics) to
+ * those in d, so that the figures for a pool include its sub-pools.
+ */
+static void
+statsMerge(NSMutableDictionary *d, NSDictionary *other)
 {
-  NSString	*result;
-
-  [poolLock lock];
-  result = [NSString stringWithFormat:
-    @"queue: %"PRIuPTR"(%"PRIuPTR")"
-    @" threads: %"PRIuPTR"(%"PRIuPTR")"
-    @" active: %"PRIuPTR" processed: %"PRIuPTR""
-    @" suspended: %s",
-    operations->count, maxOperations,
-    idle->count + live->count, maxThreads, live->count, processed,
-    (suspended ? "yes" : "no")];
-  [poolLock unlock];
-  return result;
-}
+  NSEnumerator	*e = [other keyEnumerator];
+  NSString	*name;
 
-- (BOOL) isEmpty
-{
-  return (0 == operations->count) ? YES : NO;
-}
+  while (nil != (name = [e nextObject]))
+    {
+      NSDictionary	*a = [d objectForKey: name];
+      NSDictionary	*b = [other objectForKey: name];
+      NSMutableArray	*w;
+      NSMutableArray	*r;
+      NSUInteger	i;
 
-- (BOOL) isIdle
-{
-  return (0 == live->count) ? YES : NO;
+      if (nil == a)
+	{
+	  [d setObject: b forKey: name];
+	  continue;
+	}
+      w = [NSMutableArray arrayWithCapacity: STATS_BUCKETS];
+      r = [NSMutableArray arrayWithCapacity: STATS_BUCKETS];
+      for (i = 0; i < STATS_BUCKETS; i++)
+	{
+	  [w addObject: [NSNumber numberWithUnsignedInt:
+	    [[[a objectForKey: GSThreadPoolWaitHistogramKey]
+	      objectAtIndex: i] unsignedIntValue]
+	    + [[[b objectForKey: GSThreadPoolWaitHistogramKey]
+	      objectAtIndex: i] unsignedIntValue]]];
+	  [r addObject: [NSNumber numberWithUnsignedInt:
+	    [[[a objectForKey: GSThreadPoolRunHistogramKey]
+	      objectAtIndex: i] unsignedIntValue]
+	    + [[[b objectForKey: GSThreadPoolRunHistogramKey]
+	      objectAtIndex: i] unsignedIntValue]]];
+	}
+      [d setObject: [NSDictionary dictionaryWithObjectsAndKeys:
+	[NSNumber numberWithUnsignedLongLong:
+	  [[a objectForKey: GSThreadPoolCountKey] unsignedLongLongValue]
+	  + [[b objectForKey: GSThreadPoolCountKey] unsignedLongLongValue]],
+	GSThreadPoolCountKey,
+	[NSNumber numberWithDouble:
+	  [[a objectForKey: GSThreadPoolWaitTotalKey] doubleValue]
+	  + [[b objectForKey: GSThreadPoolWaitTotalKey] doubleValue]],
+	GSThreadPoolWaitTotalKey,
+	[NSNumber numberWithDouble:
+	  MAX([[a objectForKey: GSThreadPoolWaitMaximumKey] doubleValue],
+	  [[b objectForKey: GSThreadPoolWaitMaximumKey] doubleValue])],
+	GSThreadPoolWaitMaximumKey,
+	[NSNumber numberWithDouble:
+	  [[a objectForKey: GSThreadPoolRunTotalKey] doubleValue]
+	  + [[b objectForKey: GSThreadPoolRunTotalKey] doubleValue]],
+	GSThreadPoolRunTotalKey,
+	[NSNumber numberWithDouble:
+	  MAX([[a objectForKey: GSThreadPoolRunMaximumKey] doubleValue],
+	  [[b objectForKey: GSThreadPoolRunMaximumKey] doubleValue])],
+	GSThreadPoolRunMaximumKey,
+	w, GSThreadPoolWaitHistogramKey,
+	r, GSThreadPoolRunHistogramKey,
+	nil]
+	    forKey: name];
+    }
 }
 
-- (BOOL) isSuspended
+/* Releases the contents of an operation so it can be reused.
+ */
+static inline void
+clear(GSOperation *op)
 {
-  return suspended;
+  if (nil != op->arg)
+    {
+      [op->arg release];
+      op->arg = nil;
+    }
+  if (nil != op->future)
+    {
+      [op->future release];
+      op->future = nil;
+    }
+  if (nil != op->key)
+    {
+      [op->key release];
+      op->key = nil;
+    }
+  if (nil != op->token)
+    {
+      [op->token release];
+      op->token = nil;
+    }
+  op->barrier = NO;
+  [op setItem: nil];
 }
 
-- (NSUInteger) maxOperations
+/* Empties a list of operations which will never be performed, adding
+ * their futures (if any) to pending so that the caller can complete them
+ * (using failFutures()) once it has released its locks.
+ */
+static void
+abandon(GSLinkedList *list, NSMutableArray *pending)
 {
-  return maxOperations;
-}
+  GSOperation	*op = (GSOperation*)list->head;
 
-- (NSUInteger) maxThreads
-{
-  return maxThreads;
+  while (nil != op)
+    {
+      if (nil != op->future)
+	{
+	  [pending addObject: op->future];
+	}
+      op = (GSOperation*)op->next;
+    }
+  [list empty];
 }
 
-- (NSString*) poolName
+/* Completes the future (if any) of an operation whose token has been
+ * cancelled.
+ */
+static void
+cancelFuture(GSThreadPoolFuture *future)
 {
-  NSString	*n;
+  if (nil != future)
+    {
+      NSException	*e;
 
-  [poolLock lock];
-  n = RETAIN(poolName);
-  [poolLock unlock];
-  return AUTORELEASE(n);
+      e = [NSException exceptionWithName: NSGenericException
+				  reason: @"Operation cancelled"
+				userInfo: nil];
+      [future _setResult: nil exception: e];
+    }
 }
 
-- (void) resume
+/* Completes each of the futures with an exception giving the reason.
+ * Completing a future runs its continuations, which may schedule more
+ * work, so this must not be called with the pool lock or the lock of a
+ * deque held.
+ */
+static void
+failFutures(NSArray *futures, NSString *reason)
 {
-  [poolLock lock];
-  if (YES == suspended)
+  NSUInteger	count = [futures count];
+
+  if (count > 0)
     {
-      suspended = NO;
-      /* No longer suspended ... start as many operations as we have idle
-       * threads available for.
-       */
-      [self _any];
+      NSException	*e;
+      NSUInteger	i;
+
+      e = [NSException exceptionWithName: NSGenericException
+				  reason: reason
+				userInfo: nil];
+      for (i = 0; i < count; i++)
+	{
+	  [[futures objectAtIndex: i] _setResult: nil exception: e];
+	}
     }
-  [poolLock unlock];
 }
 
-- (void) scheduleSelector: (SEL)aSelector
-               onReceiver: (NSObject*)aReceiver
-	       withObject: (NSObject*)anArgument
+/* Performs an operation in the current thread, trapping any exception.
+ * If there is a future, the result or exception is stored in it,
+ * otherwise any exception is logged.
+ */
+static void
+perform(NSObject *item, SEL sel, NSObject *arg, GSThreadPoolFuture *future)
 {
-  if (0 == aSelector)
-    {
-      [NSException raise: NSInvalidArgumentException
-		  format: @"Null selector"];
-    }
-  if (nil == aReceiver)
-    {
-      [NSException raise: NSInvalidArgumentException
-		  format: @"Nil receiver"];
-    }
-  [poolLock lock];
-  if (operations->count < maxOperations && maxThreads > 0)
-    {
-      GSOperation	*op = (GSOperation*)unused->head;
+  NSAutoreleasePool	*arp;
+  id			result = nil;
+  NSException		*exception = nil;
 
-      if (nil == op)
+  NS_DURING
+    {
+      arp = [NSAutoreleasePool new];
+      if (0 == sel)
+	{
+#if	defined(__BLOCKS__)
+	  if (nil == future)
+	    {
+	      ((GSThreadPoolBlock)item)();
+	    }
+	  else
+	    {
+	      result = [((GSThreadPoolResultBlock)item)() retain];
+	    }
+#endif
+	}
+      else if (nil != future && YES == [future _returnsObject])
 	{
-	  op = [GSOperation new];		// Need a new one
+	  result = [[item performSelector: sel withObject: arg] retain];
 	}
       else
 	{
-	  GSLinkedListRemove(op, unused);	// Re-use an old one
+	  [item performSelector: sel withObject: arg];
 	}
-      [op setItem: aReceiver];
-      op->sel = aSelector;
-      op->arg = [anArgument retain];
-
-      GSLinkedListInsertAfter(op, operations, operations->tail);
-      [self _any];
-      [poolLock unlock];
+      [arp release];
     }
-  else
+  NS_HANDLER
     {
-      NSAutoreleasePool	*arp;
-
-      [poolLock unlock];
-
-      NS_DURING
-	{
-	  arp = [NSAutoreleasePool new];
-	  [aReceiver performSelector: aSelector withObject: anArgument];
-	  [arp release];
-	}
-      NS_HANDLER
+      result = nil;
+      if (nil == future)
 	{
 	  arp = [NSAutoreleasePool new];
 	  NSLog(@"[%@-%@] %@",
-	    NSStringFromClass([aReceiver class]),
-	    NSStringFromSelector(aSelector),
+	    NSStringFromClass([item class]),
+	    (0 == sel) ? @"block" : NSStringFromSelector(sel),
 	    localException);
 	  [arp release];
 	}
-      NS_ENDHANDLER
+      else
+	{
+	  exception = [localException retain];
+	}
+    }
+  NS_ENDHANDLER
+  if (nil != future)
+    {
+      [future _setResult: result exception: exception];
+      [result release];
+      [exception release];
     }
 }
 
-- (void) setOperations: (NSUInteger)max
+/* A parker is a binary semaphore used to wake an idle pool thread.
+ * The pool thread spins briefly before sleeping, so work scheduled soon
+ * after a thread becomes idle is picked up without a system call, and
+ * a wakeup only costs a system call if the thread is actually asleep.
+ * On linux we sleep using a futex, elsewhere using a pthread condition.
+ */
+typedef struct {
+  volatile int32_t	state;		// 1 if a wakeup is pending
+  volatile int32_t	waiting;	// 1 if the owner may be asleep
+#if	!defined(__linux__)
+  pthread_mutex_t	mutex;
+  pthread_cond_t	cond;
+#endif
+} GSParker;
+
+/* Number of times a thread checks for a wakeup before sleeping.
+ * Set to zero on a uniprocessor where spinning would only delay the
+ * thread which is going to wake us.
+ */
+static unsigned	parkerSpin = 1000;
+
+#if	defined(__i386__) || defined(__x86_64__)
+#define	PARKER_RELAX()	__asm__ __volatile__ ("pause")
+#else
+#define	PARKER_RELAX()	__sync_synchronize()
+#endif
+
+static void
+parkerInit(GSParker *p)
 {
-  maxOperations = max;
+  p->state = 0;
+  p->waiting = 0;
+#if	!defined(__linux__)
+  pthread_mutex_init(&p->mutex, NULL);
+  pthread_cond_init(&p->cond, NULL);
+#endif
 }
 
-- (void) setPoolName: (NSString*)aName
+static void
+parkerDestroy(GSParker *p)
 {
-  NSString	*s = nil;
+#if	!defined(__linux__)
+  pthread_cond_destroy(&p->cond);
+  pthread_mutex_destroy(&p->mutex);
+#endif
+}
 
-  if (aName)
+/* Makes a wakeup pending and wakes the owner if it is asleep.
+ */
+static void
+parkerPost(GSParker *p)
+{
+#if	defined(__linux__)
+  __sync_lock_test_and_set(&p->state, 1);
+  __sync_synchronize();
+  if (p->waiting)
+    {
+      syscall(SYS_futex, &p->state, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+    }
+#else
+  pthread_mutex_lock(&p->mutex);
+  p->state = 1;
+  if (p->waiting)
+    {
+      pthread_cond_signal(&p->cond);
+    }
+  pthread_mutex_unlock(&p->mutex);
+#endif
+}
+
+/* Waits for (and consumes) a wakeup.  If the timeout is positive, gives
+ * up after that many seconds and returns NO.  Only the owning thread may
+ * wait on a parker.
+ */
+static BOOL
+parkerWait(GSParker *p, NSTimeInterval timeout)
+{
+  unsigned	spin;
+
+  for (spin = 0; spin < parkerSpin; spin++)
+    {
+      if (p->state && __sync_bool_compare_and_swap(&p->state, 1, 0))
+	{
+	  return YES;
+	}
+      PARKER_RELAX();
+    }
+
+#if	defined(__linux__)
+  {
+    struct timespec	ts;
+    struct timespec	end;
+
+    if (timeout > 0.0)
+      {
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	end.tv_sec += (time_t)timeout;
+	end.tv_nsec += (long)((timeout - (time_t)timeout) * 1000000000.0);
+	if (end.tv_nsec >= 1000000000)
+	  {
+	    end.tv_sec++;
+	    end.tv_nsec -= 1000000000;
+	  }
+      }
+    for (;;)
+      {
+	struct timespec	*tsp = NULL;
+
+	p->waiting = 1;
+	__sync_synchronize();
+	if (__sync_bool_compare_and_swap(&p->state, 1, 0))
+	  {
+	    p->waiting = 0;
+	    return YES;
+	  }
+	if (timeout > 0.0)
+	  {
+	    clock_gettime(CLOCK_MONOTONIC, &ts);
+	    ts.tv_sec = end.tv_sec - ts.tv_sec;
+	    ts.tv_nsec = end.tv_nsec - ts.tv_nsec;
+	    if (ts.tv_nsec < 0)
+	      {
+		ts.tv_sec--;
+		ts.tv_nsec += 1000000000;
+	      }
+	    if (ts.tv_sec < 0)
+	      {
+		p->waiting = 0;
+		return __sync_bool_compare_and_swap(&p->state, 1, 0) ? YES : NO;
+	      }
+	    tsp = &ts;
+	  }
+	syscall(SYS_futex, &p->state, FUTEX_WAIT_PRIVATE, 0, tsp, NULL, 0);
+	p->waiting = 0;
+      }
+  }
+#else
+  {
+    struct timespec	end;
+    BOOL		woken = YES;
+
+    if (timeout > 0.0)
+      {
+	struct timeval	tv;
+	double		when;
+
+	gettimeofday(&tv, NULL);
+	when = tv.tv_sec + tv.tv_usec / 1000000.0 + timeout;
+	end.tv_sec = (time_t)when;
+	end.tv_nsec = (long)((when - end.tv_sec) * 1000000000.0);
+      }
+    pthread_mutex_lock(&p->mutex);
+    p->waiting = 1;
+    while (0 == p->state)
+      {
+	if (timeout > 0.0)
+	  {
+	    if (ETIMEDOUT == pthread_cond_timedwait(&p->cond, &p->mutex, &end)
+	      && 0 == p->state)
+	      {
+		woken = NO;
+		break;
+	      }
+	  }
+	else
+	  {
+	    pthread_cond_wait(&p->cond, &p->mutex);
+	  }
+      }
+    p->waiting = 0;
+    if (YES == woken)
+      {
+	p->state = 0;
+      }
+    pthread_mutex_unlock(&p->mutex);
+    return woken;
+  }
+#endif
+}
+
+@interface	GSThreadLink : GSListLink
+{
+  @public
+  GSThreadPool		*pool;	// Not retained
+  GSParker		parker;
+  GSOperation		*op;
+  NSLock		*localLock;	// Protects local
+  GSLinkedList		*local;		// Deque for work-stealing
+  GSLinkedList		*spare;		// Used only by the owning thread
+  NSUInteger		index;		// Order in which thread was created
+}
+@end
+
+@implementation	GSThreadLink
+- (void) dealloc
+{
+  parkerDestroy(&parker);
+  [localLock release];
+  [local release];
+  [spare release];
+  [super dealloc];
+}
+
+- (id) init
+{
+  if ((self = [super init]) != nil)
+    {
+      parkerInit(&parker);
+      localLock = [NSLock new];
+      local = [GSLinkedList new];
+      spare = [GSLinkedList new];
+    }
+  return self;
+}
+@end
+
+/* The link for the pool thread we are running in (if any).
+ */
+static __thread GSThreadLink	*current = nil;
+
+/* Shared state for the threads taking part in an apply operation.
+ * Helper threads retain this, so they may safely start after the work
+ * has all been done and the caller has returned.
+ */
+@interface	GSApplyContext : NSObject
+{
+  @public
+  NSCondition		*condition;
+  NSUInteger		count;		// Number of calls
+  NSUInteger		size;		// Calls per chunk
+  NSUInteger		chunks;		// Number of chunks
+  volatile NSUInteger	next;		// Next chunk to claim
+  volatile NSUInteger	finished;	// Chunks completed
+  NSException		*exception;	// First exception raised
+  NSObject		*receiver;
+  SEL			sel;
+  void			(*imp)(id, SEL, NSUInteger);
+#if	defined(__BLOCKS__)
+  void			(^block)(NSUInteger);
+#endif
+}
+- (void) run: (id)ignored;
+@end
+
+@implementation	GSApplyContext
+- (void) dealloc
+{
+  [condition release];
+  [exception release];
+  [receiver release];
+#if	defined(__BLOCKS__)
+  [block release];
+#endif
+  [super dealloc];
+}
+
+/* Claims and performs chunks until there are none left.
+ */
+- (void) run: (id)ignored
+{
+  NSUInteger	chunk;
+
+  while ((chunk = __sync_fetch_and_add(&next, 1)) < chunks)
+    {
+      NSUInteger	index = chunk * size;
+      NSUInteger	end = index + size;
+      NSAutoreleasePool	*arp;
+
+      if (end > count)
+	{
+	  end = count;
+	}
+      NS_DURING
+	{
+	  arp = [NSAutoreleasePool new];
+#if	defined(__BLOCKS__)
+	  if (nil != block)
+	    {
+	      while (index < end)
+		{
+		  block(index++);
+		}
+	    }
+	  else
+#endif
+	    {
+	      while (index < end)
+		{
+		  (*imp)(receiver, sel, index++);
+		}
+	    }
+	  [arp release];
+	}
+      NS_HANDLER
+	{
+	  [condition lock];
+	  if (nil == exception)
+	    {
+	      exception = [localException retain];
+	    }
+	  [condition unlock];
+	}
+      NS_ENDHANDLER
+      if (__sync_add_and_fetch(&finished, 1) == chunks)
+	{
+	  [condition lock];
+	  [condition broadcast];
+	  [condition unlock];
+	}
+    }
+}
+@end
+
+/* The NUMA topology, read once from sysfs.  The node for each CPU is
+ * held in cpuNode (for CPUs up to cpuLimit).
+ */
+static pthread_once_t	topologyOnce = PTHREAD_ONCE_INIT;
+static NSUInteger	nodeCount = 1;
+static NSIndexSet	**nodeCPUs = 0;
+static uint16_t		*cpuNode = 0;
+static NSUInteger	cpuLimit = 0;
+
+#if	defined(__linux__)
+/* Parses a sysfs CPU list (eg '0-3,8-11') into an index set.
+ */
+static NSIndexSet *
+parseCPUList(const char *path)
+{
+  NSMutableIndexSet	*set;
+  FILE			*f;
+  char			buf[4096];
+  char			*p;
+
+  if (0 == (f = fopen(path, "r")))
+    {
+      return nil;
+    }
+  if (0 == fgets(buf, sizeof(buf), f))
+    {
+      buf[0] = '\0';
+    }
+  fclose(f);
+  set = [NSMutableIndexSet indexSet];
+  p = buf;
+  while (*p >= '0' && *p <= '9')
+    {
+      unsigned long	lo = strtoul(p, &p, 10);
+      unsigned long	hi = lo;
+
+      if ('-' == *p)
+	{
+	  hi = strtoul(p + 1, &p, 10);
+	}
+      if (hi >= lo)
+	{
+	  [set addIndexesInRange: NSMakeRange(lo, hi - lo + 1)];
+	}
+      if (',' == *p)
+	{
+	  p++;
+	}
+    }
+  return set;
+}
+#endif
+
+static void
+topologySetup()
+{
+  NSAutoreleasePool	*arp = [NSAutoreleasePool new];
+  NSMutableArray	*nodes = [NSMutableArray array];
+  NSUInteger		n;
+
+#if	defined(__linux__)
+  for (n = 0; n < 1024; n++)
+    {
+      char		path[128];
+      NSIndexSet	*set;
+
+      snprintf(path, sizeof(path),
+	"/sys/devices/system/node/node%u/cpulist", (unsigned)n);
+      if (nil != (set = parseCPUList(path)) && [set count] > 0)
+	{
+	  [nodes addObject: set];
+	}
+    }
+#endif
+  if ([nodes count] == 0)
+    {
+      NSUInteger	cpus;
+
+      cpus = [[NSProcessInfo processInfo] processorCount];
+      [nodes addObject: [NSIndexSet indexSetWithIndexesInRange:
+	NSMakeRange(0, (cpus > 0) ? cpus : 1)]];
+    }
+  nodeCount = [nodes count];
+  nodeCPUs = (NSIndexSet**)NSZoneCalloc(NSDefaultMallocZone(),
+    nodeCount, sizeof(NSIndexSet*));
+  for (n = 0; n < nodeCount; n++)
+    {
+      NSIndexSet	*set = [nodes objectAtIndex: n];
+
+      nodeCPUs[n] = [set copy];
+      if ([set lastIndex] + 1 > cpuLimit)
+	{
+	  cpuLimit = [set lastIndex] + 1;
+	}
+    }
+  cpuNode = (uint16_t*)NSZoneCalloc(NSDefaultMallocZone(),
+    cpuLimit, sizeof(uint16_t));
+  for (n = 0; n < nodeCount; n++)
+    {
+      NSUInteger	cpu = [nodeCPUs[n] firstIndex];
+
+      while (NSNotFound != cpu)
+	{
+	  cpuNode[cpu] = (uint16_t)n;
+	  cpu = [nodeCPUs[n] indexGreaterThanIndex: cpu];
+	}
+    }
+  [arp release];
+}
+
+NSUInteger
+GSThreadPoolNodeCount()
+{
+  pthread_once(&topologyOnce, topologySetup);
+  return nodeCount;
+}
+
+NSIndexSet *
+GSThreadPoolNodeCPUs(NSUInteger node)
+{
+  pthread_once(&topologyOnce, topologySetup);
+  return (node < nodeCount) ? nodeCPUs[node] : nil;
+}
+
+NSUInteger
+GSThreadPoolCurrentNode()
+{
+#if	defined(__linux__)
+  int	cpu;
+
+  pthread_once(&topologyOnce, topologySetup);
+  if (nodeCount > 1 && (cpu = sched_getcpu()) >= 0
+    && (NSUInteger)cpu < cpuLimit)
+    {
+      return cpuNode[cpu];
+    }
+#endif
+  return 0;
+}
+
+BOOL
+GSThreadPoolPlaceCurrentThread(GSThreadPlacement placement,
+  NSIndexSet *cpus, NSUInteger index)
+{
+#if	defined(__linux__)
+  cpu_set_t	mask;
+  NSIndexSet	*set;
+  NSUInteger	cpu;
+
+  if (GSThreadPlacementNone == placement)
+    {
+      return YES;
+    }
+  pthread_once(&topologyOnce, topologySetup);
+  CPU_ZERO(&mask);
+  if (GSThreadPlacementNode == placement)
+    {
+      set = nodeCPUs[index % nodeCount];
+    }
+  else
+    {
+      set = cpus;
+      if (nil == set)
+	{
+	  set = [NSIndexSet indexSetWithIndexesInRange:
+	    NSMakeRange(0, cpuLimit)];
+	}
+      if ([set count] == 0)
+	{
+	  return NO;
+	}
+      if (GSThreadPlacementSpread == placement)
+	{
+	  NSUInteger	skip = index % [set count];
+
+	  cpu = [set firstIndex];
+	  while (skip-- > 0)
+	    {
+	      cpu = [set indexGreaterThanIndex: cpu];
+	    }
+	  set = [NSIndexSet indexSetWithIndex: cpu];
+	}
+    }
+  cpu = [set firstIndex];
+  while (NSNotFound != cpu && cpu < CPU_SETSIZE)
+    {
+      CPU_SET(cpu, &mask);
+      cpu = [set indexGreaterThanIndex: cpu];
+    }
+  if (pthread_setaffinity_np(pthread_self(), sizeof(mask), &mask) != 0)
+    {
+      return NO;
+    }
+  return YES;
+#else
+  return (GSThreadPlacementNone == placement) ? YES : NO;
+#endif
+}
+
+/* The timing wheel has four levels of 256 slots.  Each slot of the first
+ * level represents a millisecond, each slot of the second level the 256
+ * milliseconds covered by the whole of the first level and so on.
+ * When the first level wraps round, the timers from the next slot of
+ * the second level are redistributed (cascaded) into the first level,
+ * and similarly for higher levels.
+ */
+#define	WHEEL_BITS	8
+#define	WHEEL_SIZE	(1 << WHEEL_BITS)
+#define	WHEEL_MASK	(WHEEL_SIZE - 1)
+#define	WHEEL_LEVELS	4
+
+@interface	GSTimingWheel : NSObject
+{
+  @public
+  NSCondition		*condition;
+  GSLinkedList		*slots[WHEEL_LEVELS][WHEEL_SIZE];
+  GSLinkedList		*expired;	// Timers due to be fired
+  uint64_t		current;	// Time processed up to
+  uint64_t		wake;		// Time thread will next wake
+  NSUInteger		count;		// Timers in slots
+  NSThread		*thread;
+}
+- (void) add: (GSThreadPoolTimer*)t;
+- (uint64_t) next;
+- (void) run: (id)ignored;
+- (void) tick;
+@end
+
+static GSTimingWheel	*wheel = nil;
+
+@interface	GSThreadPool (Internal)
+- (void) _apply: (GSApplyContext*)context;
+- (void) _fire: (GSThreadPoolTimer*)t;
+- (void) _any;
+- (void) _barrier: (GSThreadPoolTask*)task;
+- (void) _dead: (GSThreadLink*)link;
+- (void) _drained;
+- (GSThreadLink*) _grow;
+- (BOOL) _idle: (GSThreadLink*)link;
+- (BOOL) _isEmpty: (NSArray*)nodes;
+- (BOOL) _isIdle: (NSArray*)nodes;
+- (BOOL) _more: (GSThreadLink*)link;
+- (BOOL) _reap: (GSThreadLink*)link;
+- (void) _cancel: (GSThreadPoolCancelToken*)token;
+- (GSThreadPool*) _node: (NSArray*)nodes;
+- (void) _place: (GSThreadLink*)link;
+- (void) _record: (GSOperation*)op started: (uint64_t)started;
+- (void) _run: (GSThreadLink*)link;
+- (void) _schedule: (GSThreadPoolTask*)tasks
+	     count: (NSUInteger)count
+	   futures: (GSThreadPoolFuture**)futures
+	  priority: (NSUInteger)level;
+- (void) _schedule: (GSThreadPoolTask*)tasks
+	     count: (NSUInteger)count
+	   futures: (GSThreadPoolFuture**)futures
+	  priority: (NSUInteger)level
+	     token: (GSThreadPoolCancelToken*)token;
+- (GSThreadLink*) _spawn;
+- (void) _start: (GSOperation*)op link: (GSThreadLink*)link;
+- (void) _serial: (NSObject*)key;
+- (GSOperation*) _steal;
+- (GSOperation*) _take: (NSUInteger)busy;
+@end
+
+
+@implementation	GSThreadPool
+
+static GSThreadPool	*shared = nil;
+
++ (void) initialize
+{
+  if ([GSThreadPool class] == self && nil == shared)
+    {
+      if ([[NSProcessInfo processInfo] activeProcessorCount] < 2)
+	{
+	  parkerSpin = 0;
+	}
+      wheel = [GSTimingWheel new];
+      shared = [self new];
+    }
+}
+
++ (GSThreadPool*) sharedPool
+{
+  return shared;
+}
+
+#if	defined(__BLOCKS__)
+- (void) applyCount: (NSUInteger)count block: (void (^)(NSUInteger))aBlock
+{
+  GSApplyContext	*context;
+
+  if (nil == aBlock)
+    {
+      [NSException raise: NSInvalidArgumentException
+		  format: @"Nil block"];
+    }
+  if (0 == count)
+    {
+      return;
+    }
+  context = [GSApplyContext new];
+  context->block = [aBlock copy];
+  context->count = count;
+  NS_DURING
+    [self _apply: context];
+  NS_HANDLER
+    [context release];
+    [localException raise];
+  NS_ENDHANDLER
+  [context release];
+}
+#endif
+
+- (void) applyCount: (NSUInteger)count
+	   selector: (SEL)aSelector
+	 onReceiver: (NSObject*)aReceiver
+{
+  GSApplyContext	*context;
+
+  if (0 == aSelector)
+    {
+      [NSException raise: NSInvalidArgumentException
+		  format: @"Null selector"];
+    }
+  if (nil == aReceiver)
+    {
+      [NSException raise: NSInvalidArgumentException
+		  format: @"Nil receiver"];
+    }
+  if (0 == count)
+    {
+      return;
+    }
+  context = [GSApplyContext new];
+  context->receiver = [aReceiver retain];
+  context->sel = aSelector;
+  context->imp = (void (*)(id, SEL, NSUInteger))
+    [aReceiver methodForSelector: aSelector];
+  context->count = count;
+  NS_DURING
+    [self _apply: context];
+  NS_HANDLER
+    [context release];
+    [localException raise];
+  NS_ENDHANDLER
+  [context release];
+}
+
+- (void) dealloc
+{
+  NSMutableArray	*pending;
+  GSThreadLink		*link;
+
+  if (self == shared)
+    {
+      [self retain];
+      [NSException raise: NSInternalInconsistencyException
+	format: @"[GSThreadPool-dealloc] attempt to deallocate shared pool"];
+    }
+  pending = [NSMutableArray new];
+  [poolLock lock];
+  if (0 != lanes)
+    {
+      NSUInteger	lane;
+
+      for (lane = 0; lane < laneCount; lane++)
+	{
+	  abandon(lanes[lane], pending);
+	  [lanes[lane] release];
+	}
+      NSZoneFree(NSDefaultMallocZone(), lanes);
+      lanes = 0;
+    }
+  if (0 != weights)
+    {
+      NSZoneFree(NSDefaultMallocZone(), weights);
+      weights = 0;
+    }
+  if (0 != reserve)
+    {
+      NSZoneFree(NSDefaultMallocZone(), reserve);
+      reserve = 0;
+    }
+  abandon(barriers, pending);
+  [barriers release];
+  barriers = nil;
+  if (nil != serialQueues)
+    {
+      NSEnumerator	*e = [serialQueues objectEnumerator];
+      GSLinkedList	*q;
+
+      while (nil != (q = [e nextObject]))
+	{
+	  abandon(q, pending);
+	}
+      [serialQueues release];
+      serialQueues = nil;
+    }
+  [unused release];
+  unused = nil;
+  if (nil != idle)
+    {
+      while (nil != (link = (GSThreadLink*)idle->head))
+	{
+	  GSLinkedListRemove(link, idle);
+	  parkerPost(&link->parker);
+	}
+      [idle release];
+      idle = nil;
+    }
+  if (nil != live)
+    {
+      while (nil != (link = (GSThreadLink*)live->head))
+	{
+	  GSLinkedListRemove(link, live);
+	  link->pool = nil;
+	}
+      [live release];
+      live = nil;
+    }
+  [poolName release];
+  [poolLock unlock];
+  failFutures(pending, @"Operation abandoned");
+  [pending release];
+  [self setCollectsStatistics: NO];
+  [poolLock release];
+  [drainCondition release];
+  [statsLock release];
+  [placementCPUs release];
+  [nodePools release];
+  [super dealloc];
+}
+
+- (BOOL) collectsStatistics
+{
+  return timing;
+}
+
+- (NSString*) description
+{
+  NSString	*result = [self info];
+
+  [poolLock lock];
+  result = [NSString stringWithFormat: @"%@ %@ %@",
+    [super description], poolName, result];
+  [poolLock unlock];
+  return result;
+}
+
+- (BOOL) drain: (NSDate*)before
+{
+  NSArray	*nodes;
+  BOOL		result;
+
+  [poolLock lock];
+  nodes = [[nodePools retain] autorelease];
+  [poolLock unlock];
+  if (nil != nodes)
+    {
+      NSEnumerator	*e = [nodes objectEnumerator];
+      GSThreadPool	*p;
+
+      while (nil != (p = [e nextObject]))
+	{
+	  if (NO == [p drain: before])
+	    {
+	      return NO;
+	    }
+	}
+    }
+  [drainCondition lock];
+  while (NO == (result = ([self _isEmpty: nodes] && [self _isIdle: nodes])
+    ? YES : NO))
+    {
+      if (NO == [drainCondition waitUntilDate: before])
+	{
+	  result = ([self _isEmpty: nodes] && [self _isIdle: nodes])
+	    ? YES : NO;
+	  break;
+	}
+    }
+  [drainCondition unlock];
+  return result;
+}
+
+- (NSUInteger) flush
+{
+  NSMutableArray	*pending = [NSMutableArray new];
+  NSUInteger		counter;
+  NSUInteger		lane;
+
+  [poolLock lock];
+  counter = queued + barriers->count;
+  if (serialCount > 0 || [serialQueues count] > 0)
+    {
+      NSEnumerator	*e = [serialQueues objectEnumerator];
+      GSLinkedList	*q;
+      GSOperation	*op;
+
+      /* Empty the queues waiting for each key, but keep the entries for
+       * keys whose operation is in progress so that later operations for
+       * those keys still wait for -_serial: to retire them.
+       * A keyed operation still in the main queue has not started, so
+       * its key is no longer in use once that operation is abandoned.
+       */
+      while (nil != (q = [e nextObject]))
+	{
+	  abandon(q, pending);
+	}
+      for (op = (GSOperation*)lanes[laneCount - 1]->head; nil != op;
+	op = (GSOperation*)op->next)
+	{
+	  if (nil != op->key)
+	    {
+	      [serialQueues removeObjectForKey: op->key];
+	    }
+	}
+      counter += serialCount;
+      serialCount = 0;
+    }
+  for (lane = 0; lane < laneCount; lane++)
+    {
+      abandon(lanes[lane], pending);
+    }
+  queued = 0;
+  abandon(barriers, pending);
+  if (localCount > 0)
+    {
+      GSThreadLink	*link = (GSThreadLink*)live->head;
+
+      while (nil != link)
+	{
+	  NSUInteger	c;
+
+	  [link->localLock lock];
+	  c = link->local->count;
+	  abandon(link->local, pending);
+	  [link->localLock unlock];
+	  __sync_fetch_and_sub(&localCount, c);
+	  counter += c;
+	  link = (GSThreadLink*)link->next;
+	}
+    }
+  if (0 == live->count)
+    {
+      [self _drained];
+    }
+  if (nil != nodePools)
+    {
+      NSEnumerator	*e = [nodePools objectEnumerator];
+      GSThreadPool	*p;
+
+      while (nil != (p = [e nextObject]))
+	{
+	  counter += [p flush];
+	}
+    }
+  [poolLock unlock];
+  failFutures(pending, @"Operation abandoned");
+  [pending release];
+  return counter;
+}
+
+- (id) init
+{
+  if ((self = [super init]) != nil)
+    {
+      poolLock = [NSRecursiveLock new];
+      drainCondition = [NSCondition new];
+      statsLock = [NSLock new];
+      poolName = @"GSThreadPool";
+      idle = [GSLinkedList new];
+      live = [GSLinkedList new];
+      laneCount = 1;
+      lanes = (GSLinkedList**)NSZoneMalloc(NSDefaultMallocZone(),
+	sizeof(GSLinkedList*));
+      lanes[0] = [GSLinkedList new];
+      reserve = (NSUInteger*)NSZoneCalloc(NSDefaultMallocZone(),
+	1, sizeof(NSUInteger));
+      barriers = [GSLinkedList new];
+      serialQueues = [NSMutableDictionary new];
+      unused = [GSLinkedList new];
+      [self setOperations: 100];
+      [self setThreads: 2];
+    }
+  return self;
+}
+
+- (NSString*) info
+{
+  NSString	*result;
+
+  [poolLock lock];
+  result = [NSString stringWithFormat:
+    @"queue: %"PRIuPTR"(%"PRIuPTR")"
+    @" threads: %"PRIuPTR"(%"PRIuPTR")"
+    @" active: %"PRIuPTR" processed: %"PRIuPTR""
+    @" suspended: %s",
+    queued + barriers->count, maxOperations,
+    idle->count + live->count, maxThreads, live->count, processed,
+    (suspended ? "yes" : "no")];
+  if (laneCount > 1)
+    {
+      NSMutableString	*m = [[result mutableCopy] autorelease];
+      NSUInteger	lane;
+
+      [m appendString: @" lanes:"];
+      for (lane = 0; lane < laneCount; lane++)
+	{
+	  [m appendFormat: @" %"PRIuPTR, lanes[lane]->count];
+	}
+      result = m;
+    }
+  if (idleTimeout > 0.0)
+    {
+      result = [result stringByAppendingFormat:
+	@" min: %"PRIuPTR" spawned: %u reaped: %"PRIuPTR"",
+	minThreads, created, reaped];
+    }
+  if (YES == workStealing)
+    {
+      result = [result stringByAppendingFormat:
+	@" local: %"PRIuPTR" stolen: %"PRIuPTR"", localCount, stolen];
+    }
+  if ([serialQueues count] > 0)
+    {
+      result = [result stringByAppendingFormat:
+	@" keys: %"PRIuPTR" serial: %"PRIuPTR"",
+	[serialQueues count], serialCount];
+    }
+  if (nil != nodePools)
+    {
+      NSMutableString	*m = [[result mutableCopy] autorelease];
+      NSUInteger	count = [nodePools count];
+      NSUInteger	n;
+
+      /* The sub-pools have threads of their own in addition to ours.
+       */
+      [m appendFormat: @" limit: %"PRIuPTR,
+	maxThreads + count * ((maxThreads + count - 1) / count)];
+      for (n = 0; n < count; n++)
+	{
+	  [m appendFormat: @" node%"PRIuPTR": (%@)",
+	    n, [[nodePools objectAtIndex: n] info]];
+	}
+      result = m;
+    }
+  [poolLock unlock];
+  return result;
+}
+
+- (NSDictionary*) operationStatistics
+{
+  NSMutableDictionary	*d = [NSMutableDictionary dictionary];
+  NSArray		*nodes;
+  NSMapEnumerator	e;
+  GSOperationStats	*k;
+  GSOperationStats	*st;
+  NSUInteger		i;
+
+  [statsLock lock];
+  if (nil != stats)
+    {
+      e = NSEnumerateMapTable(stats);
+      while (NSNextMapEnumeratorPair(&e, (void**)&k, (void**)&st) != 0)
+	{
+	  NSMutableArray	*w;
+	  NSMutableArray	*r;
+	  NSUInteger		i;
+
+	  w = [NSMutableArray arrayWithCapacity: STATS_BUCKETS];
+	  r = [NSMutableArray arrayWithCapacity: STATS_BUCKETS];
+	  for (i = 0; i < STATS_BUCKETS; i++)
+	    {
+	      [w addObject: [NSNumber numberWithUnsignedInt: st->wait[i]]];
+	      [r addObject: [NSNumber numberWithUnsignedInt: st->run[i]]];
+	    }
+	  [d setObject: [NSDictionary dictionaryWithObjectsAndKeys:
+	    [NSNumber numberWithUnsignedLongLong: st->count],
+	    GSThreadPoolCountKey,
+	    [NSNumber numberWithDouble: st->waitTotal / 1000000000.0],
+	    GSThreadPoolWaitTotalKey,
+	    [NSNumber numberWithDouble: st->waitMax / 1000000000.0],
+	    GSThreadPoolWaitMaximumKey,
+	    [NSNumber numberWithDouble: st->runTotal / 1000000000.0],
+	    GSThreadPoolRunTotalKey,
+	    [NSNumber numberWithDouble: st->runMax / 1000000000.0],
+	    GSThreadPoolRunMaximumKey,
+	    w, GSThreadPoolWaitHistogramKey,
+	    r, GSThreadPoolRunHistogramKey,
+	    nil]
+		forKey: statsName(st)];
+	}
+      NSEndMapTableEnumeration(&e);
+    }
+  [statsLock unlock];
+  [poolLock lock];
+  nodes = [[nodePools retain] autorelease];
+  [poolLock unlock];
+  for (i = 0; i < [nodes count]; i++)
+    {
+      statsMerge(d, [[nodes objectAtIndex: i] operationStatistics]);
+    }
+  return d;
+}
+
+- (NSTimeInterval) idleTimeout
+{
+  return idleTimeout;
+}
+
+- (BOOL) isEmpty
+{
+  NSArray	*nodes;
+
+  [poolLock lock];
+  nodes = [[nodePools retain] autorelease];
+  [poolLock unlock];
+  return [self _isEmpty: nodes];
+}
+
+- (BOOL) isIdle
+{
+  NSArray	*nodes;
+
+  [poolLock lock];
+  nodes = [[nodePools retain] autorelease];
+  [poolLock unlock];
+  return [self _isIdle: nodes];
+}
+
+- (BOOL) isSuspended
+{
+  return suspended;
+}
+
+- (NSUInteger) maxOperations
+{
+  return maxOperations;
+}
+
+- (NSUInteger) maxThreads
+{
+  return maxThreads;
+}
+
+- (NSUInteger) minThreads
+{
+  return minThreads;
+}
+
+- (NSUInteger) priorityLevels
+{
+  return laneCount;
+}
+
+- (GSThreadPlacement) placement
+{
+  return placement;
+}
+
+- (NSString*) poolName
+{
+  NSString	*n;
+
+  [poolLock lock];
+  n = RETAIN(poolName);
+  [poolLock unlock];
+  return AUTORELEASE(n);
+}
+
+- (void) resume
+{
+  NSArray	*nodes;
+
+  [poolLock lock];
+  if (YES == suspended)
+    {
+      suspended = NO;
+      /* No longer suspended ... start as many operations as we have idle
+       * threads available for.
+       */
+      [self _any];
+    }
+  nodes = [[nodePools retain] autorelease];
+  [poolLock unlock];
+  [nodes makeObjectsPerformSelector: @selector(resume)];
+}
+
+#if	defined(__BLOCKS__)
+- (void) scheduleBarrierBlock: (GSThreadPoolBlock)aBlock
+{
+  GSThreadPoolTask	task;
+
+  if (nil == aBlock)
+    {
+      [NSException raise: NSInvalidArgumentException
+		  format: @"Nil block"];
+    }
+  task.selector = 0;
+  task.receiver = [aBlock copy];
+  task.argument = nil;
+  NS_DURING
+    [self _barrier: &task];
+  NS_HANDLER
+    [task.receiver release];
+    [localException raise];
+  NS_ENDHANDLER
+  [task.receiver release];
+}
+#endif
+
+- (void) scheduleBarrierSelector: (SEL)aSelector
+		      onReceiver: (NSObject*)aReceiver
+		      withObject: (NSObject*)anArgument
+{
+  GSThreadPoolTask	task;
+
+  if (0 == aSelector)
+    {
+      [NSException raise: NSInvalidArgumentException
+		  format: @"Null selector"];
+    }
+  if (nil == aReceiver)
+    {
+      [NSException raise: NSInvalidArgumentException
+		  format: @"Nil receiver"];
+    }
+  task.selector = aSelector;
+  task.receiver = aReceiver;
+  task.argument = anArgument;
+  [self _barrier: &task];
+}
+
+#if	defined(__BLOCKS__)
+- (void) scheduleBlock: (GSThreadPoolBlock)aBlock
+{
+  GSThreadPoolTask	task;
+
+  if (nil == aBlock)
+    {
+      [NSException raise: NSInvalidArgumentException
+		  format: @"Nil block"];
+    }
+  task.selector = 0;
+  task.receiver = [aBlock copy];
+  task.argument = nil;
+  NS_DURING
+    [self _schedule: &task count: 1 futures: 0
+	 priority: laneCount - 1];
+  NS_HANDLER
+    [task.receiver release];
+    [localException raise];
+  NS_ENDHANDLER
+  [task.receiver release];
+}
+
+- (void) scheduleBlock: (GSThreadPoolBlock)aBlock
+		 token: (GSThreadPoolCancelToken*)aToken
+{
+  GSThreadPoolTask	task;
+
+  if (nil == aBlock)
+    {
+      [NSException raise: NSInvalidArgumentException
+		  format: @"Nil block"];
+    }
+  task.selector = 0;
+  task.receiver = [aBlock copy];
+  task.argument = nil;
+  NS_DURING
+    [self _schedule: &task count: 1 futures: 0
+	 priority: laneCount - 1 token: aToken];
+  NS_HANDLER
+    [task.receiver release];
+    [localException raise];
+  NS_ENDHANDLER
+  [task.receiver release];
+}
+
+- (void) scheduleBlock: (GSThreadPoolBlock)aBlock
+	      priority: (NSUInteger)level
+{
+  GSThreadPoolTask	task;
+
+  if (nil == aBlock)
+    {
+      [NSException raise: NSInvalidArgumentException
+		  format: @"Nil block"];
+    }
+  task.selector = 0;
+  task.receiver = [aBlock copy];
+  task.argument = nil;
+  NS_DURING
+    [self _schedule: &task count: 1 futures: 0 priority: level];
+  NS_HANDLER
+    [task.receiver release];
+    [localException raise];
+  NS_ENDHANDLER
+  [task.receiver release];
+}
+
+- (void) scheduleBlocks: (NSArray*)blocks
+{
+  NSUInteger		count = [blocks count];
+  GSThreadPoolTask	*tasks;
+  NSUInteger		index;
+
+  if (0 == count)
+    {
+      return;
+    }
+  tasks = (GSThreadPoolTask*)NSZoneMalloc(NSDefaultMallocZone(),
+    count * sizeof(GSThreadPoolTask));
+  for (index = 0; index < count; index++)
+    {
+      tasks[index].selector = 0;
+      tasks[index].receiver = [[blocks objectAtIndex: index] copy];
+      tasks[index].argument = nil;
+    }
+  NS_DURING
+    [self _schedule: tasks count: count futures: 0
+	 priority: laneCount - 1];
+  NS_HANDLER
+    for (index = 0; index < count; index++)
+      {
+	[tasks[index].receiver release];
+      }
+    NSZoneFree(NSDefaultMallocZone(), tasks);
+    [localException raise];
+  NS_ENDHANDLER
+  for (index = 0; index < count; index++)
+    {
+      [tasks[index].receiver release];
+    }
+  NSZoneFree(NSDefaultMallocZone(), tasks);
+}
+#endif
+
+- (void) scheduleSelector: (SEL)aSelector
+               onReceiver: (NSObject*)aReceiver
+	       withObject: (NSObject*)anArgument
+{
+  GSThreadPoolTask	task;
+
+  if (0 == aSelector)
+    {
+      [NSException raise: NSInvalidArgumentException
+		  format: @"Null selector"];
+    }
+  if (nil == aReceiver)
+    {
+      [NSException raise: NSInvalidArgumentException
+		  format: @"Nil receiver"];
+    }
+  task.selector = aSelector;
+  task.receiver = aReceiver;
+  task.argument = anArgument;
+  [self _schedule: &task count: 1 futures: 0
+	 priority: laneCount - 1];
+}
+
+- (void) scheduleSelector: (SEL)aSelector
+               onReceiver: (NSObject*)aReceiver
+	       withObject: (NSObject*)anArgument
+		 priority: (NSUInteger)level
+{
+  GSThreadPoolTask	task;
+
+  if (0 == aSelector)
+    {
+      [NSException raise: NSInvalidArgumentException
+		  format: @"Null selector"];
+    }
+  if (nil == aReceiver)
+    {
+      [NSException raise: NSInvalidArgumentException
+		  format: @"Nil receiver"];
+    }
+  task.selector = aSelector;
+  task.receiver = aReceiver;
+  task.argument = anArgument;
+  [self _schedule: &task count: 1 futures: 0 priority: level];
+}
+
+- (void) scheduleSelector: (SEL)aSelector
+               onReceiver: (NSObject*)aReceiver
+	       withObject: (NSObject*)anArgument
+		serialKey: (id<NSCopying>)aKey
+{
+  GSThreadPoolTask	task;
+  GSOperation		*op;
+  GSLinkedList		*q;
+
+  if (nil == aKey)
+    {
+      [self scheduleSelector: aSelector
+		  onReceiver: aReceiver
+		  withObject: anArgument];
+      return;
+    }
+  if (0 == aSelector)
+    {
+      [NSException raise: NSInvalidArgumentException
+		  format: @"Null selector"];
+    }
+  if (nil == aReceiver)
+    {
+      [NSException raise: NSInvalidArgumentException
+		  format: @"Nil receiver"];
+    }
+  task.selector = aSelector;
+  task.receiver = aReceiver;
+  task.argument = anArgument;
+
+  [poolLock lock];
+  if (0 == maxThreads)
+    {
+      [poolLock unlock];
+      perform(aReceiver, aSelector, anArgument, nil);
+      return;
+    }
+  if (nil == (op = (GSOperation*)unused->head))
+    {
+      op = [GSOperation new];
+    }
+  else
+    {
+      GSLinkedListRemove(op, unused);
+    }
+  fill(op, &task, nil, timing);
+  op->key = (NSObject*)[aKey copyWithZone: NSDefaultMallocZone()];
+  op->seq = ++sequence;
+  if (growDelay > 0.0)
+    {
+      op->queued = GSTickerTimeNow();
+    }
+  if (nil == (q = [serialQueues objectForKey: op->key]))
+    {
+      GSLinkedList	*lane = lanes[laneCount - 1];
+
+      /* No operation is in progress for this key, so this one can go
+       * straight into the main queue, and we set up an empty queue
+       * to hold any later operations for the key.
+       */
+      q = [GSLinkedList new];
+      [serialQueues setObject: q forKey: op->key];
+      [q release];
+      GSLinkedListInsertAfter(op, lane, lane->tail);
+      queued++;
+      [self _any];
+    }
+  else
+    {
+      GSLinkedListInsertAfter(op, q, q->tail);
+      serialCount++;
+    }
+  [poolLock unlock];
+}
+
+- (void) scheduleSelector: (SEL)aSelector
+               onReceiver: (NSObject*)aReceiver
+	       withObject: (NSObject*)anArgument
+		    token: (GSThreadPoolCancelToken*)aToken
+{
+  GSThreadPoolTask	task;
+
+  if (0 == aSelector)
+    {
+      [NSException raise: NSInvalidArgumentException
+		  format: @"Null selector"];
+    }
+  if (nil == aReceiver)
+    {
+      [NSException raise: NSInvalidArgumentException
+		  format: @"Nil receiver"];
+    }
+  task.selector = aSelector;
+  task.receiver = aReceiver;
+  task.argument = anArgument;
+  [self _schedule: &task count: 1 futures: 0
+	 priority: laneCount - 1 token: aToken];
+}
+
+- (GSThreadPoolTimer*) scheduleSelector: (SEL)aSelector
+			     onReceiver: (NSObject*)aReceiver
+			     withObject: (NSObject*)anArgument
+				  after: (NSTimeInterval)delay
+{
+  GSThreadPoolTimer	*t;
+
+  if (0 == aSelector)
+    {
+      [NSException raise: NSInvalidArgumentException
+		  format: @"Null selector"];
+    }
+  if (nil == aReceiver)
+    {
+      [NSException raise: NSInvalidArgumentException
+		  format: @"Nil receiver"];
+    }
+  t = [GSThreadPoolTimer new];
+  t->pool = [self retain];
+  [t setItem: aReceiver];
+  t->sel = aSelector;
+  t->arg = [anArgument retain];
+  t->expires = monotonicMilliseconds();
+  if (delay > 0.0)
+    {
+      t->expires += (uint64_t)(delay * 1000.0);
+    }
+  /* The timer may fire (and be released by the wheel) as soon as it is
+   * added, so we take our reference to return first.
+   */
+  [[t retain] autorelease];
+  [wheel add: t];		// Wheel owns the reference from +new
+  return t;
+}
+
+- (GSThreadPoolTimer*) scheduleSelector: (SEL)aSelector
+			     onReceiver: (NSObject*)aReceiver
+			     withObject: (NSObject*)anArgument
+				  every: (NSTimeInterval)interval
+{
+  GSThreadPoolTimer	*t;
+
+  if (0 == aSelector)
+    {
+      [NSException raise: NSInvalidArgumentException
+		  format: @"Null selector"];
+    }
+  if (nil == aReceiver)
+    {
+      [NSException raise: NSInvalidArgumentException
+		  format: @"Nil receiver"];
+    }
+  t = [GSThreadPoolTimer new];
+  t->pool = [self retain];
+  [t setItem: aReceiver];
+  t->sel = aSelector;
+  t->arg = [anArgument retain];
+  t->interval = (uint64_t)(interval * 1000.0);
+  if (0 == t->interval)
+    {
+      t->interval = 1;
+    }
+  t->expires = monotonicMilliseconds() + t->interval;
+  /* The timer may fire (and be released by the wheel) as soon as it is
+   * added, so we take our reference to return first.
+   */
+  [[t retain] autorelease];
+  [wheel add: t];		// Wheel owns the reference from +new
+  return t;
+}
+
+- (void) scheduleSelectors: (GSThreadPoolTask*)tasks count: (NSUInteger)count
+{
+  NSUInteger	index;
+
+  for (index = 0; index < count; index++)
+    {
+      if (0 == tasks[index].selector)
+	{
+	  [NSException raise: NSInvalidArgumentException
+		      format: @"Null selector in task %"PRIuPTR, index];
+	}
+      if (nil == tasks[index].receiver)
+	{
+	  [NSException raise: NSInvalidArgumentException
+		      format: @"Nil receiver in task %"PRIuPTR, index];
+	}
+    }
+  [self _schedule: tasks count: count futures: 0
+	 priority: laneCount - 1];
+}
+
+#if	defined(__BLOCKS__)
+- (GSThreadPoolFuture*) submitBlock: (GSThreadPoolResultBlock)aBlock
+{
+  GSThreadPoolFuture	*future;
+  GSThreadPoolTask	task;
+
+  if (nil == aBlock)
+    {
+      [NSException raise: NSInvalidArgumentException
+		  format: @"Nil block"];
+    }
+  future = [[[GSThreadPoolFuture alloc] _initReturningObject: YES]
+    autorelease];
+  task.selector = 0;
+  task.receiver = [aBlock copy];
+  task.argument = nil;
+  NS_DURING
+    [self _schedule: &task count: 1 futures: &future
+	 priority: laneCount - 1];
+  NS_HANDLER
+    [task.receiver release];
+    [localException raise];
+  NS_ENDHANDLER
+  [task.receiver release];
+  return future;
+}
+#endif
+
+- (GSThreadPoolFuture*) submitSelector: (SEL)aSelector
+			    onReceiver: (NSObject*)aReceiver
+			    withObject: (NSObject*)anArgument
+{
+  return [self submitSelector: aSelector
+		   onReceiver: aReceiver
+		   withObject: anArgument
+			token: nil];
+}
+
+- (GSThreadPoolFuture*) submitSelector: (SEL)aSelector
+			    onReceiver: (NSObject*)aReceiver
+			    withObject: (NSObject*)anArgument
+				 token: (GSThreadPoolCancelToken*)aToken
+{
+  GSThreadPoolFuture	*future;
+  GSThreadPoolTask	task;
+  NSMethodSignature	*sig;
+  BOOL			returnsObject = NO;
+
+  if (0 == aSelector)
+    {
+      [NSException raise: NSInvalidArgumentException
+		  format: @"Null selector"];
+    }
+  if (nil == aReceiver)
+    {
+      [NSException raise: NSInvalidArgumentException
+		  format: @"Nil receiver"];
+    }
+
+  /* We can only keep the result if the method actually returns an object.
+   */
+  sig = [aReceiver methodSignatureForSelector: aSelector];
+  if (nil != sig && '@' == *[sig methodReturnType])
+    {
+      returnsObject = YES;
+    }
+  future = [[[GSThreadPoolFuture alloc] _initReturningObject: returnsObject]
+    autorelease];
+  task.selector = aSelector;
+  task.receiver = aReceiver;
+  task.argument = anArgument;
+  [self _schedule: &task count: 1 futures: &future
+	 priority: laneCount - 1 token: aToken];
+  return future;
+}
+
+- (void) setCollectsStatistics: (BOOL)flag
+{
+  NSArray	*nodes;
+  NSUInteger	n;
+
+  [statsLock lock];
+  if (nil != stats)
+    {
+      NSMapEnumerator	e = NSEnumerateMapTable(stats);
+      GSOperationStats	*k;
+      GSOperationStats	*st;
+
+      while (NSNextMapEnumeratorPair(&e, (void**)&k, (void**)&st) != 0)
+	{
+	  NSZoneFree(NSDefaultMallocZone(), st);
+	}
+      NSEndMapTableEnumeration(&e);
+      NSFreeMapTable(stats);
+      stats = nil;
+    }
+  if (YES == flag)
+    {
+      stats = NSCreateMapTable(statsKeyCallBacks,
+	NSNonOwnedPointerMapValueCallBacks, 0);
+    }
+  timing = flag;
+  [statsLock unlock];
+  [poolLock lock];
+  nodes = [[nodePools retain] autorelease];
+  [poolLock unlock];
+  for (n = 0; n < [nodes count]; n++)
+    {
+      [[nodes objectAtIndex: n] setCollectsStatistics: flag];
+    }
+}
+
+- (void) setGrowthQueueDepth: (NSUInteger)depth delay: (NSTimeInterval)delay
+{
+  [poolLock lock];
+  growDepth = depth;
+  growDelay = (delay > 0.0) ? delay : 0.0;
+  [self _any];
+  [poolLock unlock];
+}
+
+- (void) setIdleTimeout: (NSTimeInterval)seconds
+{
+  [poolLock lock];
+  idleTimeout = (seconds > 0.0) ? seconds : 0.0;
+  [poolLock unlock];
+}
+
+- (void) setMinThreads: (NSUInteger)min
+{
+  [poolLock lock];
+  minThreads = min;
+  [poolLock unlock];
+}
+
+- (void) setPriorityLevels: (NSUInteger)count
+		   weights: (NSArray*)w
+		  reserved: (NSArray*)r
+{
+  NSUInteger	*newWeights = 0;
+  NSUInteger	*newReserve;
+  NSUInteger	lane;
+  NSUInteger	total = 0;
+
+  if (0 == count)
+    {
+      [NSException raise: NSInvalidArgumentException
+		  format: @"[%@-%@] zero priority levels",
+	NSStringFromClass([self class]), NSStringFromSelector(_cmd)];
+    }
+  if ((nil != w && [w count] != count) || (nil != r && [r count] != count))
+    {
+      [NSException raise: NSInvalidArgumentException
+		  format: @"[%@-%@] weights or reserved threads array size"
+	@" does not match the number of levels",
+	NSStringFromClass([self class]), NSStringFromSelector(_cmd)];
+    }
+  for (lane = 0; lane < count; lane++)
+    {
+      if (nil != w && [[w objectAtIndex: lane] integerValue] <= 0)
+	{
+	  [NSException raise: NSInvalidArgumentException
+		      format: @"[%@-%@] bad weight for level %"PRIuPTR,
+	    NSStringFromClass([self class]), NSStringFromSelector(_cmd), lane];
+	}
+      if (nil != r && [[r objectAtIndex: lane] integerValue] < 0)
+	{
+	  [NSException raise: NSInvalidArgumentException
+		      format: @"[%@-%@] bad reserve for level %"PRIuPTR,
+	    NSStringFromClass([self class]), NSStringFromSelector(_cmd), lane];
+	}
+    }
+
+  if (nil != w)
+    {
+      newWeights = (NSUInteger*)NSZoneMalloc(NSDefaultMallocZone(),
+	2 * count * sizeof(NSUInteger));
+      for (lane = 0; lane < count; lane++)
+	{
+	  newWeights[lane] = newWeights[count + lane]
+	    = (NSUInteger)[[w objectAtIndex: lane] integerValue];
+	}
+    }
+
+  /* Each level may use the threads not reserved for more urgent levels.
+   */
+  newReserve = (NSUInteger*)NSZoneMalloc(NSDefaultMallocZone(),
+    count * sizeof(NSUInteger));
+  for (lane = 0; lane < count; lane++)
+    {
+      newReserve[lane] = total;
+      if (nil != r)
+	{
+	  total += (NSUInteger)[[r objectAtIndex: lane] integerValue];
+	}
+    }
+
+  [poolLock lock];
+  if (queued > 0 || barriers->count > 0)
+    {
+      [poolLock unlock];
+      if (0 != newWeights)
+	{
+	  NSZoneFree(NSDefaultMallocZone(), newWeights);
+	}
+      NSZoneFree(NSDefaultMallocZone(), newReserve);
+      [NSException raise: NSInternalInconsistencyException
+		  format: @"[%@-%@] operations are waiting",
+	NSStringFromClass([self class]), NSStringFromSelector(_cmd)];
+    }
+  for (lane = 0; lane < laneCount; lane++)
+    {
+      [lanes[lane] release];
+    }
+  lanes = (GSLinkedList**)NSZoneRealloc(NSDefaultMallocZone(), lanes,
+    count * sizeof(GSLinkedList*));
+  for (lane = 0; lane < count; lane++)
+    {
+      lanes[lane] = [GSLinkedList new];
+    }
+  laneCount = count;
+  currentLane = 0;
+  if (0 != weights)
+    {
+      NSZoneFree(NSDefaultMallocZone(), weights);
+    }
+  weights = newWeights;
+  credits = (0 == weights) ? 0 : weights + count;
+  NSZoneFree(NSDefaultMallocZone(), reserve);
+  reserve = newReserve;
+  [poolLock unlock];
+}
+
+- (void) setOperations: (NSUInteger)max
+{
+  NSArray	*nodes;
+  NSUInteger	n;
+
+  [poolLock lock];
+  maxOperations = max;
+  nodes = [[nodePools retain] autorelease];
+  [poolLock unlock];
+  for (n = 0; n < [nodes count]; n++)
+    {
+      [[nodes objectAtIndex: n] setOperations: max];
+    }
+}
+
+- (void) setPlacement: (GSThreadPlacement)policy cpus: (NSIndexSet*)cpus
+{
+  NSMutableArray	*nodes = nil;
+  NSArray		*old;
+  NSUInteger		count = GSThreadPoolNodeCount();
+
+  if (GSThreadPlacementNode == policy && count > 1)
+    {
+      NSUInteger	threads = (maxThreads + count - 1) / count;
+      NSUInteger	n;
+
+      nodes = [NSMutableArray arrayWithCapacity: count];
+      for (n = 0; n < count; n++)
+	{
+	  GSThreadPool	*p = [GSThreadPool new];
+
+	  [p setPoolName: [NSString stringWithFormat: @"%@-node%"PRIuPTR,
+	    [self poolName], n]];
+	  [p setPlacement: GSThreadPlacementPinned
+		     cpus: GSThreadPoolNodeCPUs(n)];
+	  [p setOperations: maxOperations];
+	  [p setWorkStealing: workStealing];
+	  [p setCollectsStatistics: timing];
+	  [p setThreads: threads];
+	  [nodes addObject: p];
+	  [p release];
+	}
+    }
+  [poolLock lock];
+  if (nil != nodes && (barriers->count > 0 || YES == barrierRunning))
+    {
+      [poolLock unlock];
+      [NSException raise: NSInternalInconsistencyException
+		  format: @"[%@-%@] barriers are in use",
+	NSStringFromClass([self class]), NSStringFromSelector(_cmd)];
+    }
+  if (YES == suspended)
+    {
+      [nodes makeObjectsPerformSelector: @selector(suspend)];
+    }
+  placement = policy;
+  cpus = [cpus copy];
+  [placementCPUs release];
+  placementCPUs = cpus;
+  old = nodePools;
+  nodePools = [nodes copy];
+  [poolLock unlock];
+  if (nil != old)
+    {
+      /* Let the old sub-pools finish their work before they go away.
+       */
+      NSUInteger	n;
+
+      for (n = 0; n < [old count]; n++)
+	{
+	  [[old objectAtIndex: n] drain: [NSDate distantFuture]];
+	}
+      [old release];
+    }
+}
+
+- (void) setPoolName: (NSString*)aName
+{
+  NSString	*s = nil;
+
+  if (aName)
+    {
+      s = AUTORELEASE([aName copy]);
+      NSAssert([s isKindOfClass: [NSString class]], NSInvalidArgumentException);
+    }
+  [poolLock lock];
+  ASSIGN(poolName, s);
+  [poolLock unlock];
+}
+
+- (void) setThreads: (NSUInteger)max
+{
+  NSArray	*nodes = nil;
+
+  [poolLock lock];
+  if (max != maxThreads)
+    {
+      maxThreads = max;
+      if (0 == maxThreads)
+	{
+	  [poolLock unlock];
+	  if (NO == [self drain: [NSDate dateWithTimeIntervalSinceNow: 30.0]])
+	    {
+	      [self flush];
+	    }
+	  [poolLock lock];
+	}
+      while (maxThreads < idle->count + live->count && idle->count > 0)
+	{
+	  GSThreadLink	*link = (GSThreadLink*)idle->head;
+
+	  /* Remove thread link from the idle list, then wake up the
+	   * thread using its parker ... the thread will see
+	   * that it has no operation to work with and will terminate
+	   * itsself and release the link.
+	   */
+	  GSLinkedListRemove(link, idle);
+	  parkerPost(&link->parker);
+	}
+      [self _any];
+      nodes = [[nodePools retain] autorelease];
+    }
+  [poolLock unlock];
+  if (nil != nodes)
+    {
+      NSUInteger	count = [nodes count];
+      NSUInteger	n;
+
+      /* The sub-pools are changed without our lock held, since they may
+       * need to wait for their operations to complete.
+       */
+      for (n = 0; n < count; n++)
+	{
+	  [[nodes objectAtIndex: n] setThreads: (max + count - 1) / count];
+	}
+    }
+}
+
+- (void) setWorkStealing: (BOOL)flag
+{
+  NSArray	*nodes;
+  NSUInteger	n;
+
+  [poolLock lock];
+  workStealing = (flag ? YES : NO);
+  nodes = [[nodePools retain] autorelease];
+  [poolLock unlock];
+  for (n = 0; n < [nodes count]; n++)
+    {
+      [[nodes objectAtIndex: n] setWorkStealing: flag];
+    }
+}
+
+- (void) suspend
+{
+  NSArray	*nodes;
+
+  [poolLock lock];
+  suspended = YES;
+  nodes = [[nodePools retain] autorelease];
+  [poolLock unlock];
+  [nodes makeObjectsPerformSelector: @selector(suspend)];
+}
+
+- (void) updateThroughput
+{
+  NSArray		*nodes;
+  NSMutableDictionary	*instances;
+  NSMutableArray	*names;
+  NSMutableData		*deltas;
+  NSMapEnumerator	e;
+  GSOperationStats	*k;
+  GSOperationStats	*st;
+  NSUInteger		count;
+  NSUInteger		i;
+
+  /* Collect the changes since the last call with the lock held, then
+   * update the GSThroughput instances (which may raise or take a while)
+   * without it.
+   */
+  names = [NSMutableArray array];
+  deltas = [NSMutableData data];
+  [statsLock lock];
+  if (nil != stats)
+    {
+      e = NSEnumerateMapTable(stats);
+      while (NSNextMapEnumeratorPair(&e, (void**)&k, (void**)&st) != 0)
+	{
+	  uint64_t	d[3];
+
+	  if (st->count == st->fedCount)
+	    {
+	      continue;
+	    }
+	  d[0] = st->count - st->fedCount;
+	  d[1] = st->runTotal - st->fedRun;
+	  d[2] = st->waitTotal - st->fedWait;
+	  st->fedCount = st->count;
+	  st->fedRun = st->runTotal;
+	  st->fedWait = st->waitTotal;
+	  [names addObject: statsName(st)];
+	  [deltas appendBytes: d length: sizeof(d)];
+	}
+      NSEndMapTableEnumeration(&e);
+    }
+  [statsLock unlock];
+
+  instances = [[[NSThread currentThread] threadDictionary]
+    objectForKey: @"GSThreadPoolThroughput"];
+  if (nil == instances)
+    {
+      instances = [NSMutableDictionary dictionary];
+      [[[NSThread currentThread] threadDictionary]
+	setObject: instances forKey: @"GSThreadPoolThroughput"];
+    }
+  count = [names count];
+  for (i = 0; i < count; i++)
+    {
+      const uint64_t	*d = ((const uint64_t*)[deltas bytes]) + 3 * i;
+      NSString		*base;
+      NSString		*name;
+      GSThroughput	*t;
+
+      base = [NSString stringWithFormat: @"%@ %@",
+	[self poolName], [names objectAtIndex: i]];
+
+      name = [base stringByAppendingString: @" run"];
+      if (nil == (t = [instances objectForKey: name]))
+	{
+	  t = [GSThroughput new];
+	  [t setName: name];
+	  [instances setObject: t forKey: name];
+	  [t release];
+	}
+      [t add: (unsigned)d[0] duration: d[1] / 1000000000.0];
+
+      name = [base stringByAppendingString: @" wait"];
+      if (nil == (t = [instances objectForKey: name]))
+	{
+	  t = [GSThroughput new];
+	  [t setName: name];
+	  [instances setObject: t forKey: name];
+	  [t release];
+	}
+      [t add: (unsigned)d[0] duration: d[2] / 1000000000.0];
+    }
+
+  /* Sub-pools report under their own names.
+   */
+  [poolLock lock];
+  nodes = [[nodePools retain] autorelease];
+  [poolLock unlock];
+  [nodes makeObjectsPerformSelector: @selector(updateThroughput)];
+}
+
+- (BOOL) workStealing
+{
+  return workStealing;
+}
+@end
+
+/* Adds a timer to the appropriate slot of the wheel.
+ * This function expects the wheel lock to already be held.
+ */
+static void
+wheelInsert(GSTimingWheel *w, GSThreadPoolTimer *t)
+{
+  uint64_t	when = t->expires;
+  unsigned	level;
+  GSLinkedList	*l;
+
+  if (when <= w->current)
+    {
+      when = w->current + 1;	// Overdue ... fire at next tick
+    }
+
+  /* A timer goes in the lowest level at which its expiry time lies in
+   * the same rotation as the current time, so that it is always in a
+   * slot which will be reached (and cascaded or expired) in the future.
+   */
+  for (level = 0; level < WHEEL_LEVELS; level++)
+    {
+      unsigned	shift = WHEEL_BITS * (level + 1);
+
+      if ((when >> shift) == (w->current >> shift))
+	{
+	  break;
+	}
+    }
+  if (WHEEL_LEVELS == level)
+    {
+      /* Too far in the future for the wheel ... put it in the last slot
+       * of the top level to be reached, and it will be put back in the
+       * wheel when that slot is cascaded.
+       */
+      level = WHEEL_LEVELS - 1;
+      when = w->current
+	+ (((uint64_t)WHEEL_MASK) << (WHEEL_BITS * level));
+    }
+  l = w->slots[level][(when >> (WHEEL_BITS * level)) & WHEEL_MASK];
+  GSLinkedListInsertAfter(t, l, l->tail);
+}
+
+@implementation	GSTimingWheel
+
+- (void) add: (GSThreadPoolTimer*)t
+{
+  [condition lock];
+  if (nil == thread)
+    {
+      thread = [[NSThread alloc] initWithTarget: self
+				       selector: @selector(run:)
+					 object: nil];
+      [thread setName: @"GSThreadPoolTimer"];
+      [thread start];
+    }
+  if (0 == count)
+    {
+      current = monotonicMilliseconds();
+    }
+  wheelInsert(self, t);
+  count++;
+  if (t->expires < wake)
+    {
+      [condition signal];	// Timer thread must wake earlier
+    }
+  [condition unlock];
+}
+
+- (void) dealloc
+{
+  unsigned	level;
+  unsigned	slot;
+
+  for (level = 0; level < WHEEL_LEVELS; level++)
+    {
+      for (slot = 0; slot < WHEEL_SIZE; slot++)
+	{
+	  [slots[level][slot] release];
+	}
+    }
+  [expired release];
+  [condition release];
+  [thread release];
+  [super dealloc];
+}
+
+- (id) init
+{
+  if ((self = [super init]) != nil)
+    {
+      unsigned	level;
+      unsigned	slot;
+
+      for (level = 0; level < WHEEL_LEVELS; level++)
+	{
+	  for (slot = 0; slot < WHEEL_SIZE; slot++)
+	    {
+	      slots[level][slot] = [GSLinkedList new];
+	    }
+	}
+      expired = [GSLinkedList new];
+      condition = [NSCondition new];
+      current = monotonicMilliseconds();
+      wake = UINT64_MAX;
+    }
+  return self;
+}
+
+/* Returns the time of the next slot in the first level which has timers,
+ * or the time at which the first level wraps round (when timers will be
+ * cascaded into it) if there is no such slot.
+ * This method expects the wheel lock to already be held.
+ */
+- (uint64_t) next
+{
+  uint64_t	t = current + 1;
+
+  while ((t & WHEEL_MASK) != 0)
+    {
+      if (slots[0][t & WHEEL_MASK]->count > 0)
+	{
+	  return t;
+	}
+      t++;
+    }
+  return t;
+}
+
+- (void) run: (id)ignored
+{
+  NSAutoreleasePool	*arp = [NSAutoreleasePool new];
+
+  [condition lock];
+  for (;;)
+    {
+      uint64_t		now = monotonicMilliseconds();
+      GSThreadPoolTimer	*t;
+
+      if (0 == count)
+	{
+	  current = now;
+	}
+      while (current < now)
+	{
+	  [self tick];
+	}
+
+      /* Fire any expired timers, releasing the lock while we add each
+       * operation to its pool.  A repeating timer is put back into the
+       * wheel unless it was cancelled while we were firing it.
+       */
+      while (nil != (t = (GSThreadPoolTimer*)expired->head))
+	{
+	  GSLinkedListRemove(t, expired);
+	  [condition unlock];
+	  if (NO == t->cancelled)
+	    {
+	      [t->pool _fire: t];
+	    }
+	  [condition lock];
+	  if (t->interval > 0 && NO == t->cancelled)
+	    {
+	      t->expires += t->interval;
+	      if (t->expires <= current)
+		{
+		  /* We fell behind ... skip the missed repeats.
+		   */
+		  t->expires += ((current - t->expires) / t->interval + 1)
+		    * t->interval;
+		}
+	      wheelInsert(self, t);
+	      count++;
+	    }
+	  else
+	    {
+	      t->fired = YES;
+	      [t release];
+	    }
+	}
+
+      [arp release];
+      arp = [NSAutoreleasePool new];
+      if (0 == count)
+	{
+	  wake = UINT64_MAX;
+	  [condition wait];
+	}
+      else
+	{
+	  NSDate	*d;
+
+	  wake = [self next];
+	  now = monotonicMilliseconds();
+	  if (wake > now)
+	    {
+	      d = [[NSDate alloc]
+		initWithTimeIntervalSinceNow: (wake - now) / 1000.0];
+	      [condition waitUntilDate: d];
+	      [d release];
+	    }
+	}
+    }
+}
+
+/* Advances the wheel by one millisecond, cascading timers from higher
+ * levels as needed, and moving the timers which are due to the list of
+ * expired timers.
+ * This method expects the wheel lock to already be held.
+ */
+- (void) tick
+{
+  GSLinkedList		*l;
+  GSThreadPoolTimer	*t;
+
+  current++;
+  if (0 == (current & WHEEL_MASK))
+    {
+      unsigned	level = 1;
+
+      /* Find the highest level which has moved on to a new slot, then
+       * cascade from that level downwards so that timers moved from one
+       * level into the slot just reached in the level below are handled.
+       */
+      while (level < WHEEL_LEVELS - 1
+	&& 0 == ((current >> (WHEEL_BITS * level)) & WHEEL_MASK))
+	{
+	  level++;
+	}
+      while (level > 0)
+	{
+	  unsigned	index;
+
+	  index = (unsigned)((current >> (WHEEL_BITS * level)) & WHEEL_MASK);
+	  l = slots[level][index];
+	  while (nil != (t = (GSThreadPoolTimer*)l->head))
+	    {
+	      GSLinkedListRemove(t, l);
+	      wheelInsert(self, t);
+	    }
+	  level--;
+	}
+    }
+  l = slots[0][current & WHEEL_MASK];
+  while (nil != (t = (GSThreadPoolTimer*)l->head))
+    {
+      GSLinkedListRemove(t, l);
+      if (t->expires > current)
+	{
+	  wheelInsert(self, t);		// Was beyond the span of the wheel
+	}
+      else
+	{
+	  GSLinkedListInsertAfter(t, expired, expired->tail);
+	  count--;
+	}
+    }
+}
+@end
+
+@interface	GSThreadPoolCancelToken (Internal)
+- (BOOL) _addPool: (GSThreadPool*)pool;
+@end
+
+@implementation	GSThreadPoolCancelToken
+
++ (GSThreadPoolCancelToken*) currentToken
+{
+  GSThreadLink	*link = current;
+
+  if (nil == link || nil == link->op)
+    {
+      return nil;
+    }
+  return link->op->token;
+}
+
+- (void) cancel
+{
+  NSArray	*a;
+  NSUInteger	i;
+
+  [lock lock];
+  if (YES == cancelled)
+    {
+      [lock unlock];
+      return;
+    }
+  cancelled = YES;
+  a = pools;
+  pools = nil;
+  [lock unlock];
+
+  for (i = 0; i < [a count]; i++)
+    {
+      [[a objectAtIndex: i] _cancel: self];
+    }
+  [a release];
+}
+
+- (void) dealloc
+{
+  [pools release];
+  [lock release];
+  [super dealloc];
+}
+
+- (id) init
+{
+  if ((self = [super init]) != nil)
+    {
+      lock = [NSLock new];
+    }
+  return self;
+}
+
+- (BOOL) isCancelled
+{
+  return cancelled;
+}
+
+/* Records a pool which may hold operations for the receiver, so that
+ * they can be removed on cancellation.  Returns NO if already cancelled.
+ */
+- (BOOL) _addPool: (GSThreadPool*)pool
+{
+  BOOL	result;
+
+  [lock lock];
+  if (YES == cancelled)
+    {
+      result = NO;
+    }
+  else
+    {
+      if (nil == pools)
+	{
+	  pools = [NSMutableArray new];
+	}
+      if ([pools indexOfObjectIdenticalTo: pool] == NSNotFound)
+	{
+	  [pools addObject: pool];
+	}
+      result = YES;
+    }
+  [lock unlock];
+  return result;
+}
+@end
+
+@implementation	GSThreadPoolTimer
+
+- (void) cancel
+{
+  [wheel->condition lock];
+  if (NO == cancelled)
+    {
+      cancelled = YES;
+      if (nil != owner)
+	{
+	  /* Remove from the wheel and release the wheel's reference.
+	   * The caller holds a reference, so we can't be deallocated here.
+	   */
+	  if (owner != wheel->expired)
+	    {
+	      wheel->count--;
+	    }
+	  GSLinkedListRemove(self, owner);
+	  [self release];
+	}
+    }
+  [wheel->condition unlock];
+}
+
+- (void) dealloc
+{
+  [pool release];
+  [arg release];
+  [super dealloc];
+}
+
+- (NSTimeInterval) interval
+{
+  return interval / 1000.0;
+}
+
+- (BOOL) isValid
+{
+  return (NO == cancelled && NO == fired) ? YES : NO;
+}
+@end
+
+@implementation	GSThreadPoolFuture
+
+- (void) dealloc
+{
+  [condition release];
+  [result release];
+  [exception release];
+  [continuations release];
+  [super dealloc];
+}
+
+- (NSException*) exception
+{
+  NSException	*e;
+
+  [condition lock];
+  e = [exception retain];
+  [condition unlock];
+  return [e autorelease];
+}
+
+- (id) init
+{
+  return [self _initReturningObject: NO];
+}
+
+- (BOOL) isDone
+{
+  return done;
+}
+
+#if	defined(__BLOCKS__)
+- (void) onCompletion: (void (^)(GSThreadPoolFuture*))aBlock
+{
+  [condition lock];
+  if (NO == done)
+    {
+      id	b = [aBlock copy];
+
+      if (nil == continuations)
+	{
+	  continuations = [NSMutableArray new];
+	}
+      [continuations addObject: b];
+      [b release];
+      [condition unlock];
+      return;
+    }
+  [condition unlock];
+  aBlock(self);
+}
+#endif
+
+- (void) onCompletionPerform: (SEL)aSelector target: (NSObject*)aTarget
+{
+  if (0 == aSelector || nil == aTarget)
+    {
+      [NSException raise: NSInvalidArgumentException
+		  format: @"[%@-%@] null selector or nil target",
+	NSStringFromClass([self class]), NSStringFromSelector(_cmd)];
+    }
+  [condition lock];
+  if (NO == done)
+    {
+      GSFutureCallback	*c = [GSFutureCallback new];
+
+      c->target = [aTarget retain];
+      c->sel = aSelector;
+      if (nil == continuations)
+	{
+	  continuations = [NSMutableArray new];
+	}
+      [continuations addObject: c];
+      [c release];
+      [condition unlock];
+      return;
+    }
+  [condition unlock];
+  [aTarget performSelector: aSelector withObject: self];
+}
+
+- (id) result
+{
+  id	r;
+
+  [condition lock];
+  r = [result retain];
+  [condition unlock];
+  return [r autorelease];
+}
+
+- (id) wait
+{
+  id	r;
+
+  [condition lock];
+  while (NO == done)
+    {
+      [condition wait];
+    }
+  r = [result retain];
+  [condition unlock];
+  return [r autorelease];
+}
+
+- (BOOL) waitUntil: (NSDate*)date
+{
+  BOOL	finished;
+
+  [condition lock];
+  while (NO == done)
+    {
+      if (NO == [condition waitUntilDate: date])
+	{
+	  break;
+	}
+    }
+  finished = done;
+  [condition unlock];
+  return finished;
+}
+@end
+
+@implementation	GSThreadPoolFuture (Internal)
+
+- (id) _initReturningObject: (BOOL)flag
+{
+  if ((self = [super init]) != nil)
+    {
+      condition = [NSCondition new];
+      returnsObject = flag;
+    }
+  return self;
+}
+
+- (BOOL) _returnsObject
+{
+  return returnsObject;
+}
+
+/* Completes the future, wakes any waiting threads, and performs any
+ * continuations (trapping and logging exceptions they raise).
+ */
+- (void) _setResult: (id)anObject exception: (NSException*)anException
+{
+  NSMutableArray	*a;
+  NSUInteger		count;
+  NSUInteger		index;
+
+  [condition lock];
+  if (YES == done)
+    {
+      [condition unlock];
+      return;
+    }
+  result = [anObject retain];
+  exception = [anException retain];
+  done = YES;
+  a = continuations;
+  continuations = nil;
+  [condition broadcast];
+  [condition unlock];
+
+  count = [a count];
+  for (index = 0; index < count; index++)
+    {
+      id			c = [a objectAtIndex: index];
+      NSAutoreleasePool		*arp;
+
+      NS_DURING
+	{
+	  arp = [NSAutoreleasePool new];
+	  if ([c isKindOfClass: [GSFutureCallback class]])
+	    {
+	      GSFutureCallback	*f = (GSFutureCallback*)c;
+
+	      [f->target performSelector: f->sel withObject: self];
+	    }
+#if	defined(__BLOCKS__)
+	  else
+	    {
+	      ((void (^)(GSThreadPoolFuture*))c)(self);
+	    }
+#endif
+	  [arp release];
+	}
+      NS_HANDLER
+	{
+	  arp = [NSAutoreleasePool new];
+	  NSLog(@"[%@-%@] continuation %@",
+	    NSStringFromClass([self class]), NSStringFromSelector(_cmd),
+	    localException);
+	  [arp release];
+	}
+      NS_ENDHANDLER
+    }
+  [a release];
+}
+@end
+
+@implementation	GSThreadPool (Internal)
+
+/* Splits the work of an apply operation into chunks, schedules helper
+ * operations in the pool, and takes part in the work until all the
+ * chunks have been claimed, then waits for those in progress in other
+ * threads to complete.
+ */
+- (void) _apply: (GSApplyContext*)context
+{
+  NSUInteger	helpers = maxThreads;
+  NSUInteger	participants;
+
+  /* Aim for several chunks per participating thread so that threads
+   * which get cheap chunks can pick up more of the work.
+   */
+  participants = helpers + 1;
+  context->size = context->count / (participants * 4);
+  if (0 == context->size)
     {
-      s = AUTORELEASE([aName copy]);
-      NSAssert([s isKindOfClass: [NSString class]], NSInvalidArgumentException);
+      context->size = 1;
+    }
+  context->chunks = (context->count + context->size - 1) / context->size;
+  if (helpers >= context->chunks)
+    {
+      helpers = context->chunks - 1;
+    }
+  context->condition = [NSCondition new];
+
+  if (helpers > 0)
+    {
+      GSThreadPoolTask	tasks[helpers];
+      NSUInteger	index;
+
+      for (index = 0; index < helpers; index++)
+	{
+	  tasks[index].selector = @selector(run:);
+	  tasks[index].receiver = context;
+	  tasks[index].argument = nil;
+	}
+      [self _schedule: tasks count: helpers futures: 0
+	 priority: laneCount - 1];
+    }
+
+  [context run: nil];
+
+  [context->condition lock];
+  while (context->finished < context->chunks)
+    {
+      [context->condition wait];
+    }
+  [context->condition unlock];
+
+  if (nil != context->exception)
+    {
+      NSException	*e;
+
+      /* The helpers may already have released the context, so our caller
+       * may deallocate it (and the exception) before re-raising.
+       */
+      e = [[context->exception retain] autorelease];
+      [e raise];
     }
-  [poolLock lock];
-  ASSIGN(poolName, s);
-  [poolLock unlock];
 }
 
-- (void) setThreads: (NSUInteger)max
+/* This method expects the global lock to already be held.
+ */
+- (void) _any
 {
-  [poolLock lock];
-  if (max != maxThreads)
+  if (NO == suspended && NO == barrierRunning)
     {
-      maxThreads = max;
-      if (0 == maxThreads)
+      GSOperation	*op;
+
+      while (queued > 0 || barriers->count > 0)
 	{
-	  [poolLock unlock];
-	  if (NO == [self drain: [NSDate dateWithTimeIntervalSinceNow: 30.0]])
+	  GSThreadLink	*link = (GSThreadLink*)idle->head;
+
+	  if (nil == link && nil == (link = [self _grow]))
 	    {
-	      [self flush];
+	      break;		// No idle thread to perform operation
+	    }
+	  if (nil == (op = [self _take: live->count]))
+	    {
+	      break;		// Nothing which can be started now
+	    }
+	  [self _start: op link: link];
+	  if (YES == op->barrier)
+	    {
+	      return;		// Nothing else may start
 	    }
-	  [poolLock lock];
 	}
-      while (maxThreads < idle->count + live->count && idle->count > 0)
+
+      /* Any threads still idle may steal work from the deques of
+       * busy threads.
+       */
+      while (localCount > 0)
 	{
 	  GSThreadLink	*link = (GSThreadLink*)idle->head;
 
-	  /* Remove thread link from the idle list, then start up the
-	   * thread using the condition lock ... the thread will see
-	   * that it has no operation to work with and will terminate
-	   * itsself and release the link.
-	   */
-	  GSLinkedListRemove(link, idle);
-	  [link->lock lock];
-	  [link->lock unlockWithCondition: 1];
+	  if (nil == link && nil == (link = [self _grow]))
+	    {
+	      break;		// No idle thread to perform operation
+	    }
+	  if (nil == (op = [self _steal]))
+	    {
+	      break;
+	    }
+	  [self _start: op link: link];
+	}
+    }
+}
+
+/* Adds a barrier operation to the shared queue (ignoring the limit on
+ * the size of the queue).
+ */
+- (void) _barrier: (GSThreadPoolTask*)task
+{
+  [poolLock lock];
+  if (nil != nodePools)
+    {
+      [poolLock unlock];
+      [NSException raise: NSInternalInconsistencyException
+		  format: @"[%@-%@] barriers can't be used with node placement",
+	NSStringFromClass([self class]), NSStringFromSelector(_cmd)];
+    }
+  if (maxThreads > 0)
+    {
+      GSOperation	*op = (GSOperation*)unused->head;
+
+      if (nil == op)
+	{
+	  op = [GSOperation new];
+	}
+      else
+	{
+	  GSLinkedListRemove(op, unused);
+	}
+      fill(op, task, nil, timing);
+      op->barrier = YES;
+      op->seq = ++sequence;
+      if (growDelay > 0.0)
+	{
+	  op->queued = GSTickerTimeNow();
 	}
+      GSLinkedListInsertAfter(op, barriers, barriers->tail);
       [self _any];
+      [poolLock unlock];
+      return;
     }
   [poolLock unlock];
+  perform(task->receiver, task->selector, task->argument, nil);
 }
 
-- (void) suspend
+- (void) _dead: (GSThreadLink*)link
 {
   [poolLock lock];
-  suspended = YES;
+  if (link->owner != nil)
+    {
+      GSLinkedListRemove(link, link->owner);
+    }
+  if (0 == live->count)
+    {
+      [self _drained];
+    }
   [poolLock unlock];
 }
-@end
 
-@implementation	GSThreadPool (Internal)
+/* Adds the operation for a timer to the queue (ignoring the limit on the
+ * size of the queue) or performs it immediately if the pool has no threads.
+ */
+- (void) _fire: (GSThreadPoolTimer*)t
+{
+  [poolLock lock];
+  if (maxThreads > 0)
+    {
+      GSOperation	*op = (GSOperation*)unused->head;
+      GSLinkedList	*lane = lanes[laneCount - 1];
+      GSThreadPoolTask	task;
+
+      if (nil == op)
+	{
+	  op = [GSOperation new];
+	}
+      else
+	{
+	  GSLinkedListRemove(op, unused);
+	}
+      task.selector = t->sel;
+      task.receiver = t->item;
+      task.argument = t->arg;
+      fill(op, &task, nil, timing);
+      op->seq = ++sequence;
+      if (growDelay > 0.0)
+	{
+	  op->queued = GSTickerTimeNow();
+	}
+      GSLinkedListInsertAfter(op, lane, lane->tail);
+      queued++;
+      [self _any];
+      [poolLock unlock];
+      return;
+    }
+  [poolLock unlock];
+  perform(t->item, t->sel, t->arg, nil);
+}
+
+/* Creates a new thread if the pool has fewer than the minimum number,
+ * or if the queue is deep enough or has waited long enough to justify
+ * growth, returning nil if no thread should be created.
+ * This method expects the global lock to already be held.
+ */
+- (GSThreadLink*) _grow
+{
+  NSUInteger	threads = idle->count + live->count;
+
+  if (threads > 0 && threads >= minThreads && (growDepth > 0 || growDelay > 0))
+    {
+      NSTimeInterval	oldest = 0.0;
+
+      if (growDelay > 0.0)
+	{
+	  NSUInteger	lane;
+
+	  for (lane = 0; lane < laneCount; lane++)
+	    {
+	      GSOperation	*op = (GSOperation*)lanes[lane]->head;
+
+	      if (nil != op && (0.0 == oldest || op->queued < oldest))
+		{
+		  oldest = op->queued;
+		}
+	    }
+	}
+      if ((0 == growDepth || queued + localCount <= growDepth)
+	&& (0 == growDelay || 0.0 == oldest
+	  || GSTickerTimeNow() - oldest < growDelay))
+	{
+	  return nil;
+	}
+    }
+  return [self _spawn];
+}
+
+/* Wakes any threads waiting in -drain: if there is no more work.
+ */
+- (void) _drained
+{
+  if (0 == queued && 0 == barriers->count && 0 == localCount
+    && 0 == serialCount)
+    {
+      [drainCondition lock];
+      [drainCondition broadcast];
+      [drainCondition unlock];
+    }
+}
+
+/* Returns YES if the receiver and the sub-pools in nodes (read under the
+ * lock by the caller) have no work waiting.  This does not lock, so that
+ * -drain: may call it while holding drainCondition.
+ */
+- (BOOL) _isEmpty: (NSArray*)nodes
+{
+  if (0 == queued && 0 == barriers->count && 0 == localCount
+    && 0 == serialCount)
+    {
+      NSUInteger	i = [nodes count];
+
+      while (i-- > 0)
+	{
+	  if (NO == [[nodes objectAtIndex: i] isEmpty])
+	    {
+	      return NO;
+	    }
+	}
+      return YES;
+    }
+  return NO;
+}
+
+/* Returns YES if the receiver and the sub-pools in nodes have no
+ * operations in progress.  As for -_isEmpty: this does not lock.
+ */
+- (BOOL) _isIdle: (NSArray*)nodes
+{
+  if (0 == live->count)
+    {
+      NSUInteger	i = [nodes count];
+
+      while (i-- > 0)
+	{
+	  if (NO == [[nodes objectAtIndex: i] isIdle])
+	    {
+	      return NO;
+	    }
+	}
+      return YES;
+    }
+  return NO;
+}
+
+/* Make the thread link idle ... returns YES on success, NO if the thread
+ * should actually terminate instead.
+ */
+- (BOOL) _idle: (GSThreadLink*)link
+{
+  BOOL	madeIdle = YES;
+
+  [poolLock lock];
+  if (link->owner != nil) 
+    {
+      GSLinkedListRemove(link, link->owner);
+    }
+  if (idle->count + live->count > maxThreads)
+    {
+      madeIdle = NO;		// Made dead instead
+    }
+  else
+    {
+      GSLinkedListInsertAfter(link, idle, idle->tail);
+    }
+  if (0 == live->count)
+    {
+      /* The last active thread has finished, so we may be able to start
+       * a waiting barrier, or the pool may have drained.
+       */
+      [self _any];
+      [self _drained];
+    }
+  [poolLock unlock];
+  return madeIdle;
+}
+
+/* If there are more operations waiting for work, move the first one from the
+ * operations queue into the supplied thread link.<br />
+ * In any case, remove the old operation.
+ */
+- (BOOL) _more: (GSThreadLink*)link
+{
+  GSOperation	*op = link->op;
+  BOOL		wasBarrier = op->barrier;
+  NSObject	*key = [op->key retain];
+  BOOL		more = NO;
+
+  __sync_fetch_and_add(&processed, 1);
+  if (YES == workStealing && NO == wasBarrier && nil == key
+    && NO == suspended && NO == barrierRunning && 0 == barriers->count
+    && queued <= lanes[laneCount - 1]->count)
+    {
+      /* Keep the old operation for reuse by this thread and take the
+       * most recently added operation from our own deque, all without
+       * using the pool lock.  We only do this if there are no urgent
+       * operations waiting in the shared queues, and the pool is not
+       * suspended or waiting for a barrier (in which case the locked
+       * path below decides what may start).
+       */
+      if (link->spare->count < maxOperations)
+	{
+	  clear(op);
+	  GSLinkedListInsertAfter(op, link->spare, link->spare->tail);
+	}
+      else
+	{
+	  [op release];
+	}
+      if (link->local->count > 0)
+	{
+	  [link->localLock lock];
+	  op = (GSOperation*)link->local->tail;
+	  if (nil != op)
+	    {
+	      GSLinkedListRemove(op, link->local);
+	    }
+	  [link->localLock unlock];
+	  if (nil != op)
+	    {
+	      __sync_fetch_and_sub(&localCount, 1);
+	      link->op = op;
+	      return YES;
+	    }
+	}
+      [poolLock lock];
+    }
+  else
+    {
+      [poolLock lock];
+      if (unused->count < maxOperations)
+	{
+	  clear(op);
+	  GSLinkedListInsertAfter(op, unused, unused->tail);
+	}
+      else
+	{
+	  [op release];
+	}
+    }
+  if (YES == wasBarrier)
+    {
+      barrierRunning = NO;
+    }
+  if (nil != key)
+    {
+      [self _serial: key];	// Release next operation for the key
+      [key release];
+    }
+  if (nil != (op = [self _take: live->count - 1]))
+    {
+      more = YES;
+    }
+  else if (localCount > 0 && NO == suspended && NO == barrierRunning)
+    {
+      /* Nothing available in the shared queue, so try stealing from
+       * a busy thread.  The deques only hold work scheduled before any
+       * waiting barrier, which must be done before the barrier starts.
+       */
+      if (nil != (op = [self _steal]))
+	{
+	  more = YES;
+	}
+    }
+  link->op = op;
+  if (YES == wasBarrier)
+    {
+      [self _any];	// Start operations held back by the barrier
+    }
+  else if (queued > 0 && 0 == idle->count
+    && (growDepth > 0 || growDelay > 0))
+    {
+      [self _any];	// Queue may now justify another thread
+    }
+  [poolLock unlock];
+  return more;
+}
 
-/* This method expects the global lock to already be held.
+/* Removes the operations for a cancelled token from the queues.
  */
-- (void) _any
+- (void) _cancel: (GSThreadPoolCancelToken*)token
 {
-  if (NO == suspended)
+  NSMutableArray	*pending = [NSMutableArray new];
+  NSUInteger		lane;
+  GSThreadLink		*link;
+
+  [poolLock lock];
+  for (lane = 0; lane < laneCount; lane++)
     {
-      GSOperation	*op;
+      GSLinkedList	*l = lanes[lane];
+      GSOperation	*op = (GSOperation*)l->head;
 
-      while (nil != (op = (GSOperation*)operations->head))
+      while (nil != op)
 	{
-	  GSThreadLink	*link = (GSThreadLink*)idle->head;
+	  GSOperation	*next = (GSOperation*)op->next;
 
-	  if (nil == link)
+	  if (op->token == token)
 	    {
-	      if (maxThreads > idle->count + live->count)
+	      GSLinkedListRemove(op, l);
+	      queued--;
+	      if (nil != op->future)
 		{
-		  NSThread	*thread;
-		  NSString	*name;
+		  [pending addObject: op->future];
+		}
+	      clear(op);
+	      GSLinkedListInsertAfter(op, unused, unused->tail);
+	    }
+	  op = next;
+	}
+    }
 
-		  /* Create a new link, add it to the idle list, and start the
-		   * thread which will work with it.
-		   */
-		  link = [GSThreadLink new];
-		  link->pool = self;
-		  GSLinkedListInsertAfter(link, idle, idle->tail);
+  /* Operations in the deques of worker threads can't be recycled (the
+   * spare lists belong to the worker threads), so they are released.
+   */
+  if (localCount > 0)
+    {
+      GSLinkedList	*lists[2];
+      unsigned		i;
 
-#if !defined (GNUSTEP) && (MAC_OS_X_VERSION_MAX_ALLOWED<=MAC_OS_X_VERSION_10_4)
+      lists[0] = idle;
+      lists[1] = live;
+      for (i = 0; i < 2; i++)
+	{
+	  for (link = (GSThreadLink*)lists[i]->head; nil != link;
+	    link = (GSThreadLink*)link->next)
+	    {
+	      GSOperation	*op;
+	      NSUInteger	c = 0;
 
-		  /* With the old thread API we can't get an NSThread object
-		   * until after the thread has started ... so we start the
-		   * thread and then wait for the new thread to have set the
-		   * link item up properly.
-		   */
-		  [NSThread detachNewThreadSelector: @selector(_run:)
-					   toTarget: self
-				         withObject: link];
-		  while (nil == link->item)
-		    {
-		      NSDate	*when;
+	      [link->localLock lock];
+	      op = (GSOperation*)link->local->head;
+	      while (nil != op)
+		{
+		  GSOperation	*next = (GSOperation*)op->next;
 
-		      when = [[NSDate alloc]
-			initWithTimeIntervalSinceNow: 0.001];
-		      [NSThread sleepUntilDate: when];
-		      [when release];
-		    }
-#else
-		  /* New thread API ... create thread object, set it in the
-		   * link, then start the thread.
-		   */
-		  thread = [[NSThread alloc] initWithTarget: self
-						   selector: @selector(_run:)
-						     object: link];
-		  if (nil == (name = poolName))
+		  if (op->token == token)
 		    {
-		      name = @"GSThreadPool";
+		      GSLinkedListRemove(op, link->local);
+		      if (nil != op->future)
+			{
+			  [pending addObject: op->future];
+			}
+		      clear(op);
+		      [op release];
+		      c++;
 		    }
-		  name = [NSString stringWithFormat: @"%@-%u",
-		    name, ++created];
-		  [thread setName: name];
-		  [link setItem: thread];
-		  [thread start];
-		  [thread release];	// Retained by link
-#endif
+		  op = next;
 		}
-	      else
+	      [link->localLock unlock];
+	      if (c > 0)
 		{
-		  break;		// No idle thread to perform operation
+		  __sync_fetch_and_sub(&localCount, c);
 		}
 	    }
-	  GSLinkedListRemove(op, operations);
-	  GSLinkedListRemove(link, idle);
-	  GSLinkedListInsertAfter(link, live, live->tail);
-	  link->op = op;
-	  [link->lock lock];
-	  [link->lock unlockWithCondition: 1];
 	}
     }
-}
-
-- (void) _dead: (GSThreadLink*)link
-{
-  [poolLock lock];
-  if (link->owner != nil)
+  if (0 == live->count)
     {
-      GSLinkedListRemove(link, link->owner);
+      [self _drained];
     }
   [poolLock unlock];
+
+  /* The futures are completed once the locks are released, since their
+   * continuations may schedule work in this pool.
+   */
+  failFutures(pending, @"Operation cancelled");
+  [pending release];
 }
 
-/* Make the thread link idle ... returns YES on success, NO if the thread
- * should actually terminate instead.
+/* Returns the sub-pool (from nodes, a non-empty array of the sub-pools
+ * read under the lock) to be used for an operation scheduled in the
+ * current thread ... the one for the current node unless that is
+ * saturated, in which case the least loaded one.
+ * The counts are read without locking, since this is only a heuristic.
  */
-- (BOOL) _idle: (GSThreadLink*)link
+- (GSThreadPool*) _node: (NSArray*)nodes
 {
-  BOOL	madeIdle = YES;
+  NSUInteger	count = [nodes count];
+  NSUInteger	n = GSThreadPoolCurrentNode() % count;
+  GSThreadPool	*local = [nodes objectAtIndex: n];
+  GSThreadPool	*best;
+  NSUInteger	load;
+  NSUInteger	i;
 
-  [poolLock lock];
-  if (link->owner != nil) 
+  if (local->queued < local->maxOperations
+    && (0 == local->queued || local->idle->count > 0
+    || local->idle->count + local->live->count < local->maxThreads))
     {
-      GSLinkedListRemove(link, link->owner);
+      return local;
     }
-  if (idle->count + live->count > maxThreads)
+  best = local;
+  load = local->queued + local->live->count;
+  for (i = 0; i < count; i++)
     {
-      madeIdle = NO;		// Made dead instead
+      GSThreadPool	*p = [nodes objectAtIndex: i];
+
+      if (p->queued + p->live->count < load)
+	{
+	  best = p;
+	  load = p->queued + p->live->count;
+	}
     }
-  else
+  return best;
+}
+
+/* Applies the placement policy to the thread for a link.
+ */
+- (void) _place: (GSThreadLink*)link
+{
+  GSThreadPlacement	p;
+  NSIndexSet		*cpus;
+
+  [poolLock lock];
+  p = placement;
+  cpus = [[placementCPUs retain] autorelease];
+  [poolLock unlock];
+  if (GSThreadPlacementNone != p
+    && NO == GSThreadPoolPlaceCurrentThread(p, cpus, link->index))
     {
-      GSLinkedListInsertAfter(link, idle, idle->tail);
+      NSLog(@"%@ unable to set CPU affinity for thread %"PRIuPTR,
+	self, link->index);
     }
-  [poolLock unlock];
-  return madeIdle;
 }
 
-/* If there are more operations waiting for work, move the first one from the
- * operations queue into the supplied thread link.<br />
- * In any case, remove the old operation.
+/* Adds the wait and run times of a completed operation to the statistics
+ * for its receiver class and selector.
  */
-- (BOOL) _more: (GSThreadLink*)link
+- (void) _record: (GSOperation*)op started: (uint64_t)started
 {
-  GSOperation	*op = link->op;
-  BOOL		more = NO;
+  uint64_t		finished = monotonicNanoseconds();
+  uint64_t		wait;
+  uint64_t		run;
+  GSOperationStats	key;
+  GSOperationStats	*st;
 
-  [poolLock lock];
-  processed++;
-  if (unused->count < maxOperations)
+  wait = (started > op->enqueued) ? started - op->enqueued : 0;
+  run = finished - started;
+  key.cls = [op->item class];
+  key.sel = op->sel;
+  [statsLock lock];
+  if (nil == stats)
     {
-      if (nil != op->arg)
-	{
-	  [op->arg release];
-	  op->arg = nil;
-	}
-      [op setItem: nil];
-      GSLinkedListInsertAfter(op, unused, unused->tail);
+      [statsLock unlock];
+      return;		// Collection turned off
     }
-  else
+  st = (GSOperationStats*)NSMapGet(stats, &key);
+  if (0 == st)
     {
-      [op release];
+      st = (GSOperationStats*)NSZoneCalloc(NSDefaultMallocZone(),
+	1, sizeof(GSOperationStats));
+      st->cls = key.cls;
+      st->sel = key.sel;
+      NSMapInsert(stats, st, st);
     }
-  link->op = (GSOperation*)operations->head;
-  if (nil != link->op)
+  st->count++;
+  st->waitTotal += wait;
+  if (wait > st->waitMax)
     {
-      GSLinkedListRemove(link->op, operations);
-      more = YES;
+      st->waitMax = wait;
     }
-  [poolLock unlock];
-  return more;
+  st->runTotal += run;
+  if (run > st->runMax)
+    {
+      st->runMax = run;
+    }
+  st->wait[bucket(wait)]++;
+  st->run[bucket(run)]++;
+  [statsLock unlock];
 }
 
 - (void) _run: (GSThreadLink*)link
@@ -530,13 +3651,22 @@ static GSThreadPool	*shared = nil;
    */
   [link setItem: [NSThread currentThread]];
 #endif
+  current = link;
+  [link->pool _place: link];
 
   for (;;)
     {
       GSOperation	*op;
 
-      [link->lock lockWhenCondition: 1];
-//NSLog(@"locked");
+      if (NO == parkerWait(&link->parker, idleTimeout))
+	{
+	  if (YES == [link->pool _reap: link])
+	    {
+	      break;	// Idle for too long
+	    }
+	  continue;
+	}
+//NSLog(@"woken");
       op = link->op;
       if (nil == op)
         {
@@ -545,26 +3675,23 @@ static GSThreadPool	*shared = nil;
         }
       else
         {
-          [link->lock unlockWithCondition: 0];
-//NSLog(@"unlock");
 	  while (nil != op)
 	    {
-	      NS_DURING
+	      if (nil != op->token && YES == [op->token isCancelled])
 		{
-		  arp = [NSAutoreleasePool new];
-		  [op->item performSelector: op->sel withObject: op->arg];
-		  [arp release];
+		  cancelFuture(op->future);
 		}
-	      NS_HANDLER
+	      else if (op->enqueued > 0)
+		{
+		  uint64_t	started = monotonicNanoseconds();
+
+		  perform(op->item, op->sel, op->arg, op->future);
+		  [link->pool _record: op started: started];
+		}
+	      else
 		{
-		  arp = [NSAutoreleasePool new];
-		  NSLog(@"[%@-%@] %@",
-		    NSStringFromClass([op->item class]),
-		    NSStringFromSelector(op->sel),
-		    localException);
-		  [arp release];
+		  perform(op->item, op->sel, op->arg, op->future);
 		}
-	      NS_ENDHANDLER
 	      if (NO == [link->pool _more: link])
 		{
 //NSLog(@"no more");
@@ -591,5 +3718,432 @@ static GSThreadPool	*shared = nil;
   [NSThread exit];	// Will release 'link'
 }
 
+/* Removes an idle thread link from the pool if it has been idle for
+ * too long and the pool has more than the minimum number of threads.
+ * Returns YES if the thread should terminate, NO otherwise.
+ */
+- (BOOL) _reap: (GSThreadLink*)link
+{
+  BOOL	reap = NO;
+
+  [poolLock lock];
+  if (link->owner == idle && idle->count + live->count > minThreads)
+    {
+      GSLinkedListRemove(link, idle);
+      reaped++;
+      reap = YES;
+    }
+  [poolLock unlock];
+  return reap;
+}
+
+/* Adds operations for the tasks to the deque of the current thread (in
+ * work-stealing mode) or to the shared queue, waking threads to handle
+ * them.  Tasks which do not fit in the deque go to the shared queue, and
+ * any for which there is no space there are performed immediately.
+ */
+- (void) _schedule: (GSThreadPoolTask*)tasks
+	     count: (NSUInteger)count
+	   futures: (GSThreadPoolFuture**)futures
+	  priority: (NSUInteger)level
+{
+  [self _schedule: tasks
+	    count: count
+	  futures: futures
+	 priority: level
+	    token: nil];
+}
+
+- (void) _schedule: (GSThreadPoolTask*)tasks
+	     count: (NSUInteger)count
+	   futures: (GSThreadPoolFuture**)futures
+	  priority: (NSUInteger)level
+	     token: (GSThreadPoolCancelToken*)token
+{
+  NSUInteger	done = 0;
+  NSArray	*nodes;
+  BOOL		normal;
+
+  /* The lanes may be replaced by -setPriorityLevels:weights:reserved:,
+   * and the sub-pools by -setPlacement:cpus:, so the level is checked
+   * and the sub-pools are fetched with the lock held.
+   */
+  [poolLock lock];
+  if (level >= laneCount)
+    {
+      [poolLock unlock];
+      [NSException raise: NSInvalidArgumentException
+		  format: @"[%@-%@] priority %"PRIuPTR" out of range",
+	NSStringFromClass([self class]), NSStringFromSelector(_cmd), level];
+    }
+  normal = (level == laneCount - 1) ? YES : NO;
+  nodes = [[nodePools retain] autorelease];
+  [poolLock unlock];
+
+  if (nil != nodes && YES == normal)
+    {
+      GSThreadPool	*node = [self _node: nodes];
+
+      [node _schedule: tasks
+		count: count
+	      futures: futures
+	     priority: node->laneCount - 1
+		token: token];
+      return;
+    }
+  if (nil != token && NO == [token _addPool: self])
+    {
+      /* Already cancelled ... none of the operations may be performed.
+       */
+      while (done < count)
+	{
+	  cancelFuture((0 == futures) ? nil : futures[done]);
+	  done++;
+	}
+      return;
+    }
+  if (YES == workStealing && nil != current && self == current->pool
+    && YES == normal && 0 == barriers->count && NO == barrierRunning)
+    {
+      GSThreadLink	*link = current;
+
+      /* We are running in one of our own threads, so the operations go
+       * into the private deque for this thread.  The spare operations
+       * list is only ever used by this thread, so needs no locking.
+       * While a barrier is waiting or running, operations go to the
+       * shared queue instead, where they are held back behind it.
+       */
+      [link->localLock lock];
+      while (done < count && link->local->count < maxOperations)
+	{
+	  GSOperation	*op = (GSOperation*)link->spare->head;
+
+	  if (nil == op)
+	    {
+	      op = [GSOperation new];
+	    }
+	  else
+	    {
+	      GSLinkedListRemove(op, link->spare);
+	    }
+	  fill(op, tasks + done, (0 == futures) ? nil : futures[done], timing);
+	  op->token = [token retain];
+	  done++;
+	  GSLinkedListInsertAfter(op, link->local, link->local->tail);
+	}
+      [link->localLock unlock];
+      if (done > 0)
+	{
+	  __sync_fetch_and_add(&localCount, done);
+
+	  /* If there may be a thread available to steal work, wake it.
+	   */
+	  if (NO == suspended
+	    && (idle->count > 0 || idle->count + live->count < maxThreads))
+	    {
+	      [poolLock lock];
+	      [self _any];
+	      [poolLock unlock];
+	    }
+	}
+    }
+
+  /* Anything which did not fit in the deque goes to the shared lane.
+   */
+  if (done < count && maxThreads > 0)
+    {
+      GSLinkedList	*lane;
+
+      [poolLock lock];
+      if (level >= laneCount)
+	{
+	  level = laneCount - 1;	// Lanes replaced since we checked
+	}
+      lane = lanes[level];
+      while (done < count && queued < maxOperations)
+	{
+	  GSOperation	*op = (GSOperation*)unused->head;
+
+	  if (nil == op)
+	    {
+	      op = [GSOperation new];		// Need a new one
+	    }
+	  else
+	    {
+	      GSLinkedListRemove(op, unused);	// Re-use an old one
+	    }
+	  fill(op, tasks + done, (0 == futures) ? nil : futures[done], timing);
+	  op->token = [token retain];
+	  done++;
+	  op->seq = ++sequence;
+	  if (growDelay > 0.0)
+	    {
+	      op->queued = GSTickerTimeNow();
+	    }
+	  GSLinkedListInsertAfter(op, lane, lane->tail);
+	  queued++;
+	}
+      if (done > 0)
+	{
+	  [self _any];
+	}
+      [poolLock unlock];
+    }
+
+  while (done < count)
+    {
+      GSThreadPoolTask	*t = tasks + done;
+
+      perform(t->receiver, t->selector, t->argument,
+	(0 == futures) ? nil : futures[done]);
+      done++;
+    }
+}
+
+/* Creates a new thread and adds its link to the idle list, returning the
+ * link or nil if the pool already has its maximum number of threads.
+ * This method expects the global lock to already be held.
+ */
+- (GSThreadLink*) _spawn
+{
+  GSThreadLink	*link;
+  NSThread	*thread;
+  NSString	*name;
+
+  if (maxThreads <= idle->count + live->count)
+    {
+      return nil;
+    }
+
+  /* Create a new link, add it to the idle list, and start the
+   * thread which will work with it.
+   */
+  link = [GSThreadLink new];
+  link->pool = self;
+  link->index = created;
+  GSLinkedListInsertAfter(link, idle, idle->tail);
+
+#if !defined (GNUSTEP) && (MAC_OS_X_VERSION_MAX_ALLOWED<=MAC_OS_X_VERSION_10_4)
+
+  /* With the old thread API we can't get an NSThread object
+   * until after the thread has started ... so we start the
+   * thread and then wait for the new thread to have set the
+   * link item up properly.
+   */
+  [NSThread detachNewThreadSelector: @selector(_run:)
+			   toTarget: self
+			 withObject: link];
+  while (nil == link->item)
+    {
+      NSDate	*when;
+
+      when = [[NSDate alloc]
+	initWithTimeIntervalSinceNow: 0.001];
+      [NSThread sleepUntilDate: when];
+      [when release];
+    }
+#else
+  /* New thread API ... create thread object, set it in the
+   * link, then start the thread.
+   */
+  thread = [[NSThread alloc] initWithTarget: self
+				   selector: @selector(_run:)
+				     object: link];
+  if (nil == (name = poolName))
+    {
+      name = @"GSThreadPool";
+    }
+  name = [NSString stringWithFormat: @"%@-%u",
+    name, ++created];
+  [thread setName: name];
+  [link setItem: thread];
+  [thread start];
+  [thread release];	// Retained by link
+#endif
+  return link;
+}
+
+/* Moves an idle thread link to the live list and sets it going with
+ * the operation.
+ * This method expects the global lock to already be held.
+ */
+- (void) _start: (GSOperation*)op link: (GSThreadLink*)link
+{
+  GSLinkedListRemove(link, idle);
+  GSLinkedListInsertAfter(link, live, live->tail);
+  link->op = op;
+  parkerPost(&link->parker);
+}
+
+/* Removes and returns the next operation which may be started from the
+ * shared queues, or nil if there is none.  The busy argument is the number
+ * of live threads other than the one which will perform the operation.
+ * Operations queued before the first waiting barrier are chosen from the
+ * priority levels using the configured policy, then the barrier is
+ * started once all the earlier work has completed.
+ * This method expects the global lock to already be held.
+ */
+- (GSOperation*) _take: (NSUInteger)busy
+{
+  GSOperation	*barrier = (GSOperation*)barriers->head;
+  uint64_t	limit = (nil == barrier) ? UINT64_MAX : barrier->seq;
+  NSUInteger	lane = laneCount;
+  NSUInteger	n;
+  GSOperation	*op;
+
+  if (YES == barrierRunning)
+    {
+      return nil;
+    }
+
+  if (queued > 0)
+    {
+      if (0 == weights)
+	{
+	  for (n = 0; n < laneCount; n++)
+	    {
+	      op = (GSOperation*)lanes[n]->head;
+	      if (nil != op && op->seq < limit
+		&& (0 == reserve[n] || busy + 1 + reserve[n] <= maxThreads))
+		{
+		  lane = n;
+		  break;
+		}
+	    }
+	}
+      else
+	{
+	  /* Weighted round robin ... the current level supplies operations
+	   * until its credit is used up or it has none we can start, then
+	   * we move on to the next.
+	   */
+	  for (n = 0; n < laneCount; n++)
+	    {
+	      NSUInteger	l = currentLane;
+
+	      op = (GSOperation*)lanes[l]->head;
+	      if (nil != op && op->seq < limit
+		&& (0 == reserve[l] || busy + 1 + reserve[l] <= maxThreads))
+		{
+		  if (0 == --credits[l])
+		    {
+		      credits[l] = weights[l];
+		      currentLane = (l + 1) % laneCount;
+		    }
+		  lane = l;
+		  break;
+		}
+	      credits[l] = weights[l];
+	      currentLane = (l + 1) % laneCount;
+	    }
+	}
+    }
+
+  if (lane < laneCount)
+    {
+      op = (GSOperation*)lanes[lane]->head;
+      GSLinkedListRemove(op, lanes[lane]);
+      queued--;
+      return op;
+    }
+
+  /* A barrier can't start until everything before it is done.
+   */
+  if (nil != barrier && 0 == busy && 0 == localCount)
+    {
+      for (n = 0; n < laneCount; n++)
+	{
+	  op = (GSOperation*)lanes[n]->head;
+	  if (nil != op && op->seq < limit)
+	    {
+	      return nil;	// Held back by reserved threads
+	    }
+	}
+      GSLinkedListRemove(barrier, barriers);
+      barrierRunning = YES;
+      return barrier;
+    }
+  return nil;
+}
+
+/* Called when an operation with a serial key completes, to move the next
+ * operation waiting for that key (if any) into the main queue,
+ * or to discard the queue for the key if there is nothing waiting.
+ * This method expects the global lock to already be held.
+ */
+- (void) _serial: (NSObject*)key
+{
+  GSLinkedList	*q = [serialQueues objectForKey: key];
+
+  if (nil != q)
+    {
+      GSOperation	*op = (GSOperation*)q->head;
+
+      if (nil == op)
+	{
+	  [serialQueues removeObjectForKey: key];
+	}
+      else
+	{
+	  GSLinkedList	*lane = lanes[laneCount - 1];
+	  GSOperation	*pos = (GSOperation*)lane->head;
+
+	  /* The operation has already waited its turn, so it goes ahead of
+	   * any later operations rather than at the tail.  It is kept in
+	   * sequence order so that -_take: does not hold back older work
+	   * behind it (or start a barrier before that work is done).
+	   */
+	  GSLinkedListRemove(op, q);
+	  serialCount--;
+	  while (nil != pos && pos->seq < op->seq)
+	    {
+	      pos = (GSOperation*)pos->next;
+	    }
+	  if (nil == pos)
+	    {
+	      GSLinkedListInsertAfter(op, lane, lane->tail);
+	    }
+	  else
+	    {
+	      GSLinkedListInsertBefore(op, lane, pos);
+	    }
+	  queued++;
+	}
+    }
+}
+
+/* Takes the oldest operation from the deque of a busy thread, or returns
+ * nil if there is none.  Only live threads can have work in their deques.
+ * This method expects the global lock to already be held.
+ */
+- (GSOperation*) _steal
+{
+  GSThreadLink	*link = (GSThreadLink*)live->head;
+
+  while (nil != link && localCount > 0)
+    {
+      if (link->local->count > 0)
+	{
+	  GSOperation	*op;
+
+	  [link->localLock lock];
+	  op = (GSOperation*)link->local->head;
+	  if (nil != op)
+	    {
+	      GSLinkedListRemove(op, link->local);
+	    }
+	  [link->localLock unlock];
+	  if (nil != op)
+	    {
+	      __sync_fetch_and_sub(&localCount, 1);
+	      stolen++;
+	      return op;
+	    }
+	}
+      link = (GSThreadLink*)link->next;
+    }
+  return nil;
+}
+
 @end
 
@@ -0,0 +1,191 @@
+/**
+   Copyright (C) 2026 Free Software Foundation, Inc.
+
+   Written by:  Richard Frith-Macdonald <rfm@gnu.org>
+   Date:        October 2026
+
+   This file is part of the Performance Library.
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 3 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; if not, write to the Free
+   Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111 USA.
+
+   Measures the time from scheduling an operation in a GSThreadPool to
+   the operation starting in a pool thread.  Each operation is scheduled
+   only once the previous one has started, so the figures are for handing
+   work to an idle thread: with no gap between operations the thread is
+   normally still spinning, while with a gap (longer than the spin) it
+   has gone to sleep and must be woken.
+   The tool uses only the public API, so the same source may be built
+   against earlier versions of the library for comparison (eg with and
+   without the parker used to wake idle threads).  Compare runs made
+   with the same options on the same otherwise idle multi-core machine;
+   on a uniprocessor the pool threads never spin, so the hot and idle
+   figures are the same and mostly reflect the kernel scheduler.
+
+   Options (user defaults, eg '-Count 100000'):
+     Count	Number of operations timed in each run (default 10000)
+     Gap	Microseconds between operations in the idle run (default 2000)
+     Threads	Number of threads in the pool (default 1)
+   */
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#import <Foundation/NSAutoreleasePool.h>
+#import <Foundation/NSDate.h>
+#import <Foundation/NSProcessInfo.h>
+#import <Foundation/NSString.h>
+#import <Foundation/NSUserDefaults.h>
+#import "GSThreadPool.h"
+
+#if !defined (GNUSTEP)
+#import  "GNUstep.h"
+#endif
+
+static inline uint64_t
+nanoseconds()
+{
+  struct timespec	ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static int
+compare(const void *a, const void *b)
+{
+  uint64_t	x = *(const uint64_t*)a;
+  uint64_t	y = *(const uint64_t*)b;
+
+  return (x < y) ? -1 : ((x > y) ? 1 : 0);
+}
+
+/* The operation performed in the pool ... records how long after it was
+ * scheduled it started, then tells the scheduling thread it is done.
+ */
+@interface	Probe : NSObject
+{
+@public
+  volatile uint64_t	scheduled;
+  uint64_t		*samples;
+  NSUInteger		count;
+  volatile int		done;
+}
+- (void) run: (id)ignored;
+@end
+
+@implementation	Probe
+- (void) run: (id)ignored
+{
+  samples[count++] = nanoseconds() - scheduled;
+  __sync_synchronize();
+  done = 1;
+}
+@end
+
+/* Times count operations with gap microseconds between them and prints
+ * the distribution of schedule to start latencies.
+ */
+static void
+measure(GSThreadPool *pool, Probe *p, NSUInteger count, unsigned gap,
+  const char *label)
+{
+  uint64_t	total = 0;
+  NSUInteger	i;
+
+  p->count = 0;
+  for (i = 0; i < count; i++)
+    {
+      if (gap > 0)
+	{
+	  usleep(gap);
+	}
+      p->done = 0;
+      __sync_synchronize();
+      p->scheduled = nanoseconds();
+      [pool scheduleSelector: @selector(run:) onReceiver: p withObject: nil];
+      while (0 == p->done)
+	;			// Spin so that we don't add wakeup latency
+    }
+  qsort(p->samples, count, sizeof(uint64_t), compare);
+  for (i = 0; i < count; i++)
+    {
+      total += p->samples[i];
+    }
+  printf("%-6s count:%"PRIuPTR" mean:%.2fus p50:%.2fus p90:%.2fus"
+    " p99:%.2fus max:%.2fus\n", label, (uintptr_t)count,
+    total / (double)count / 1000.0,
+    p->samples[count / 2] / 1000.0,
+    p->samples[count * 9 / 10] / 1000.0,
+    p->samples[count * 99 / 100] / 1000.0,
+    p->samples[count - 1] / 1000.0);
+}
+
+int
+main(int argc, char **argv)
+{
+  NSAutoreleasePool	*arp = [NSAutoreleasePool new];
+  NSUserDefaults	*defs = [NSUserDefaults standardUserDefaults];
+  NSUInteger		cpus = [[NSProcessInfo processInfo]
+    activeProcessorCount];
+  NSInteger		count = [defs integerForKey: @"Count"];
+  NSInteger		gap = [defs integerForKey: @"Gap"];
+  NSInteger		threads = [defs integerForKey: @"Threads"];
+  GSThreadPool		*pool;
+  Probe			*p;
+
+  if (count <= 0)
+    {
+      count = 10000;
+    }
+  if (nil == [defs objectForKey: @"Gap"])
+    {
+      gap = 2000;
+    }
+  if (gap < 0)
+    {
+      gap = 0;
+    }
+  if (threads <= 0)
+    {
+      threads = 1;
+    }
+  printf("GSThreadPool schedule to start latency, %"PRIuPTR" CPUs,"
+    " %"PRIdPTR" pool threads\n", (uintptr_t)cpus, (intptr_t)threads);
+  if (cpus < (NSUInteger)threads + 1)
+    {
+      printf("WARNING: too few CPUs for the pool threads and the scheduling"
+	" thread to run at once, so the figures mostly measure the kernel"
+	" scheduler (and a uniprocessor does not spin at all).\n");
+    }
+
+  pool = [GSThreadPool new];
+  [pool setThreads: threads];
+  [pool setOperations: 100];
+  p = [Probe new];
+  p->samples = (uint64_t*)malloc(count * sizeof(uint64_t));
+
+  measure(pool, p, (count < 1000) ? count : 1000, 0, "warmup");
+  measure(pool, p, count, 0, "hot");
+  measure(pool, p, count, (unsigned)gap, "idle");
+
+  [pool drain: [NSDate distantFuture]];
+  [pool release];
+  free(p->samples);
+  [p release];
+  [arp release];
+  return 0;
+}
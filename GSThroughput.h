@@ -35,6 +35,10 @@ extern NSString * const GSThroughputNotification;
 extern NSString * const GSThroughputCountKey;
 extern NSString * const GSThroughputMaximumKey;
 extern NSString * const GSThroughputMinimumKey;
+extern NSString * const GSThroughputP50Key;
+extern NSString * const GSThroughputP90Key;
+extern NSString * const GSThroughputP99Key;
+extern NSString * const GSThroughputP999Key;
 extern NSString * const GSThroughputTimeKey;
 extern NSString * const GSThroughputTotalKey;
 
@@ -48,6 +52,15 @@ extern NSString * const GSThroughputTotalKey;
  * that a run loop runs in each thread in which you use an instance, so that
  * stats can be updated for that thread every second.
  * </p>
+ * <p>Alternatively, an instance created using the
+ * -initWithDurations:forPeriods:ofLength:concurrent: method with a
+ * concurrent flag of YES may have events added from any thread.  Such an
+ * instance keeps a set of shards which other threads update using atomic
+ * operations (without locking), and the shards are gathered into the
+ * statistics of the instance each second in the thread which created it,
+ * which must run its run loop and tick as above.  All other methods must
+ * only be used in the creating thread.
+ * </p>
  * <p>You create an instance of the class for each event/operation that you
  * are interested in monitoring, and you call the -add: or -addDuration:
  * method to record events.<br />
@@ -145,7 +158,9 @@ extern NSString * const GSThroughputTotalKey;
  * in the configured number of periods.<br />
  * For an instance configured with no periodic breakdown, this produces
  * a short summary of the total count of events and, where durations are used,
- * the maximum, minimum and average duration of events.
+ * the maximum, minimum and average duration of events.<br />
+ * Where durations are used, the 50th, 90th, 99th and 99.9th percentile
+ * durations are also shown (see -percentile:).
  */
 - (NSString*) description;
 
@@ -163,6 +178,11 @@ extern NSString * const GSThroughputTotalKey;
  *   <term>GSThroughputMinimumKey</term>
  *   <desc>The minimum event duration (double floating point number)
  *   or -1.0 if no events occurred during the minute.</desc>
+ *   <term>GSThroughputP50Key, GSThroughputP90Key, GSThroughputP99Key,
+ *   GSThroughputP999Key</term>
+ *   <desc>The 50th, 90th, 99th and 99.9th percentile event durations
+ *   (double floating point numbers), present only if events occurred
+ *   during the minute.</desc>
  *   <term>GSThroughputTimeKey</term>
  *   <desc>The time of the start of the minute (an NSDate)</desc>
  *   <term>GSThroughputTotalKey</term>
@@ -196,7 +216,7 @@ extern NSString * const GSThroughputTotalKey;
  */
 - (id) init;
 
-/** <init />
+/**
  * <p>Initialises the receiver to maintain stats (for the current thread only)
  * over a particular time range, specifying whether duration statistics are
  * to be maintained, or just event/transaction counts.
@@ -215,6 +235,24 @@ extern NSString * const GSThroughputTotalKey;
 	      forPeriods: (unsigned)numberOfPeriods
 		ofLength: (unsigned)minutesPerPeriod;
 
+/** <init />
+ * Initialises the receiver as for -initWithDurations:forPeriods:ofLength:
+ * but, if concurrent is YES, allows the -add:, -add:duration: and
+ * -addDuration: methods to be called from any thread.<br />
+ * Events added by other threads appear in the statistics of the receiver
+ * when it is next updated by the +tick method (or timer) in the thread
+ * which created it, or when its -description is produced in that thread.
+ */
+- (id) initWithDurations: (BOOL)aFlag
+	      forPeriods: (unsigned)numberOfPeriods
+		ofLength: (unsigned)minutesPerPeriod
+	      concurrent: (BOOL)concurrent;
+
+/**
+ * Returns YES if the receiver allows events to be added from any thread.
+ */
+- (BOOL) isConcurrent;
+
 /**
  * Return the name of this instance (as set using -setName:).<br />
  * This is used in the -description method and for ordering instances
@@ -222,6 +260,19 @@ extern NSString * const GSThroughputTotalKey;
  */
 - (NSString*) name;
 
+/**
+ * Returns the duration below which the specified percentage (0.0 to
+ * 100.0) of events fall, for the events in the current period (or for
+ * all events if the receiver was configured with no periodic breakdown).
+ * <br />
+ * Durations are recorded in a log-linear histogram, so the value is
+ * accurate to about 6% (but never outside the minimum and maximum
+ * durations recorded).<br />
+ * You may use this method only if the receiver was initialised with
+ * duration logging turned on.
+ */
+- (NSTimeInterval) percentile: (double)percent;
+
 /**
  * Sets the name of this instance.
  */
@@ -43,6 +43,11 @@
 #import	"GSThroughput.h"
 #import	"GSTicker.h"
 
+#include	<math.h>
+#include	<stdint.h>
+#include	<string.h>
+#include	<unistd.h>
+
 #if !defined (GNUSTEP)
 #import  "GNUstep.h"
 #endif
@@ -52,6 +57,10 @@ NSString * const GSThroughputNotification = @"GSThroughputNotification";
 NSString * const GSThroughputCountKey = @"Count";
 NSString * const GSThroughputMaximumKey = @"Maximum";
 NSString * const GSThroughputMinimumKey = @"Maximum";
+NSString * const GSThroughputP50Key = @"P50";
+NSString * const GSThroughputP90Key = @"P90";
+NSString * const GSThroughputP99Key = @"P99";
+NSString * const GSThroughputP999Key = @"P999";
 NSString * const GSThroughputTimeKey = @"Time";
 NSString * const GSThroughputTotalKey = @"Total";
 
@@ -74,8 +83,181 @@ typedef	struct {
   NSTimeInterval	min;	// Shortest duration
   NSTimeInterval	sum;	// Total (sum of durations for event)
   unsigned		tick;	// Start time
+  uint32_t		*hist;	// Histogram (allocated when first used)
 } DurationInfo;
 
+/* Durations are kept in a log-linear (HDR style) histogram of
+ * microseconds.  Values below HSUB have a bucket each, and each power of
+ * two range above that is split into HSUB equal buckets, so a value is
+ * known to within 1/HSUB of its size.  HBUCKETS covers durations up to
+ * 2^37 microseconds (more than MAXDURATION).
+ */
+#define	HSHIFT		3
+#define	HSUB		(1 << HSHIFT)
+#define	HBUCKETS	((37 - HSHIFT + 1) * HSUB)
+
+static inline unsigned
+hindex(NSTimeInterval t)
+{
+  uint64_t	us = (t > 0.0) ? (uint64_t)(t * 1000000.0) : 0;
+  unsigned	m;
+  unsigned	i;
+
+  if (us < HSUB)
+    {
+      return (unsigned)us;
+    }
+  m = 63 - __builtin_clzll(us);
+  i = (m - HSHIFT + 1) * HSUB + (unsigned)((us >> (m - HSHIFT)) & (HSUB - 1));
+  return (i < HBUCKETS) ? i : HBUCKETS - 1;
+}
+
+/* Returns the duration (in seconds) at the middle of a bucket.
+ */
+static inline NSTimeInterval
+hvalue(unsigned i)
+{
+  unsigned	m;
+  uint64_t	low;
+  uint64_t	width;
+
+  if (i < HSUB)
+    {
+      return i / 1000000.0;
+    }
+  m = i / HSUB + HSHIFT - 1;
+  width = (uint64_t)1 << (m - HSHIFT);
+  low = (uint64_t)(HSUB + i % HSUB) * width;
+  return (low + width / 2) / 1000000.0;
+}
+
+static inline void
+histAdd(DurationInfo *info, NSTimeInterval t, unsigned count)
+{
+  if (0 == info->hist)
+    {
+      info->hist = (uint32_t*)NSZoneCalloc(NSDefaultMallocZone(),
+	HBUCKETS, sizeof(uint32_t));
+    }
+  info->hist[hindex(t)] += count;
+}
+
+static inline void
+histClear(DurationInfo *info)
+{
+  if (0 != info->hist)
+    {
+      memset(info->hist, '\0', HBUCKETS * sizeof(uint32_t));
+    }
+}
+
+static void
+histMerge(DurationInfo *to, const uint32_t *from)
+{
+  unsigned	i;
+
+  if (0 == from)
+    {
+      return;
+    }
+  if (0 == to->hist)
+    {
+      to->hist = (uint32_t*)NSZoneCalloc(NSDefaultMallocZone(),
+	HBUCKETS, sizeof(uint32_t));
+    }
+  for (i = 0; i < HBUCKETS; i++)
+    {
+      to->hist[i] += from[i];
+    }
+}
+
+/* Returns the duration below which the percentage of the events in the
+ * histogram fall, clamped to the known minimum and maximum.
+ */
+static NSTimeInterval
+percentile(const uint32_t *hist, uint64_t cnt, double percent,
+  NSTimeInterval min, NSTimeInterval max)
+{
+  uint64_t	rank;
+  uint64_t	seen = 0;
+  unsigned	i;
+
+  if (0 == hist || 0 == cnt)
+    {
+      return 0.0;
+    }
+  rank = (uint64_t)ceil(percent / 100.0 * cnt);
+  if (rank < 1)
+    {
+      rank = 1;
+    }
+  for (i = 0; i < HBUCKETS; i++)
+    {
+      seen += hist[i];
+      if (seen >= rank)
+	{
+	  NSTimeInterval	v = hvalue(i);
+
+	  if (v > max)
+	    {
+	      v = max;
+	    }
+	  if (v < min)
+	    {
+	      v = min;
+	    }
+	  return v;
+	}
+    }
+  return max;
+}
+
+/* Returns a copy of the notification information with the percentiles
+ * for the duration information added.
+ */
+static NSDictionary*
+withPercentiles(DurationInfo *info, NSDictionary *d)
+{
+  NSMutableDictionary	*m;
+
+  if (0 == info->cnt || 0 == info->hist)
+    {
+      return d;
+    }
+  m = [[d mutableCopy] autorelease];
+  [m setObject: [NSNumber numberWithDouble: percentile(info->hist,
+    info->cnt, 50.0, info->min, info->max)] forKey: GSThroughputP50Key];
+  [m setObject: [NSNumber numberWithDouble: percentile(info->hist,
+    info->cnt, 90.0, info->min, info->max)] forKey: GSThroughputP90Key];
+  [m setObject: [NSNumber numberWithDouble: percentile(info->hist,
+    info->cnt, 99.0, info->min, info->max)] forKey: GSThroughputP99Key];
+  [m setObject: [NSNumber numberWithDouble: percentile(info->hist,
+    info->cnt, 99.9, info->min, info->max)] forKey: GSThroughputP999Key];
+  return m;
+}
+
+/* A shard of the counters of a concurrent instance, updated with atomic
+ * operations by the threads using it and harvested by the owning thread.
+ * Durations are in nanoseconds so that they can be added atomically.
+ * Each shard occupies its own cache line to avoid false sharing, so the
+ * padding depends on the size of a pointer.
+ */
+#define	CACHE_LINE	64
+typedef struct {
+  uint64_t		cnt;
+  uint64_t		sum;
+  uint64_t		min;
+  uint64_t		max;
+  uint32_t		*hist;		// Histogram for durations
+  char			pad[CACHE_LINE - 4 * sizeof(uint64_t)
+			  - sizeof(uint32_t*)];
+} Shard;
+
+/* Fails to compile if a shard is not exactly one cache line (the shards
+ * are aligned by rounding their address up to a multiple of the size).
+ */
+typedef char	ShardSizeCheck[(sizeof(Shard) == CACHE_LINE) ? 1 : -1];
+
 typedef struct {
   void			*seconds;
   void			*minutes;
@@ -93,6 +275,10 @@ typedef struct {
   NSString		*event;		// Name of current event 
   NSString		*name;		// Name of this instance
   GSThroughputThread	*thread;	// Thread info
+  BOOL			concurrent;	// Updated from many threads
+  unsigned		shardMask;	// Number of shards - 1
+  Shard			*shards;	// Cache line aligned shards
+  void			*shardMemory;	// Allocated memory for shards
 } Item;
 #define	my	((Item*)_data)
 
@@ -118,9 +304,65 @@ typedef struct {
 + (GSThroughputThread*) _threadInfo;
 + (void) newSecond: (GSThroughputThread*)t;
 - (void) _detach;
+- (void) _harvest;
+- (void) _merge: (uint64_t)cnt
+	    sum: (NSTimeInterval)sum
+	    min: (NSTimeInterval)min
+	    max: (NSTimeInterval)max
+	   hist: (const uint32_t*)hist;
 - (void) _update;
 @end
 
+/* Returns the shard to be used by the current thread.  Threads are given
+ * shards in turn, so up to the number of shards they never share one.
+ */
+static inline Shard*
+shard(Item *item)
+{
+  static unsigned	counter = 0;
+  static __thread unsigned	index = 0;
+
+  if (0 == index)
+    {
+      index = __sync_add_and_fetch(&counter, 1);
+    }
+  return &item->shards[index & item->shardMask];
+}
+
+/* Records count events taking a total of ns nanoseconds, each of
+ * length ns/count, in the shard.
+ */
+static inline void
+shardAdd(Shard *s, unsigned count, uint64_t ns)
+{
+  uint64_t	length = ns / count;
+  uint64_t	old;
+
+  __sync_fetch_and_add(&s->cnt, count);
+  __sync_fetch_and_add(&s->sum, ns);
+  __sync_fetch_and_add(&s->hist[hindex(length / 1000000000.0)], count);
+  while (length < (old = s->min))
+    {
+      if (__sync_bool_compare_and_swap(&s->min, old, length))
+	{
+	  break;
+	}
+    }
+  while (length > (old = s->max))
+    {
+      if (__sync_bool_compare_and_swap(&s->max, old, length))
+	{
+	  break;
+	}
+    }
+}
+
+static inline uint64_t
+nanoseconds(NSTimeInterval t)
+{
+  return (t > 0.0) ? (uint64_t)(t * 1000000000.0) : 0;
+}
+
 
 
 @implementation	GSThroughputThread
@@ -199,6 +441,108 @@ typedef struct {
   my->thread = nil;
 }
 
+/* Moves the counts accumulated in the shards of a concurrent instance
+ * into the current second.  Must be called in the owning thread.  An
+ * event being added while this runs may have its count and duration
+ * harvested in different seconds.
+ */
+- (void) _harvest
+{
+  unsigned	i;
+
+  for (i = 0; i <= my->shardMask; i++)
+    {
+      Shard	*sh = &my->shards[i];
+      uint64_t	cnt;
+
+      if (0 == sh->cnt)
+	{
+	  continue;
+	}
+      cnt = __sync_lock_test_and_set(&sh->cnt, 0);
+      if (YES == my->supportDurations)
+	{
+	  uint64_t	sum = __sync_lock_test_and_set(&sh->sum, 0);
+	  uint64_t	min = __sync_lock_test_and_set(&sh->min, UINT64_MAX);
+	  uint64_t	max = __sync_lock_test_and_set(&sh->max, 0);
+	  uint32_t	hist[HBUCKETS];
+	  unsigned	j;
+
+	  if (UINT64_MAX == min)
+	    {
+	      min = max;
+	    }
+	  for (j = 0; j < HBUCKETS; j++)
+	    {
+	      hist[j] = (0 == sh->hist[j]) ? 0
+		: __sync_lock_test_and_set(&sh->hist[j], 0);
+	    }
+	  [self _merge: cnt
+		   sum: sum / 1000000000.0
+		   min: min / 1000000000.0
+		   max: max / 1000000000.0
+		  hist: hist];
+	}
+      else if (my->numberOfPeriods == 0)
+	{
+	  cseconds[0].cnt += (unsigned)cnt;
+	  cseconds[1].cnt += (unsigned)cnt;
+	}
+      else
+	{
+	  cseconds[my->second].cnt += (unsigned)cnt;
+	}
+    }
+}
+
+/* Adds a set of events to the current duration information, as done by
+ * -add:duration: but with the minimum and maximum given separately.
+ */
+- (void) _merge: (uint64_t)cnt
+	    sum: (NSTimeInterval)sum
+	    min: (NSTimeInterval)min
+	    max: (NSTimeInterval)max
+	   hist: (const uint32_t*)hist
+{
+  unsigned	from;
+  unsigned	to;
+
+  if (my->numberOfPeriods == 0)
+    {
+      from = 0;		// Total
+      to = 1;		// Current minute
+    }
+  else
+    {
+      from = my->second;
+      to = from;
+    }
+  while (from <= to)
+    {
+      DurationInfo	*info = &dseconds[from++];
+
+      if (info->cnt == 0)
+	{
+	  info->min = min;
+	  info->max = max;
+	}
+      else
+	{
+	  if (max > info->max)
+	    {
+	      info->max = max;
+	    }
+	  if (min < info->min)
+	    {
+	      info->min = min;
+	    }
+	}
+      info->cnt += (unsigned)cnt;
+      info->sum += sum;
+      histMerge(info, hist);
+    }
+}
+
 - (void) _update
 {
   NSTimeInterval        base;
@@ -211,6 +555,10 @@ typedef struct {
 
   base = GSTickerTimeStart();
   tick = GSTickerTimeTick();
+  if (YES == my->concurrent && my->last < tick)
+    {
+      [self _harvest];
+    }
   if (my->numberOfPeriods > 0)
     {
       unsigned	i;
@@ -238,6 +586,7 @@ typedef struct {
 			  info->max = from->max;
 			}
 		      info->sum += from->sum;
+		      histMerge(info, from->hist);
 		    }
                   if (my->notify == YES && my->last > 59)
                     {
@@ -248,7 +597,8 @@ typedef struct {
                       [[NSNotificationCenter defaultCenter]
                         postNotificationName: GSThroughputNotification
                         object: self
-                        userInfo: [NSDictionary dictionaryWithObjectsAndKeys:
+                        userInfo: withPercentiles(info,
+                          [NSDictionary dictionaryWithObjectsAndKeys:
                           [NSNumber numberWithUnsignedInt: info->cnt],
                           GSThroughputCountKey,
                           [NSNumber numberWithDouble: info->max],
@@ -260,7 +610,7 @@ typedef struct {
                           [NSDate dateWithTimeIntervalSinceReferenceDate:
                             base + my->last - 60],
                           GSThroughputTimeKey,
-                          nil]];
+                          nil])];
                       if (info->min < 0.0)
                         {
                           info->min = MAXDURATION;
@@ -283,6 +633,7 @@ typedef struct {
 			      info->max = from->max;
 			    }
 			  info->sum += from->sum;
+			  histMerge(info, from->hist);
 			}
 		      if (my->period++ == my->numberOfPeriods - 1)
 			{
@@ -293,6 +644,7 @@ typedef struct {
 		      info->max = 0.0;
 		      info->min = MAXDURATION;
 		      info->sum = 0.0;
+		      histClear(info);
 		      info->tick = my->last;
 		      my->minute = 0;
 		    }
@@ -301,6 +653,7 @@ typedef struct {
 		  info->max = 0.0;
 		  info->min = MAXDURATION;
 		  info->sum = 0.0;
+		  histClear(info);
 		  info->tick = my->last;
 		  my->second = 0;
 		}
@@ -309,6 +662,7 @@ typedef struct {
 	      info->max = 0.0;
 	      info->min = MAXDURATION;
 	      info->sum = 0.0;
+	      histClear(info);
 	      info->tick = my->last;
 
 	      my->last++;
@@ -389,7 +743,8 @@ typedef struct {
                       [[NSNotificationCenter defaultCenter]
                         postNotificationName: GSThroughputNotification
                         object: self
-                        userInfo: [NSDictionary dictionaryWithObjectsAndKeys:
+                        userInfo: withPercentiles(info,
+                          [NSDictionary dictionaryWithObjectsAndKeys:
                           [NSNumber numberWithUnsignedInt: info->cnt],
                           GSThroughputCountKey,
                           [NSNumber numberWithDouble: info->max],
@@ -401,12 +756,13 @@ typedef struct {
                           [NSDate dateWithTimeIntervalSinceReferenceDate:
                             base + my->last - 60],
                           GSThroughputTimeKey,
-                          nil]];
+                          nil])];
                     }
                   info->cnt = 0;
                   info->max = 0.0;
                   info->min = MAXDURATION;
                   info->sum = 0.0;
+                  histClear(info);
                 }
               else
                 {
@@ -519,7 +875,11 @@ typedef struct {
       [NSException raise: NSInternalInconsistencyException
                   format: @"-add: called when set for durations"];
     }
-  if (my->numberOfPeriods == 0)
+  if (YES == my->concurrent)
+    {
+      __sync_fetch_and_add(&shard(my)->cnt, count);
+    }
+  else if (my->numberOfPeriods == 0)
     {
       cseconds[0].cnt += count; // Total
       cseconds[1].cnt += count; // Current minute
@@ -538,7 +898,14 @@ typedef struct {
                   format: @"-add:duration: called when not set for durations"];
     }
 
-  if (count > 0)
+  if (YES == my->concurrent)
+    {
+      if (count > 0)
+	{
+	  shardAdd(shard(my), count, nanoseconds(length));
+	}
+    }
+  else if (count > 0)
     {
       NSTimeInterval	total = length;
       unsigned          from;
@@ -560,6 +927,7 @@ typedef struct {
         {
           DurationInfo *info = &dseconds[from++];
 
+          histAdd(info, length, count);
           if (info->cnt == 0)
             {
               info->cnt = count;
@@ -595,6 +963,11 @@ typedef struct {
                   format: @"-addDuration: called when not set for durations"];
     }
 
+  if (YES == my->concurrent)
+    {
+      shardAdd(shard(my), 1, nanoseconds(length));
+      return;
+    }
   if (my->numberOfPeriods == 0)
     {
       from = 0; // Total
@@ -609,6 +982,7 @@ typedef struct {
     {
       DurationInfo     *info = &dseconds[from++];
 
+      histAdd(info, length, 1);
       if (info->cnt++ == 0)
         {
           info->min = length;
@@ -681,8 +1055,38 @@ typedef struct {
 	NSInternalInconsistencyException);
       if (my->seconds != 0)
 	{
+	  if (YES == my->supportDurations)
+	    {
+	      unsigned	count = 2;
+	      unsigned	i;
+
+	      if (my->numberOfPeriods > 0)
+		{
+		  count = 60 + my->minutesPerPeriod + my->numberOfPeriods;
+		}
+	      for (i = 0; i < count; i++)
+		{
+		  if (0 != dseconds[i].hist)
+		    {
+		      NSZoneFree(NSDefaultMallocZone(), dseconds[i].hist);
+		    }
+		}
+	    }
 	  NSZoneFree(NSDefaultMallocZone(), my->seconds);
 	}
+      if (my->shardMemory != 0)
+	{
+	  unsigned	i;
+
+	  for (i = 0; i <= my->shardMask; i++)
+	    {
+	      if (0 != my->shards[i].hist)
+		{
+		  NSZoneFree(NSDefaultMallocZone(), my->shards[i].hist);
+		}
+	    }
+	  NSZoneFree(NSDefaultMallocZone(), my->shardMemory);
+	}
       [my->name release];
       if (my->thread != nil)
 	{
@@ -713,8 +1117,12 @@ appendDurationInfo(DurationInfo *info, NSMutableString *m, NSTimeInterval base)
   d = [d initWithTimeIntervalSinceReferenceDate: info->tick + base];
   if (info->cnt)
     {
-      [m appendFormat: @"%u, %g, %g, %g, %@\n",
-	info->cnt, info->max, info->min, info->sum, d];
+      [m appendFormat: @"%u, %g, %g, %g, %@, %g, %g, %g, %g\n",
+	info->cnt, info->max, info->min, info->sum, d,
+	percentile(info->hist, info->cnt, 50.0, info->min, info->max),
+	percentile(info->hist, info->cnt, 90.0, info->min, info->max),
+	percentile(info->hist, info->cnt, 99.0, info->min, info->max),
+	percentile(info->hist, info->cnt, 99.9, info->min, info->max)];
     }
   else
     {
@@ -741,6 +1149,12 @@ appendDurationInfo(DurationInfo *info, NSMutableString *m, NSTimeInterval base)
       NSTimeInterval	baseTime = GSTickerTimeStart();
       unsigned		tick;
 
+      if (YES == my->concurrent
+	&& [NSThread currentThread] == [my->thread thread])
+	{
+	  [self _harvest];
+	}
+
       if (my->numberOfPeriods == 0)
 	{
 	  if (my->supportDurations == YES)
@@ -751,6 +1165,18 @@ appendDurationInfo(DurationInfo *info, NSMutableString *m, NSTimeInterval base)
 		info->cnt, info->max,
 		info->min == MAXDURATION ? 0.0 : info->min,
 		info->cnt == 0 ? 0 : info->sum / info->cnt];
+	      if (info->cnt > 0)
+		{
+		  [m appendFormat: @", p50 %g, p90 %g, p99 %g, p999 %g",
+		    percentile(info->hist, info->cnt, 50.0,
+		      info->min, info->max),
+		    percentile(info->hist, info->cnt, 90.0,
+		      info->min, info->max),
+		    percentile(info->hist, info->cnt, 99.0,
+		      info->min, info->max),
+		    percentile(info->hist, info->cnt, 99.9,
+		      info->min, info->max)];
+		}
 	    }
 	  else
 	    {
@@ -950,6 +1376,17 @@ appendDurationInfo(DurationInfo *info, NSMutableString *m, NSTimeInterval base)
 - (id) initWithDurations: (BOOL)aFlag
               forPeriods: (unsigned)numberOfPeriods
 		ofLength: (unsigned)minutesPerPeriod
+{
+  return [self initWithDurations: aFlag
+		      forPeriods: numberOfPeriods
+			ofLength: minutesPerPeriod
+		      concurrent: NO];
+}
+
+- (id) initWithDurations: (BOOL)aFlag
+              forPeriods: (unsigned)numberOfPeriods
+		ofLength: (unsigned)minutesPerPeriod
+	      concurrent: (BOOL)concurrent
 {
   if (nil != (self = [super init]))
     {
@@ -1069,15 +1506,120 @@ appendDurationInfo(DurationInfo *info, NSMutableString *m, NSTimeInterval base)
 	    }
 	}
       [c release];
+
+      if (YES == concurrent)
+	{
+	  long		cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	  unsigned	count = 4;
+
+	  /* A power of two shards, enough for one per CPU (up to 64).
+	   */
+	  while (count < cpus && count < 64)
+	    {
+	      count *= 2;
+	    }
+	  my->concurrent = YES;
+	  my->shardMask = count - 1;
+	  my->shardMemory = NSZoneCalloc(NSDefaultMallocZone(),
+	    count + 1, sizeof(Shard));
+	  my->shards = (Shard*)(((uintptr_t)my->shardMemory + CACHE_LINE - 1)
+	    & ~(uintptr_t)(CACHE_LINE - 1));
+	  for (i = 0; i < count; i++)
+	    {
+	      my->shards[i].min = UINT64_MAX;
+	      if (YES == my->supportDurations)
+		{
+		  my->shards[i].hist = (uint32_t*)NSZoneCalloc(
+		    NSDefaultMallocZone(), HBUCKETS, sizeof(uint32_t));
+		}
+	    }
+	}
     }
   return self;
 }
 
+- (BOOL) isConcurrent
+{
+  return my->concurrent;
+}
+
 - (NSString*) name
 {
   return my->name;
 }
 
+- (NSTimeInterval) percentile: (double)percent
+{
+  uint32_t		hist[HBUCKETS];
+  uint64_t		cnt = 0;
+  NSTimeInterval	min = MAXDURATION;
+  NSTimeInterval	max = 0.0;
+  unsigned		i;
+
+  if (YES != my->supportDurations)
+    {
+      [NSException raise: NSInternalInconsistencyException
+                  format: @"-percentile: called when not set for durations"];
+    }
+  if (percent < 0.0 || percent > 100.0)
+    {
+      [NSException raise: NSInvalidArgumentException
+                  format: @"-percentile: %g out of range", percent];
+    }
+  if (YES == my->concurrent
+    && [NSThread currentThread] == [my->thread thread])
+    {
+      [self _harvest];
+    }
+  if (my->numberOfPeriods == 0)
+    {
+      DurationInfo	*info = &dseconds[0];
+
+      return percentile(info->hist, info->cnt, percent, info->min, info->max);
+    }
+
+  /* Combine the minutes of the current period with the seconds of the
+   * current minute.
+   */
+  memset(hist, '\0', sizeof(hist));
+  for (i = 0; i < my->minute + 60; i++)
+    {
+      DurationInfo	*from;
+      unsigned		j;
+
+      if (i < my->minute)
+	{
+	  from = &dminutes[i];
+	}
+      else if (i - my->minute <= my->second)
+	{
+	  from = &dseconds[i - my->minute];
+	}
+      else
+	{
+	  break;
+	}
+      if (0 == from->cnt || 0 == from->hist)
+	{
+	  continue;
+	}
+      cnt += from->cnt;
+      if (from->min < min)
+	{
+	  min = from->min;
+	}
+      if (from->max > max)
+	{
+	  max = from->max;
+	}
+      for (j = 0; j < HBUCKETS; j++)
+	{
+	  hist[j] += from->hist[j];
+	}
+    }
+  return percentile(hist, cnt, percent, min, max);
+}
+
 - (void) setName: (NSString*)name
 {
   [name retain];
@@ -1092,6 +1634,12 @@ appendDurationInfo(DurationInfo *info, NSMutableString *m, NSTimeInterval base)
       [NSException raise: NSInternalInconsistencyException
         format: @"-startDuration: for '%@' when not set for durations", name];
     }
+  if (YES == my->concurrent
+    && [NSThread currentThread] != [my->thread thread])
+    {
+      [NSException raise: NSInternalInconsistencyException
+        format: @"-startDuration: for '%@' outside owning thread", name];
+    }
   if (0.0 != my->started)
     {
       [NSException raise: NSInternalInconsistencyException
@@ -25,9 +25,12 @@
    */ 
 
 #import "GSCache.h"
+#import "GSEpollThread.h"
 #import "GSFIFO.h"
+#import "GSIOFileService.h"
 #import "GSIOThreadPool.h"
 #import "GSLinkedList.h"
+#import "GSPriorityFIFO.h"
 #import "GSThreadPool.h"
 #import "GSThroughput.h"
 #import "GSTicker.h"